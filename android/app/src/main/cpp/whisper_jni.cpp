@@ -1,94 +1,566 @@
 #include <jni.h>
 #include <string>
 #include <vector>
-#include "../../../../../../../whisper-cpp/whisper.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
 #include <android/log.h>
+#include "whisper_engine.h"
+#include "arena.h"
 
 #define LOG_TAG "WhisperJNI"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
-static whisper_context* g_context = nullptr;
+static const int kSampleRate = 16000;
+
+// Preprocessing formerly done in Kotlin (WhisperManager.preprocessAudio)
+static const float kPreEmphasis = 0.97f;
+
+// Larger models re-encode the streaming window about once a second rather
+// than on every partial update
+static const int kEncoderRefreshMs = 900;
+
+// Extra ring capacity for one-shot transcriptions, which push the whole recording at once
+static const int kBatchRingSlackMs = 2000;
+
+// Layout of the benchmarkDevice result, mirrored in WhisperManager
+static const int kBenchHeaderFields = 5;     // cpu score, memory, model, threads, peak memory
+static const int kBenchModelFields = 3;      // real-time factor, threads, memory per model
+
+static JavaVM* g_vm = nullptr;
+
+// Engine callbacks run on the session's processing thread. It is attached to
+// the VM on its first callback and detached by this key's destructor when the
+// thread exits at session stop.
+static pthread_key_t g_detach_key;
+
+// TranscriptionListener methods, resolved once in JNI_OnLoad
+static jmethodID g_on_partial = nullptr;
+static jmethodID g_on_final = nullptr;
+static jmethodID g_on_error = nullptr;
+
+// ModelFetcher.fetch, resolved once in JNI_OnLoad
+static jmethodID g_fetch = nullptr;
+
+// Loaded model, shared by the streaming session and one-shot transcriptions
+static vb_model_t* g_model = nullptr;
+
+// Domain vocabulary seeded into every session's decoder prompt
+static std::string g_vocabulary;
+
+// Streaming session and the global ref of its listener. g_session is set and
+// cleared under g_mutex but read without it by pushPcm16, which counts itself
+// in g_session_pushes so stop_session can wait out a push before freeing.
+static std::atomic<vb_engine_t*> g_session{nullptr};
+static std::atomic<int> g_session_pushes{0};
+static jobject g_listener = nullptr;
+static std::mutex g_mutex;
+
+// Final text of the one-shot transcription in flight; reset by every
+// transcription. g_batch_mutex serializes one-shot transcriptions, which
+// decode outside g_mutex.
+static Arena g_batch_arena;
+static std::mutex g_batch_mutex;
+
+static JNIEnv* callback_env() {
+    JNIEnv* env = nullptr;
+    if (g_vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_OK) {
+        return env;
+    }
+    if (g_vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+        LOGE("Failed to attach callback thread");
+        return nullptr;
+    }
+    pthread_setspecific(g_detach_key, env);
+    return env;
+}
+
+static void detach_thread(void*) {
+    g_vm->DetachCurrentThread();
+}
+
+// args follow the text argument of the listener method
+template <typename... Args>
+static void call_listener(jobject listener, jmethodID method, const char* text, Args... args) {
+    JNIEnv* env = callback_env();
+    if (!env) {
+        return;
+    }
+    jstring jtext = env->NewStringUTF(text ? text : "");
+    env->CallVoidMethod(listener, method, jtext, args...);
+    if (env->ExceptionCheck()) {
+        // A throwing listener must not take down the processing thread
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+    env->DeleteLocalRef(jtext);
+}
+
+static void on_stream_result(vb_transcription_result_t* result, void* user_data) {
+    call_listener(static_cast<jobject>(user_data), result->is_final ? g_on_final : g_on_partial,
+                  result->text, (jfloat) result->confidence);
+}
+
+static void on_stream_error(vb_status_t status, const char* message, void* user_data) {
+    LOGE("Engine error %s: %s", vb_engine_status_to_string(status), message);
+    call_listener(static_cast<jobject>(user_data), g_on_error, message);
+}
+
+static vb_engine_config_t session_config(bool streaming, int ring_buffer_ms) {
+    vb_engine_config_t config = {};
+    config.model_type = vb_model_get_type(g_model);
+    // Pinned to the performance cores, capped by the thermal state
+    config.thread_policy = VB_THREADS_ADAPTIVE;
+    config.enable_partial_results = streaming;
+    config.ring_buffer_ms = ring_buffer_ms;
+    config.pre_emphasis = kPreEmphasis;
+    config.normalize_mode = VB_NORMALIZE_PEAK;
+    // A keyboard would rather show partials late than lose words
+    config.overload_policy = streaming ? VB_OVERLOAD_COALESCE : VB_OVERLOAD_BLOCK;
+    if (streaming && config.model_type != VB_MODEL_TINY_EN) {
+        config.encoder_refresh_ms = kEncoderRefreshMs;
+    }
+    // Dictation is mostly a few seconds at a time; no need to encode 30
+    config.dynamic_audio_ctx = true;
+    return config;
+}
+
+// One-shot transcription: a batch session fed the whole recording, with finals
+// collected until stop returns
+static void on_batch_result(vb_transcription_result_t* result, void* user_data) {
+    if (result->is_final && result->text) {
+        static_cast<ArenaString*>(user_data)->append(result->text);
+    }
+}
+
+static void on_batch_error(vb_status_t status, const char* message, void*) {
+    LOGE("Transcription failed: %s: %s", vb_engine_status_to_string(status), message);
+}
+
+// push feeds the session the recording; the ring holds all of it, so the push
+// never waits on the decoder. g_mutex is held only to take a reference to the
+// model, so trimMemory and cleanup do not wait out the decode.
+template <typename Push>
+static jstring run_transcription(JNIEnv *env, size_t n_samples, Push push) {
+    const int duration_ms = (int) ((int64_t) n_samples * 1000 / kSampleRate);
+    vb_model_t* model = nullptr;
+    vb_engine_config_t config;
+    std::string vocabulary;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_model == nullptr) {
+            LOGE("Model not loaded");
+            return nullptr;
+        }
+        model = vb_model_retain(g_model);
+        config = session_config(false, duration_ms + kBatchRingSlackMs);
+        vocabulary = g_vocabulary;
+    }
+    
+    std::lock_guard<std::mutex> batch_lock(g_batch_mutex);
+    vb_engine_t* session = vb_engine_create(&config, model);
+    // The session holds its own reference while attached
+    vb_model_release(model);
+    if (session == nullptr) {
+        LOGE("Failed to create session");
+        return nullptr;
+    }
+    
+    vb_engine_session_set_vocabulary(session, vocabulary.c_str());
+    g_batch_arena.reset();
+    ArenaString transcription(&g_batch_arena);
+    vb_status_t status = vb_engine_session_start(session, on_batch_result, on_batch_error, &transcription);
+    if (status == VB_STATUS_SUCCESS) {
+        status = push(session);
+        vb_engine_session_stop(session);
+    }
+    vb_engine_destroy(session);
+    
+    if (status != VB_STATUS_SUCCESS) {
+        LOGE("Transcription failed: %s", vb_engine_status_to_string(status));
+        return nullptr;
+    }
+    return env->NewStringUTF(transcription.c_str());
+}
+
+// Stops and frees the streaming session; caller holds g_mutex
+static void stop_session(JNIEnv *env) {
+    vb_engine_t* session = g_session.exchange(nullptr);
+    if (session) {
+        // A push that saw the session is a ring copy away from done
+        while (g_session_pushes.load() > 0) {
+            std::this_thread::yield();
+        }
+        // Flushes the remaining audio; final callbacks run before this returns
+        vb_engine_session_stop(session);
+        vb_engine_destroy(session);
+    }
+    if (g_listener) {
+        env->DeleteGlobalRef(g_listener);
+        g_listener = nullptr;
+    }
+}
+
+static vb_model_type_t to_model_type(jint model_type) {
+    return (vb_model_type_t) std::min<jint>(std::max<jint>(model_type, 0), VB_MODEL_TYPE_COUNT - 1);
+}
+
+// Model downloads run on the calling thread, which holds the ModelFetcher
+struct FetchContext {
+    JNIEnv* env;
+    jobject fetcher;
+};
+
+// Hands Kotlin a direct ByteBuffer over the registry's chunk buffer, so the
+// bytes are written once, straight into native memory
+static int64_t fetch_through_java(const char* url, int64_t offset, void* buffer, int64_t capacity,
+                                  void* user_data) {
+    const FetchContext* context = static_cast<const FetchContext*>(user_data);
+    JNIEnv* env = context->env;
+    
+    jstring jurl = env->NewStringUTF(url);
+    jobject jbuffer = env->NewDirectByteBuffer(buffer, capacity);
+    jint n = -1;
+    if (jurl != nullptr && jbuffer != nullptr) {
+        n = env->CallIntMethod(context->fetcher, g_fetch, jurl, (jlong) offset, jbuffer);
+    }
+    if (env->ExceptionCheck()) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+        n = -1;
+    }
+    env->DeleteLocalRef(jbuffer);
+    env->DeleteLocalRef(jurl);
+    return n;
+}
 
 extern "C" {
 
-JNIEXPORT jboolean JNICALL
-Java_com_voiceboard_android_WhisperNative_loadModel(JNIEnv *env, jobject thiz, jstring model_path) {
-    const char* path = env->GetStringUTFChars(model_path, nullptr);
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
+    g_vm = vm;
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return -1;
+    }
+    
+    jclass listener = env->FindClass("com/voiceboard/android/TranscriptionListener");
+    if (listener == nullptr) {
+        LOGE("TranscriptionListener not found");
+        return -1;
+    }
+    g_on_partial = env->GetMethodID(listener, "onPartial", "(Ljava/lang/String;F)V");
+    g_on_final = env->GetMethodID(listener, "onFinal", "(Ljava/lang/String;F)V");
+    g_on_error = env->GetMethodID(listener, "onError", "(Ljava/lang/String;)V");
+    env->DeleteLocalRef(listener);
+    if (g_on_partial == nullptr || g_on_final == nullptr || g_on_error == nullptr) {
+        return -1;
+    }
     
-    if (g_context) {
-        whisper_free(g_context);
-        g_context = nullptr;
+    jclass fetcher = env->FindClass("com/voiceboard/android/ModelFetcher");
+    if (fetcher == nullptr) {
+        LOGE("ModelFetcher not found");
+        return -1;
+    }
+    g_fetch = env->GetMethodID(fetcher, "fetch", "(Ljava/lang/String;JLjava/nio/ByteBuffer;)I");
+    env->DeleteLocalRef(fetcher);
+    if (g_fetch == nullptr) {
+        return -1;
     }
     
-    g_context = whisper_init_from_file(path);
+    pthread_key_create(&g_detach_key, detach_thread);
+    return JNI_VERSION_1_6;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_loadModel(JNIEnv *env, jobject thiz, jstring model_path,
+                                                    jint model_type) {
+    const char* path = env->GetStringUTFChars(model_path, nullptr);
+    
+    // Served from the residency cache when a previous keyboard session left it
+    // warm; a miss loads through the mmap loader, which saves read buffers while
+    // loading (the weights themselves are still heap copies).
+    // GPU where the build has a backend that works on this device, else the CPU.
+    vb_model_t* model = vb_model_acquire(to_model_type(model_type), path, 1, true);
     
     env->ReleaseStringUTFChars(model_path, path);
     
-    if (g_context == nullptr) {
+    if (model == nullptr) {
         LOGE("Failed to load model");
         return JNI_FALSE;
     }
     
-    LOGI("Model loaded successfully");
+    // A running session keeps its own reference and switches at its next start
+    std::lock_guard<std::mutex> lock(g_mutex);
+    vb_model_release(g_model);
+    g_model = model;
+    
+    LOGI("Model loaded on %s", vb_engine_backend_to_string(vb_model_get_backend(model)));
     return JNI_TRUE;
 }
 
-JNIEXPORT jstring JNICALL
-Java_com_voiceboard_android_WhisperNative_transcribe(JNIEnv *env, jobject thiz, jfloatArray audio_data) {
-    if (g_context == nullptr) {
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_startStreaming(JNIEnv *env, jobject thiz, jobject listener) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_model == nullptr) {
         LOGE("Model not loaded");
-        return nullptr;
+        return JNI_FALSE;
     }
+    stop_session(env);
     
-    jsize length = env->GetArrayLength(audio_data);
-    jfloat* samples = env->GetFloatArrayElements(audio_data, nullptr);
+    const vb_engine_config_t config = session_config(true, 0);
+    vb_engine_t* session = vb_engine_create(&config, g_model);
+    if (session == nullptr) {
+        LOGE("Failed to create session");
+        return JNI_FALSE;
+    }
+    
+    vb_engine_session_set_vocabulary(session, g_vocabulary.c_str());
+    g_listener = env->NewGlobalRef(listener);
+    const vb_status_t status = vb_engine_session_start(session, on_stream_result, on_stream_error, g_listener);
+    if (status != VB_STATUS_SUCCESS) {
+        LOGE("Failed to start session: %s", vb_engine_status_to_string(status));
+        vb_engine_destroy(session);
+        stop_session(env);
+        return JNI_FALSE;
+    }
+    // pushPcm16 only ever sees a started session
+    g_session.store(session);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_pushPcm16(JNIEnv *env, jobject thiz, jobject pcm_buffer,
+                                                    jint byte_offset, jint n_samples) {
+    // Direct buffers are read in place; the engine copies into its ring without blocking
+    const uint8_t* base = static_cast<const uint8_t*>(env->GetDirectBufferAddress(pcm_buffer));
+    const jlong capacity = env->GetDirectBufferCapacity(pcm_buffer);
+    if (base == nullptr || byte_offset < 0 || n_samples < 0 ||
+        (jlong) byte_offset + (jlong) n_samples * 2 > capacity) {
+        LOGE("Invalid PCM buffer");
+        return JNI_FALSE;
+    }
     
-    // Convert to vector
-    std::vector<float> audio(samples, samples + length);
+    vb_audio_buffer_i16_t audio;
+    audio.samples = reinterpret_cast<const int16_t*>(base + byte_offset);
+    audio.n_samples = n_samples;
+    audio.sample_rate = kSampleRate;
     
-    // Set up parameters
-    whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-    params.n_threads = 4;
-    params.offset_ms = 0;
-    params.duration_ms = 0;
-    params.translate = false;
-    params.no_context = false;
-    params.single_segment = false;
-    params.print_realtime = false;
-    params.print_progress = false;
-    params.print_timestamps = false;
-    params.print_special = false;
+    // Never takes g_mutex: stopStreaming holds it through the final decode,
+    // and the recording thread must not wait on that
+    g_session_pushes.fetch_add(1);
+    vb_engine_t* session = g_session.load();
+    const bool pushed = session != nullptr &&
+        vb_engine_session_process_audio_i16(session, &audio) == VB_STATUS_SUCCESS;
+    g_session_pushes.fetch_sub(1);
+    return pushed ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_voiceboard_android_WhisperNative_setVocabulary(JNIEnv *env, jobject thiz, jstring vocabulary) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_vocabulary.clear();
+    if (vocabulary != nullptr) {
+        const char* chars = env->GetStringUTFChars(vocabulary, nullptr);
+        g_vocabulary = chars;
+        env->ReleaseStringUTFChars(vocabulary, chars);
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_com_voiceboard_android_WhisperNative_stopStreaming(JNIEnv *env, jobject thiz) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    stop_session(env);
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_voiceboard_android_WhisperNative_transcribe(JNIEnv *env, jobject thiz, jfloatArray audio_data) {
+    const jsize length = env->GetArrayLength(audio_data);
+    return run_transcription(env, (size_t) length, [&](vb_engine_t* session) {
+        // The array is pinned rather than copied, only for the push into the
+        // session ring; no JNI calls are made while it is held
+        jfloat* samples = static_cast<jfloat*>(env->GetPrimitiveArrayCritical(audio_data, nullptr));
+        if (samples == nullptr) {
+            LOGE("Failed to access audio data");
+            return VB_STATUS_AUDIO_ERROR;
+        }
+        
+        vb_audio_buffer_t audio;
+        audio.samples = samples;
+        audio.n_samples = length;
+        audio.sample_rate = kSampleRate;
+        const vb_status_t status = vb_engine_session_process_audio(session, &audio);
+        
+        env->ReleasePrimitiveArrayCritical(audio_data, samples, JNI_ABORT);
+        return status;
+    });
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_voiceboard_android_WhisperNative_transcribePcm16(JNIEnv *env, jobject thiz,
+                                                          jobject pcm_buffer, jint n_samples) {
+    // Direct buffers are read in place; no Java heap array is involved
+    const int16_t* pcm = static_cast<const int16_t*>(env->GetDirectBufferAddress(pcm_buffer));
+    const jlong capacity = env->GetDirectBufferCapacity(pcm_buffer);
+    if (pcm == nullptr || n_samples < 0 || (jlong) n_samples * 2 > capacity) {
+        LOGE("Invalid PCM buffer");
+        return nullptr;
+    }
     
-    // Run transcription
-    int result = whisper_full(g_context, params, audio.data(), length);
+    // Conversion, pre-emphasis and peak normalization happen in the engine
+    vb_audio_buffer_i16_t audio;
+    audio.samples = pcm;
+    audio.n_samples = n_samples;
+    audio.sample_rate = kSampleRate;
+    return run_transcription(env, (size_t) n_samples, [&](vb_engine_t* session) {
+        return vb_engine_session_process_audio_i16(session, &audio);
+    });
+}
+
+// Answered from the registry's index of verified files; no model bytes are read
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_isModelAvailable(JNIEnv *env, jobject thiz, jint model_type,
+                                                           jstring models_dir) {
+    const char* dir = env->GetStringUTFChars(models_dir, nullptr);
+    const bool available = vb_engine_is_model_available(to_model_type(model_type), dir);
+    env->ReleaseStringUTFChars(models_dir, dir);
+    return available ? JNI_TRUE : JNI_FALSE;
+}
+
+// Blocks until the model is in place and verified; resumes an interrupted download
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_downloadModel(JNIEnv *env, jobject thiz, jint model_type,
+                                                        jstring models_dir, jobject fetcher) {
+    const char* dir = env->GetStringUTFChars(models_dir, nullptr);
+    FetchContext context = {env, fetcher};
+    const vb_status_t status = vb_engine_download_model(to_model_type(model_type), dir,
+                                                        fetch_through_java, &context);
+    env->ReleaseStringUTFChars(models_dir, dir);
     
-    env->ReleaseFloatArrayElements(audio_data, samples, JNI_ABORT);
+    if (status != VB_STATUS_SUCCESS) {
+        LOGE("Model download failed: %s", vb_engine_status_to_string(status));
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
+
+// Converts the downloaded model to the quantization the last benchmark recommends
+// (once; later calls find the variant indexed) and returns the file name to load,
+// or null when the conversion failed and the downloaded file should be used
+JNIEXPORT jstring JNICALL
+Java_com_voiceboard_android_WhisperNative_prepareModelVariant(JNIEnv *env, jobject thiz, jint model_type,
+                                                              jstring models_dir) {
+    const vb_model_type_t type = to_model_type(model_type);
+    const vb_quantization_t quantization = vb_engine_recommend_quantization(type, 0);
+    const char* dir = env->GetStringUTFChars(models_dir, nullptr);
+    const vb_status_t status = vb_engine_prepare_model_variant(type, quantization, dir);
+    env->ReleaseStringUTFChars(models_dir, dir);
     
-    if (result != 0) {
-        LOGE("Transcription failed: %d", result);
+    if (quantization != VB_QUANT_Q5_1 && status != VB_STATUS_SUCCESS) {
+        LOGE("Model conversion to %s failed: %s", vb_engine_quantization_to_string(quantization),
+             vb_engine_status_to_string(status));
         return nullptr;
     }
+    return env->NewStringUTF(vb_engine_get_model_variant_filename(type, quantization));
+}
+
+JNIEXPORT jfloatArray JNICALL
+Java_com_voiceboard_android_WhisperNative_benchmarkDevice(JNIEnv *env, jobject thiz,
+                                                          jobjectArray model_paths, jstring cache_path) {
+    // Paths are indexed by vb_model_type_t; null entries are skipped
+    std::vector<std::string> paths(VB_MODEL_TYPE_COUNT);
+    const char* path_ptrs[VB_MODEL_TYPE_COUNT] = {};
+    const jsize n_paths = std::min<jsize>(env->GetArrayLength(model_paths), VB_MODEL_TYPE_COUNT);
+    for (jsize i = 0; i < n_paths; ++i) {
+        jstring path = static_cast<jstring>(env->GetObjectArrayElement(model_paths, i));
+        if (path == nullptr) {
+            continue;
+        }
+        const char* chars = env->GetStringUTFChars(path, nullptr);
+        paths[i] = chars;
+        env->ReleaseStringUTFChars(path, chars);
+        env->DeleteLocalRef(path);
+        path_ptrs[i] = paths[i].c_str();
+    }
     
-    // Get results
-    std::string transcription;
-    const int n_segments = whisper_full_n_segments(g_context);
+    const char* cache = cache_path ? env->GetStringUTFChars(cache_path, nullptr) : nullptr;
+    vb_device_capabilities_t caps;
+    const vb_status_t status = vb_engine_benchmark_models(path_ptrs, cache, &caps);
+    if (cache) {
+        env->ReleaseStringUTFChars(cache_path, cache);
+    }
     
-    for (int i = 0; i < n_segments; ++i) {
-        const char* text = whisper_full_get_segment_text(g_context, i);
-        transcription += text;
+    if (status != VB_STATUS_SUCCESS) {
+        LOGE("Benchmark failed: %s", vb_engine_status_to_string(status));
+        return nullptr;
     }
     
-    return env->NewStringUTF(transcription.c_str());
+    float values[kBenchHeaderFields + kBenchModelFields * VB_MODEL_TYPE_COUNT];
+    values[0] = caps.cpu_score;
+    values[1] = caps.memory_mb;
+    values[2] = (float) caps.recommended_model;
+    values[3] = (float) caps.recommended_n_threads;
+    values[4] = caps.peak_memory_mb;
+    for (int i = 0; i < VB_MODEL_TYPE_COUNT; ++i) {
+        float* model = values + kBenchHeaderFields + kBenchModelFields * i;
+        model[0] = caps.models[i].real_time_factor;
+        model[1] = (float) caps.models[i].best_n_threads;
+        model[2] = caps.models[i].memory_mb;
+    }
+    
+    const jsize n_values = (jsize) (sizeof(values) / sizeof(values[0]));
+    jfloatArray result = env->NewFloatArray(n_values);
+    if (result != nullptr) {
+        env->SetFloatArrayRegion(result, 0, n_values, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_voiceboard_android_WhisperNative_setThermalState(JNIEnv *env, jobject thiz, jint state) {
+    vb_engine_set_thermal_state((vb_thermal_state_t) std::min<jint>(std::max<jint>(state, VB_THERMAL_NOMINAL),
+                                                                    VB_THERMAL_CRITICAL));
+}
+
+JNIEXPORT void JNICALL
+Java_com_voiceboard_android_WhisperNative_setResidency(JNIEnv *env, jobject thiz, jint idle_timeout_ms,
+                                                       jboolean warm_up) {
+    vb_residency_config_t config = {};
+    config.idle_timeout_ms = idle_timeout_ms;
+    config.warm_up = warm_up == JNI_TRUE;
+    vb_engine_set_residency(&config);
+}
+
+// Returns true when the model had to be released; it must be loaded again before use
+JNIEXPORT jboolean JNICALL
+Java_com_voiceboard_android_WhisperNative_trimMemory(JNIEnv *env, jobject thiz, jint level) {
+    const vb_trim_level_t trim = (vb_trim_level_t) std::min<jint>(std::max<jint>(level, VB_TRIM_NONE),
+                                                                  VB_TRIM_MODELS);
+    std::lock_guard<std::mutex> lock(g_mutex);
+    bool released = false;
+    // Weights go last, and never from under the streaming session; a one-shot
+    // transcription in flight keeps its own reference until it finishes
+    if (trim >= VB_TRIM_MODELS && g_session == nullptr && g_model != nullptr) {
+        vb_model_release(g_model);
+        g_model = nullptr;
+        released = true;
+    }
+    vb_engine_trim_memory(trim);
+    return released ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT void JNICALL
 Java_com_voiceboard_android_WhisperNative_cleanup(JNIEnv *env, jobject thiz) {
-    if (g_context) {
-        whisper_free(g_context);
-        g_context = nullptr;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    stop_session(env);
+    if (g_model) {
+        // The residency cache keeps it loaded for the next keyboard session
+        vb_model_release(g_model);
+        g_model = nullptr;
         LOGI("Model cleanup complete");
     }
 }
 
-}
\ No newline at end of file
+}
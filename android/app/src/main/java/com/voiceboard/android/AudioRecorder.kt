@@ -8,6 +8,8 @@ import android.media.AudioRecord
 import android.media.MediaRecorder
 import androidx.core.content.ContextCompat
 import kotlinx.coroutines.*
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 import kotlin.math.sqrt
 
 class AudioRecorder(private val context: Context) {
@@ -17,15 +19,29 @@ class AudioRecorder(private val context: Context) {
         private const val CHANNEL_CONFIG = AudioFormat.CHANNEL_IN_MONO
         private const val AUDIO_FORMAT = AudioFormat.ENCODING_PCM_16BIT
         private const val BUFFER_SIZE_FACTOR = 2
+        private const val INITIAL_RECORDING_SECONDS = 10
     }
     
+    /**
+     * Int16 PCM in native byte order, held in a direct buffer that native code
+     * reads in place. Valid until the next call to [startRecording].
+     */
+    class PcmRecording(val buffer: ByteBuffer, val sampleCount: Int)
+    
     private var audioRecord: AudioRecord? = null
     private var bufferSize = 0
     private var isRecording = false
-    private var recordingData = mutableListOf<Float>()
+    private var recordingBuffer = allocatePcmBuffer(SAMPLE_RATE * INITIAL_RECORDING_SECONDS * 2)
     
     var audioLevelCallback: ((Float) -> Unit)? = null
     
+    /**
+     * Called on the recording thread with each chunk as it arrives: the recording
+     * buffer, the chunk's byte offset in it and its sample count. The buffer is
+     * only valid for the duration of the call.
+     */
+    var pcmChunkCallback: ((ByteBuffer, Int, Int) -> Unit)? = null
+    
     init {
         calculateBufferSize()
     }
@@ -38,13 +54,13 @@ class AudioRecorder(private val context: Context) {
         ) * BUFFER_SIZE_FACTOR
     }
     
-    suspend fun startRecording(): FloatArray? = withContext(Dispatchers.IO) {
+    suspend fun startRecording(): PcmRecording? = withContext(Dispatchers.IO) {
         if (!checkPermissions()) {
             return@withContext null
         }
         
         try {
-            recordingData.clear()
+            recordingBuffer.clear()
             
             audioRecord = AudioRecord(
                 MediaRecorder.AudioSource.MIC,
@@ -61,22 +77,23 @@ class AudioRecorder(private val context: Context) {
             audioRecord?.startRecording()
             isRecording = true
             
-            val buffer = ShortArray(bufferSize / 2) // 16-bit samples
-            
             while (isRecording) {
-                val bytesRead = audioRecord?.read(buffer, 0, buffer.size) ?: 0
+                ensureCapacity(bufferSize)
+                
+                // AudioRecord writes straight into the direct buffer; no per-sample conversion here.
+                // It writes at the buffer's base address whatever its position, so hand it a
+                // slice starting at the end of what has been recorded.
+                val offset = recordingBuffer.position()
+                val chunk = recordingBuffer.duplicate().apply { position(offset) }.slice()
+                    .order(ByteOrder.nativeOrder())
+                val bytesRead = audioRecord?.read(chunk, bufferSize) ?: 0
                 
                 if (bytesRead > 0) {
-                    // Convert to float and normalize
-                    val floatBuffer = FloatArray(bytesRead)
-                    for (i in 0 until bytesRead) {
-                        floatBuffer[i] = buffer[i] / 32768.0f // Normalize 16-bit to [-1, 1]
-                    }
-                    
-                    recordingData.addAll(floatBuffer.toList())
+                    recordingBuffer.position(offset + bytesRead)
+                    pcmChunkCallback?.invoke(recordingBuffer, offset, bytesRead / 2)
                     
                     // Calculate audio level for visualization
-                    val rms = calculateRMS(floatBuffer)
+                    val rms = calculateRMS(recordingBuffer, offset, bytesRead)
                     withContext(Dispatchers.Main) {
                         audioLevelCallback?.invoke(rms)
                     }
@@ -86,7 +103,7 @@ class AudioRecorder(private val context: Context) {
                 yield()
             }
             
-            return@withContext recordingData.toFloatArray()
+            return@withContext PcmRecording(recordingBuffer, recordingBuffer.position() / 2)
             
         } catch (e: SecurityException) {
             throw IllegalStateException("Microphone permission not granted", e)
@@ -111,17 +128,31 @@ class AudioRecorder(private val context: Context) {
         }
     }
     
-    private fun calculateRMS(buffer: FloatArray): Float {
-        if (buffer.isEmpty()) return 0f
+    private fun calculateRMS(buffer: ByteBuffer, offset: Int, byteCount: Int): Float {
+        val sampleCount = byteCount / 2
+        if (sampleCount == 0) return 0f
         
         var sum = 0.0
-        for (sample in buffer) {
+        for (i in 0 until sampleCount) {
+            val sample = buffer.getShort(offset + i * 2) / 32768.0
             sum += sample * sample
         }
         
-        return sqrt(sum / buffer.size).toFloat()
+        return sqrt(sum / sampleCount).toFloat()
     }
     
+    private fun ensureCapacity(bytes: Int) {
+        if (recordingBuffer.remaining() >= bytes) return
+        
+        val grown = allocatePcmBuffer(maxOf(recordingBuffer.capacity() * 2, recordingBuffer.position() + bytes))
+        recordingBuffer.flip()
+        grown.put(recordingBuffer)
+        recordingBuffer = grown
+    }
+    
+    private fun allocatePcmBuffer(bytes: Int): ByteBuffer =
+        ByteBuffer.allocateDirect(bytes).order(ByteOrder.nativeOrder())
+    
     private fun checkPermissions(): Boolean {
         return ContextCompat.checkSelfPermission(
             context,
@@ -150,26 +181,4 @@ class AudioRecorder(private val context: Context) {
         
         return output
     }
-    
-    fun applyPreEmphasis(input: FloatArray, alpha: Float = 0.97f): FloatArray {
-        if (input.isEmpty()) return input
-        
-        val output = FloatArray(input.size)
-        output[0] = input[0]
-        
-        for (i in 1 until input.size) {
-            output[i] = input[i] - alpha * input[i - 1]
-        }
-        
-        return output
-    }
-    
-    fun normalizeAudio(input: FloatArray): FloatArray {
-        if (input.isEmpty()) return input
-        
-        val max = input.maxOfOrNull { kotlin.math.abs(it) } ?: 1.0f
-        if (max == 0.0f) return input
-        
-        return input.map { it / max }.toFloatArray()
-    }
 }
\ No newline at end of file
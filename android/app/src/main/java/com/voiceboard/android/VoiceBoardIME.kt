@@ -13,6 +13,7 @@ import android.os.Handler
 import android.os.Looper
 import android.os.VibrationEffect
 import android.os.Vibrator
+import android.util.Log
 import android.view.*
 import android.view.inputmethod.EditorInfo
 import android.widget.*
@@ -22,6 +23,10 @@ import kotlinx.coroutines.*
 
 class VoiceBoardIME : InputMethodService() {
     
+    companion object {
+        private const val TAG = "VoiceBoardIME"
+    }
+    
     private lateinit var keyboardView: View
     private lateinit var micButton: ImageView
     private lateinit var statusText: TextView
@@ -35,6 +40,9 @@ class VoiceBoardIME : InputMethodService() {
     private var isRecording = false
     private var recordingJob: Job? = null
     
+    // Whether the current dictation has committed any text yet
+    private var hasDictatedText = false
+    
     private val handler = Handler(Looper.getMainLooper())
     
     override fun onCreate() {
@@ -143,14 +151,36 @@ class VoiceBoardIME : InputMethodService() {
         // Haptic feedback
         vibrate(50)
         
+        // Stream audio into the engine while recording; partials show as composing text
+        hasDictatedText = false
+        val streaming = whisperManager?.startStreaming(
+            onPartialResult = { text, _ -> showPartial(text) },
+            onFinalResult = { text, _ -> commitFinal(text) },
+            onStreamError = { message -> Log.w(TAG, "Streaming error: $message") }
+        ) == true
+        audioRecorder?.pcmChunkCallback = if (streaming) {
+            { buffer, offset, samples -> whisperManager?.pushPcm16(buffer, offset, samples) }
+        } else {
+            null
+        }
+        
         // Start recording
         recordingJob = CoroutineScope(Dispatchers.IO).launch {
             try {
-                val audioData = audioRecorder?.startRecording()
+                val recording = audioRecorder?.startRecording()
+                
+                if (streaming) {
+                    // Decodes the tail; its finals are posted before this returns
+                    whisperManager?.stopStreaming()
+                    withContext(Dispatchers.Main) {
+                        finishDictation()
+                    }
+                    return@launch
+                }
                 
                 // Process with Whisper on background thread
-                audioData?.let { data ->
-                    val transcription = whisperManager?.transcribe(data) ?: ""
+                recording?.let { pcm ->
+                    val transcription = whisperManager?.transcribePcm16(pcm.buffer, pcm.sampleCount) ?: ""
                     
                     withContext(Dispatchers.Main) {
                         if (transcription.isNotEmpty()) {
@@ -159,7 +189,11 @@ class VoiceBoardIME : InputMethodService() {
                     }
                 }
             } catch (e: Exception) {
+                if (streaming) {
+                    whisperManager?.stopStreaming()
+                }
                 withContext(Dispatchers.Main) {
+                    finishDictation()
                     showError("Recording failed: ${e.message}")
                 }
             }
@@ -170,9 +204,8 @@ class VoiceBoardIME : InputMethodService() {
         if (!isRecording) return
         
         isRecording = false
-        recordingJob?.cancel()
         
-        // Stop recording
+        // Stop recording; the recording job then finishes transcription
         audioRecorder?.stopRecording()
         
         // Update UI
@@ -210,6 +243,38 @@ class VoiceBoardIME : InputMethodService() {
         }
     }
     
+    private fun formatDictation(text: String): String {
+        val normalized = text.replace("\\s+".toRegex(), " ") // Normalize whitespace
+        if (hasDictatedText) return normalized
+        return normalized.trimStart()
+            .replaceFirstChar { if (it.isLowerCase()) it.titlecase() else it.toString() }
+    }
+    
+    private fun showPartial(text: String) {
+        currentInputConnection?.setComposingText(formatDictation(text), 1)
+    }
+    
+    // Finals are deltas; committing one also replaces the composing partial
+    private fun commitFinal(text: String) {
+        val formatted = formatDictation(text)
+        currentInputConnection?.commitText(formatted, 1)
+        if (formatted.isNotBlank()) {
+            hasDictatedText = true
+        }
+    }
+    
+    private fun finishDictation() {
+        currentInputConnection?.let { ic ->
+            ic.finishComposingText()
+            
+            // Add space after if needed
+            val currentText = ic.getTextBeforeCursor(1, 0)
+            if (hasDictatedText && currentText?.lastOrNull()?.let { !it.isWhitespace() } == true) {
+                ic.commitText(" ", 1)
+            }
+        }
+    }
+    
     private fun updateModelStatus() {
         val isReady = whisperManager?.isModelReady == true
         statusText.text = if (isReady) {
@@ -260,9 +325,23 @@ class VoiceBoardIME : InputMethodService() {
     
     override fun onStartInputView(info: EditorInfo?, restarting: Boolean) {
         super.onStartInputView(info, restarting)
+        
+        // Reload if memory pressure released the model; a warm model comes back from the native cache
+        whisperManager?.let { manager ->
+            if (!manager.isModelReady) {
+                manager.loadModel()
+            }
+        }
         updateModelStatus()
     }
     
+    override fun onTrimMemory(level: Int) {
+        super.onTrimMemory(level)
+        if (!isRecording) {
+            whisperManager?.trimMemory(level)
+        }
+    }
+    
     override fun onDestroy() {
         super.onDestroy()
         recordingJob?.cancel()
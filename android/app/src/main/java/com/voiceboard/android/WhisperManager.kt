@@ -1,51 +1,65 @@
 package com.voiceboard.android
 
+import android.content.ComponentCallbacks2
 import android.content.Context
+import android.os.Build
+import android.os.Handler
+import android.os.Looper
+import android.os.PowerManager
 import android.util.Log
+import androidx.annotation.Keep
 import kotlinx.coroutines.*
 import java.io.File
-import java.io.FileOutputStream
+import java.io.IOException
+import java.io.InputStream
 import java.net.HttpURLConnection
 import java.net.URL
+import java.nio.ByteBuffer
 
 class WhisperManager(private val context: Context) {
     
     companion object {
         private const val TAG = "WhisperManager"
         
-        // Model information
+        // Model information, as in models/manifest.json. Download URLs and
+        // hashes live in the native model registry.
         private val MODELS = mapOf(
-            "tiny.en" to ModelInfo(
-                "ggml-tiny.en-q5_1.bin",
-                "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-tiny.en-q5_1.bin",
-                39 * 1024 * 1024L // ~39MB
-            ),
-            "base.en" to ModelInfo(
-                "ggml-base.en-q5_1.bin", 
-                "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-base.en-q5_1.bin",
-                148 * 1024 * 1024L // ~148MB
-            ),
-            "small.en" to ModelInfo(
-                "ggml-small.en-q5_1.bin",
-                "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-small.en-q5_1.bin", 
-                244 * 1024 * 1024L // ~244MB
-            )
+            "tiny.en" to ModelInfo("ggml-tiny.en-q5_1.bin", 32166155L),     // ~30.7MB
+            "base.en" to ModelInfo("ggml-base.en-q5_1.bin", 59721011L),     // ~57MB
+            "small.en" to ModelInfo("ggml-small.en-q5_1.bin", 190098681L)   // ~181MB
         )
+        
+        // Engine model order (vb_model_type_t)
+        private val ENGINE_MODEL_ORDER = listOf("tiny.en", "base.en", "small.en")
+        
+        // Layout of WhisperNative.benchmarkDevice results (see whisper_jni.cpp)
+        private const val BENCH_HEADER_FIELDS = 5
+        private const val BENCH_MODEL_FIELDS = 3
+        private const val BENCHMARK_CACHE_FILE = "benchmark.cache"
+        
+        // Keep the model loaded this long after the keyboard goes away
+        private const val MODEL_IDLE_TIMEOUT_MS = 2 * 60 * 1000
     }
     
     data class ModelInfo(
         val fileName: String,
-        val downloadUrl: String,
         val sizeBytes: Long
     )
     
     private var whisperNative: WhisperNative? = null
+    private val mainHandler = Handler(Looper.getMainLooper())
     private val modelsDir: File
     private var currentModel: String = "base.en" // Default model
     
     var isModelReady = false
         private set
     
+    @Volatile
+    private var isModelLoading = false
+    
+    // PowerManager.OnThermalStatusChangedListener; typed loosely so older APIs never load the class
+    private var thermalListener: Any? = null
+    
     var modelLoadCallback: ((Boolean, String?) -> Unit)? = null
     var downloadProgressCallback: ((Int) -> Unit)? = null
     
@@ -60,28 +74,101 @@ class WhisperManager(private val context: Context) {
         try {
             System.loadLibrary("whisper-engine")
             whisperNative = WhisperNative()
+            setResidency(MODEL_IDLE_TIMEOUT_MS, warmUp = true)
         } catch (e: UnsatisfiedLinkError) {
             Log.e(TAG, "Failed to load native library", e)
         }
+        
+        registerThermalListener()
+    }
+    
+    // Thermal throttling caps native decoder threads (API 29+)
+    private fun registerThermalListener() {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.Q) {
+            return
+        }
+        val powerManager = context.getSystemService(Context.POWER_SERVICE) as? PowerManager ?: return
+        val listener = PowerManager.OnThermalStatusChangedListener { status ->
+            whisperNative?.setThermalState(toEngineThermalState(status))
+        }
+        powerManager.addThermalStatusListener(context.mainExecutor, listener)
+        thermalListener = listener
+    }
+    
+    private fun unregisterThermalListener() {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.Q) {
+            return
+        }
+        val listener = thermalListener as? PowerManager.OnThermalStatusChangedListener ?: return
+        val powerManager = context.getSystemService(Context.POWER_SERVICE) as? PowerManager ?: return
+        powerManager.removeThermalStatusListener(listener)
+        thermalListener = null
+    }
+    
+    // PowerManager.THERMAL_STATUS_* to vb_thermal_state_t
+    private fun toEngineThermalState(status: Int): Int = when {
+        status >= PowerManager.THERMAL_STATUS_CRITICAL -> 3
+        status >= PowerManager.THERMAL_STATUS_MODERATE -> 2
+        status >= PowerManager.THERMAL_STATUS_LIGHT -> 1
+        else -> 0
+    }
+    
+    /**
+     * Native residency policy, shared by every WhisperManager in the process.
+     * After [cleanup] the model stays loaded for [idleTimeoutMs] (negative =
+     * unload at once), so reopening the keyboard skips the load. With [warmUp] a
+     * short decode runs right after loading so the first utterance starts warm.
+     */
+    fun setResidency(idleTimeoutMs: Int, warmUp: Boolean) {
+        whisperNative?.setResidency(idleTimeoutMs, warmUp)
+    }
+    
+    /**
+     * Forward [ComponentCallbacks2.onTrimMemory]. Idle decoder state buffers are
+     * dropped first; the weights only under critical pressure and never during
+     * a dictation, after which [loadModel] must be called again.
+     */
+    fun trimMemory(level: Int) {
+        if (whisperNative?.trimMemory(toEngineTrimLevel(level)) == true) {
+            isModelReady = false
+        }
+    }
+    
+    // ComponentCallbacks2.TRIM_MEMORY_* to vb_trim_level_t
+    private fun toEngineTrimLevel(level: Int): Int = when {
+        level >= ComponentCallbacks2.TRIM_MEMORY_MODERATE -> 2
+        level == ComponentCallbacks2.TRIM_MEMORY_RUNNING_CRITICAL -> 2
+        level >= ComponentCallbacks2.TRIM_MEMORY_RUNNING_LOW -> 1
+        else -> 0
     }
     
     fun loadModel(modelName: String = currentModel) {
         currentModel = modelName
         val modelInfo = MODELS[modelName] ?: return
         val modelFile = File(modelsDir, modelInfo.fileName)
+        if (isModelLoading) return
+        isModelLoading = true
         
         CoroutineScope(Dispatchers.IO).launch {
             try {
-                // Download model if not exists
-                if (!modelFile.exists()) {
-                    downloadModel(modelInfo, modelFile)
+                // Checked against the native index of verified models; a missing,
+                // corrupt or partly downloaded file is (re)fetched and verified
+                val modelType = ENGINE_MODEL_ORDER.indexOf(modelName)
+                if (!isModelDownloaded(modelName)) {
+                    downloadModel(modelType, modelInfo)
                 }
                 
+                // The quantization the device benchmark favours, converted once
+                // from the download; the download itself if that fails
+                val variantFile = whisperNative?.prepareModelVariant(modelType, modelsDir.absolutePath)
+                    ?.let { File(modelsDir, it) } ?: modelFile
+                
                 // Load model
-                val success = whisperNative?.loadModel(modelFile.absolutePath) == true
+                val success = whisperNative?.loadModel(variantFile.absolutePath, modelType) == true
                 
                 withContext(Dispatchers.Main) {
                     isModelReady = success
+                    isModelLoading = false
                     modelLoadCallback?.invoke(success, if (success) null else "Failed to load model")
                 }
                 
@@ -89,71 +176,175 @@ class WhisperManager(private val context: Context) {
                 Log.e(TAG, "Error loading model", e)
                 withContext(Dispatchers.Main) {
                     isModelReady = false
+                    isModelLoading = false
                     modelLoadCallback?.invoke(false, e.message)
                 }
             }
         }
     }
     
-    private suspend fun downloadModel(modelInfo: ModelInfo, targetFile: File) {
-        try {
-            Log.i(TAG, "Downloading model: ${modelInfo.fileName}")
-            
-            val url = URL(modelInfo.downloadUrl)
-            val connection = url.openConnection() as HttpURLConnection
-            connection.connect()
-            
-            val contentLength = connection.contentLength
-            val inputStream = connection.inputStream
-            val outputStream = FileOutputStream(targetFile)
-            
-            val buffer = ByteArray(8192)
-            var totalBytesRead = 0L
-            var bytesRead: Int
-            
-            while (inputStream.read(buffer).also { bytesRead = it } != -1) {
-                outputStream.write(buffer, 0, bytesRead)
-                totalBytesRead += bytesRead
-                
-                // Update progress
-                val progress = if (contentLength > 0) {
-                    ((totalBytesRead * 100) / contentLength).toInt()
-                } else {
-                    -1 // Indeterminate
+    private fun downloadModel(modelType: Int, modelInfo: ModelInfo) {
+        val native = whisperNative ?: throw IOException("Native library not loaded")
+        Log.i(TAG, "Downloading model: ${modelInfo.fileName}")
+        
+        val fetcher = HttpModelFetcher(modelInfo.sizeBytes)
+        val success = try {
+            native.downloadModel(modelType, modelsDir.absolutePath, fetcher)
+        } finally {
+            fetcher.close()
+        }
+        if (!success) {
+            throw IOException("Failed to download ${modelInfo.fileName}")
+        }
+        Log.i(TAG, "Model downloaded and verified: ${modelInfo.fileName}")
+    }
+    
+    /**
+     * Transport for native model downloads. Consecutive chunks are read from
+     * one ranged HTTP response; a request at any other offset (a resumed
+     * download) opens a new one from there.
+     */
+    private inner class HttpModelFetcher(private val sizeBytes: Long) : ModelFetcher {
+        private var connection: HttpURLConnection? = null
+        private var stream: InputStream? = null
+        private var position = 0L
+        private val chunk = ByteArray(64 * 1024)
+        private var lastProgress = -1
+        
+        override fun fetch(url: String, offset: Long, buffer: ByteBuffer): Int {
+            return try {
+                if (stream == null || position != offset) {
+                    open(url, offset)
                 }
-                
-                withContext(Dispatchers.Main) {
-                    downloadProgressCallback?.invoke(progress)
+                val input = stream ?: return -1
+                var written = 0
+                while (buffer.hasRemaining()) {
+                    val n = input.read(chunk, 0, minOf(chunk.size, buffer.remaining()))
+                    if (n < 0) break
+                    buffer.put(chunk, 0, n)
+                    written += n
                 }
+                position += written
+                reportProgress()
+                written
+            } catch (e: IOException) {
+                Log.e(TAG, "Error downloading model", e)
+                close()
+                -1
             }
-            
-            outputStream.close()
-            inputStream.close()
-            
-            Log.i(TAG, "Model downloaded successfully: ${targetFile.absolutePath}")
-            
-        } catch (e: Exception) {
-            Log.e(TAG, "Error downloading model", e)
-            // Clean up partial download
-            if (targetFile.exists()) {
-                targetFile.delete()
+        }
+        
+        private fun open(url: String, offset: Long) {
+            close()
+            val c = URL(url).openConnection() as HttpURLConnection
+            if (offset > 0) {
+                c.setRequestProperty("Range", "bytes=$offset-")
+            }
+            c.connect()
+            val input = c.inputStream
+            connection = c
+            stream = input
+            // A server that ignores the range sends the file from the start
+            if (offset > 0 && c.responseCode != HttpURLConnection.HTTP_PARTIAL) {
+                var skipped = 0L
+                while (skipped < offset) {
+                    val n = input.skip(offset - skipped)
+                    if (n <= 0) throw IOException("Download shorter than resume offset")
+                    skipped += n
+                }
             }
-            throw e
+            position = offset
         }
+        
+        private fun reportProgress() {
+            val progress = if (sizeBytes > 0) ((position * 100) / sizeBytes).toInt() else -1
+            if (progress != lastProgress) {
+                lastProgress = progress
+                mainHandler.post { downloadProgressCallback?.invoke(progress) }
+            }
+        }
+        
+        fun close() {
+            stream?.close()
+            connection?.disconnect()
+            stream = null
+            connection = null
+        }
+    }
+    
+    /**
+     * Start a streaming session on the loaded model. Audio pushed with [pushPcm16]
+     * is decoded while recording: [onPartialResult] replaces the previous partial and
+     * covers only the uncommitted tail, [onFinalResult] delivers append-only deltas of
+     * committed text. Both get the decoder confidence of their text, 0 to 1. Callbacks
+     * run on the main thread.
+     */
+    fun startStreaming(
+        onPartialResult: (String, Float) -> Unit,
+        onFinalResult: (String, Float) -> Unit,
+        onStreamError: (String) -> Unit = {}
+    ): Boolean {
+        val native = whisperNative ?: return false
+        if (!isModelReady) {
+            Log.w(TAG, "Model not ready")
+            return false
+        }
+        
+        // Invoked on the engine's processing thread
+        val listener = object : TranscriptionListener {
+            override fun onPartial(text: String, confidence: Float) {
+                mainHandler.post { onPartialResult(text, confidence) }
+            }
+            override fun onFinal(text: String, confidence: Float) {
+                mainHandler.post { onFinalResult(text, confidence) }
+            }
+            override fun onError(message: String) {
+                mainHandler.post { onStreamError(message) }
+            }
+        }
+        return native.startStreaming(listener)
+    }
+    
+    /**
+     * Push [sampleCount] int16 samples starting at [byteOffset] of a direct buffer
+     * into the streaming session. Copies into the native capture ring without
+     * blocking, so it is safe to call from the recording loop.
+     */
+    fun pushPcm16(pcmBuffer: ByteBuffer, byteOffset: Int, sampleCount: Int): Boolean {
+        return whisperNative?.pushPcm16(pcmBuffer, byteOffset, sampleCount) == true
+    }
+    
+    /**
+     * Domain vocabulary (names, jargon; comma-separated) used to prompt the
+     * decoder of every following session, or null for none.
+     */
+    fun setVocabulary(vocabulary: String?) {
+        whisperNative?.setVocabulary(vocabulary)
     }
     
-    suspend fun transcribe(audioData: FloatArray): String = withContext(Dispatchers.IO) {
+    /**
+     * Stop the streaming session. Remaining audio is decoded first; its final
+     * results are posted to the main thread before this returns.
+     */
+    suspend fun stopStreaming() = withContext(Dispatchers.IO) {
+        whisperNative?.stopStreaming()
+    }
+    
+    /**
+     * Transcribe int16 PCM held in a direct [ByteBuffer] (native byte order).
+     * The buffer is read in place by native code, so no Java heap copies are made.
+     * Conversion, pre-emphasis and normalization all happen natively.
+     */
+    suspend fun transcribePcm16(pcmBuffer: ByteBuffer, sampleCount: Int): String = withContext(Dispatchers.IO) {
         if (!isModelReady || whisperNative == null) {
             Log.w(TAG, "Model not ready or native library not loaded")
             return@withContext ""
         }
         
+        require(pcmBuffer.isDirect) { "PCM buffer must be a direct ByteBuffer" }
+        
         try {
-            // Preprocess audio if needed
-            val processedAudio = preprocessAudio(audioData)
-            
-            // Call native transcription
-            val result = whisperNative!!.transcribe(processedAudio)
+            val result = whisperNative!!.transcribePcm16(pcmBuffer, sampleCount)
             
             Log.d(TAG, "Transcription result: $result")
             return@withContext result ?: ""
@@ -164,63 +355,60 @@ class WhisperManager(private val context: Context) {
         }
     }
     
-    private fun preprocessAudio(audioData: FloatArray): FloatArray {
-        // Basic audio preprocessing
-        var processed = audioData
-        
-        // Apply pre-emphasis filter
-        processed = applyPreEmphasis(processed)
+    /**
+     * Measure every downloaded model natively (encoder pass plus decoder steps at
+     * several thread counts) and recommend the largest one that keeps up.
+     * Results are cached per device and model file, so only new or updated
+     * models cost benchmark time. Falls back to a heuristic without the native library.
+     */
+    suspend fun benchmarkDevice(): DeviceBenchmark = withContext(Dispatchers.Default) {
+        val runtime = Runtime.getRuntime()
+        val maxMemory = runtime.maxMemory() / (1024 * 1024) // MB
+        val processors = runtime.availableProcessors()
         
-        // Normalize
-        processed = normalizeAudio(processed)
+        // Indexed like vb_model_type_t
+        val modelPaths = ENGINE_MODEL_ORDER.map { name ->
+            MODELS[name]?.takeIf { isModelDownloaded(name) }
+                ?.let { File(modelsDir, it.fileName).absolutePath }
+        }.toTypedArray()
+        val cachePath = File(context.filesDir, BENCHMARK_CACHE_FILE).absolutePath
         
-        // Ensure minimum length (Whisper typically needs at least 1 second)
-        if (processed.size < 16000) { // 1 second at 16kHz
-            processed = processed + FloatArray(16000 - processed.size) // Pad with zeros
+        val measured = try {
+            whisperNative?.benchmarkDevice(modelPaths, cachePath)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.e(TAG, "Native benchmark unavailable", e)
+            null
         }
         
-        return processed
-    }
-    
-    private fun applyPreEmphasis(input: FloatArray, alpha: Float = 0.97f): FloatArray {
-        if (input.isEmpty()) return input
-        
-        val output = FloatArray(input.size)
-        output[0] = input[0]
-        
-        for (i in 1 until input.size) {
-            output[i] = input[i] - alpha * input[i - 1]
+        if (measured == null) {
+            // Simple heuristic for model recommendation
+            val recommendedModel = when {
+                maxMemory >= 2048 && processors >= 6 -> "small.en"
+                maxMemory >= 1024 && processors >= 4 -> "base.en"
+                else -> "tiny.en"
+            }
+            
+            return@withContext DeviceBenchmark(
+                maxMemoryMB = maxMemory,
+                processorCount = processors,
+                recommendedModel = recommendedModel,
+                deviceModel = android.os.Build.MODEL
+            )
         }
         
-        return output
-    }
-    
-    private fun normalizeAudio(input: FloatArray): FloatArray {
-        if (input.isEmpty()) return input
-        
-        val max = input.maxOfOrNull { kotlin.math.abs(it) } ?: 1.0f
-        if (max == 0.0f) return input
+        val realTimeFactors = ENGINE_MODEL_ORDER.mapIndexedNotNull { i, name ->
+            val rtf = measured[BENCH_HEADER_FIELDS + BENCH_MODEL_FIELDS * i]
+            if (rtf > 0f) name to rtf else null
+        }.toMap()
         
-        return input.map { it / max }.toFloatArray()
-    }
-    
-    fun benchmarkDevice(): DeviceBenchmark {
-        val runtime = Runtime.getRuntime()
-        val maxMemory = runtime.maxMemory() / (1024 * 1024) // MB
-        val processors = runtime.availableProcessors()
-        
-        // Simple heuristic for model recommendation
-        val recommendedModel = when {
-            maxMemory >= 2048 && processors >= 6 -> "small.en"
-            maxMemory >= 1024 && processors >= 4 -> "base.en"
-            else -> "tiny.en"
-        }
-        
-        return DeviceBenchmark(
+        DeviceBenchmark(
             maxMemoryMB = maxMemory,
             processorCount = processors,
-            recommendedModel = recommendedModel,
-            deviceModel = android.os.Build.MODEL
+            recommendedModel = ENGINE_MODEL_ORDER[measured[2].toInt()],
+            deviceModel = android.os.Build.MODEL,
+            cpuScore = measured[0],
+            recommendedThreads = measured[3].toInt(),
+            realTimeFactors = realTimeFactors
         )
     }
     
@@ -228,13 +416,16 @@ class WhisperManager(private val context: Context) {
     
     fun getModelInfo(modelName: String): ModelInfo? = MODELS[modelName]
     
+    // Verified copy present, answered by the native model index without reading the file
     fun isModelDownloaded(modelName: String): Boolean {
-        val modelInfo = MODELS[modelName] ?: return false
-        val modelFile = File(modelsDir, modelInfo.fileName)
-        return modelFile.exists() && modelFile.length() > 0
+        val modelType = ENGINE_MODEL_ORDER.indexOf(modelName)
+        if (modelType < 0) return false
+        return whisperNative?.isModelAvailable(modelType, modelsDir.absolutePath) == true
     }
     
+    // The native model stays resident for MODEL_IDLE_TIMEOUT_MS
     fun cleanup() {
+        unregisterThermalListener()
         whisperNative?.cleanup()
         whisperNative = null
         isModelReady = false
@@ -244,14 +435,45 @@ class WhisperManager(private val context: Context) {
         val maxMemoryMB: Long,
         val processorCount: Int,
         val recommendedModel: String,
-        val deviceModel: String
+        val deviceModel: String,
+        val cpuScore: Float = 0f, // tiny.en audio seconds per second, 0 = not measured
+        val recommendedThreads: Int = 0,
+        val realTimeFactors: Map<String, Float> = emptyMap()
     )
 }
 
+// Streaming results from native code; method IDs are resolved once in JNI_OnLoad
+@Keep
+interface TranscriptionListener {
+    fun onPartial(text: String, confidence: Float)
+    fun onFinal(text: String, confidence: Float)
+    fun onError(message: String)
+}
+
+// Model download transport for the native registry: copy bytes of [url] from
+// [offset] into [buffer] (direct, native memory) and return how many were
+// copied, 0 at the end of the file or -1 on failure
+@Keep
+interface ModelFetcher {
+    fun fetch(url: String, offset: Long, buffer: ByteBuffer): Int
+}
+
 // Native interface - implementation will be in C++
 private class WhisperNative {
-    external fun loadModel(modelPath: String): Boolean
+    external fun loadModel(modelPath: String, modelType: Int): Boolean
+    external fun startStreaming(listener: TranscriptionListener): Boolean
+    external fun pushPcm16(pcmBuffer: ByteBuffer, byteOffset: Int, sampleCount: Int): Boolean
+    external fun setVocabulary(vocabulary: String?)
+    external fun stopStreaming()
     external fun transcribe(audioData: FloatArray): String?
+    external fun transcribePcm16(pcmBuffer: ByteBuffer, sampleCount: Int): String?
+    external fun isModelAvailable(modelType: Int, modelsDir: String): Boolean
+    external fun downloadModel(modelType: Int, modelsDir: String, fetcher: ModelFetcher): Boolean
+    external fun prepareModelVariant(modelType: Int, modelsDir: String): String?
+    external fun benchmarkDevice(modelPaths: Array<String?>, cachePath: String): FloatArray?
+    external fun setThermalState(state: Int)
+    external fun setResidency(idleTimeoutMs: Int, warmUp: Boolean)
+    external fun trimMemory(level: Int): Boolean
     external fun cleanup()
     
     companion object {
@@ -5,8 +5,8 @@ import Combine
 class AudioEngine: NSObject, ObservableObject {
     private var audioEngine = AVAudioEngine()
     private var inputNode: AVAudioInputNode?
-    private var audioBuffer: [Float] = []
-    private let sampleRate: Double = 16000.0
+    private var levelTimer: Timer?
+    private let levelMeterInterval: TimeInterval = 1.0 / 30.0
     
     @Published var isRecording = false
     @Published var audioLevel: Float = 0.0
@@ -30,68 +30,34 @@ class AudioEngine: NSObject, ObservableObject {
     func startRecording() async throws -> Bool {
         guard !isRecording else { return false }
         
-        // Reset buffer
-        audioBuffer.removeAll()
-        
         // Configure audio engine
         let inputNode = audioEngine.inputNode
         self.inputNode = inputNode
         
         let recordingFormat = inputNode.outputFormat(forBus: 0)
-        let desiredFormat = AVAudioFormat(standardFormatWithSampleRate: sampleRate, channels: 1)!
-        
-        // Create format converter if needed
-        var converter: AVAudioConverter?
-        if recordingFormat != desiredFormat {
-            converter = AVAudioConverter(from: recordingFormat, to: desiredFormat)
-        }
+        let deviceSampleRate = Int32(recordingFormat.sampleRate)
         
-        inputNode.installTap(onBus: 0, bufferSize: 1024, format: recordingFormat) { [weak self] buffer, _ in
-            guard let self = self else { return }
-            
-            let convertedBuffer: AVAudioPCMBuffer
+        // Runs on the tap's audio thread. The engine resamples the device-rate
+        // samples to 16kHz and meters them natively, straight into its capture
+        // ring; nothing here allocates or waits on the main queue.
+        inputNode.installTap(onBus: 0, bufferSize: 1024, format: recordingFormat) { buffer, _ in
+            guard let channelData = buffer.floatChannelData?[0] else { return }
             
-            if let converter = converter {
-                // Convert to desired format
-                guard let outputBuffer = AVAudioPCMBuffer(pcmFormat: desiredFormat, frameCapacity: buffer.frameCapacity) else { return }
-                
-                var error: NSError?
-                converter.convert(to: outputBuffer, error: &error) { _, outStatus in
-                    outStatus.pointee = .haveData
-                    return buffer
-                }
-                
-                if error != nil {
-                    return
-                }
-                
-                convertedBuffer = outputBuffer
-            } else {
-                convertedBuffer = buffer
-            }
-            
-            // Extract audio samples
-            if let channelData = convertedBuffer.floatChannelData?[0] {
-                let frameLength = Int(convertedBuffer.frameLength)
-                let samples = Array(UnsafeBufferPointer(start: channelData, count: frameLength))
-                
-                DispatchQueue.main.async {
-                    self.audioBuffer.append(contentsOf: samples)
-                    
-                    // Update audio level for visualization
-                    let rms = sqrt(samples.map { $0 * $0 }.reduce(0, +) / Float(samples.count))
-                    self.audioLevel = min(rms * 10, 1.0) // Scale and clamp
-                }
-            }
+            var capture = vb_audio_buffer_t(samples: channelData,
+                                            n_samples: Int32(buffer.frameLength),
+                                            sample_rate: deviceSampleRate)
+            vb_engine_process_capture(&capture)
         }
         
         do {
             try audioEngine.start()
             await MainActor.run {
                 self.isRecording = true
+                self.startLevelMeter()
             }
             return true
         } catch {
+            inputNode.removeTap(onBus: 0)
             await MainActor.run {
                 self.error = .engineStartFailed(error)
             }
@@ -99,18 +65,32 @@ class AudioEngine: NSObject, ObservableObject {
         }
     }
     
-    func stopRecording() async throws -> [Float] {
-        guard isRecording else { return [] }
+    func stopRecording() async throws {
+        guard isRecording else { return }
         
         audioEngine.stop()
         inputNode?.removeTap(onBus: 0)
         
         await MainActor.run {
+            self.stopLevelMeter()
             self.isRecording = false
             self.audioLevel = 0.0
         }
-        
-        return audioBuffer
+    }
+    
+    // The meter polls the level of the engine's latest capture buffer at
+    // display rate instead of receiving every tap on the main queue
+    private func startLevelMeter() {
+        levelTimer = Timer.scheduledTimer(withTimeInterval: levelMeterInterval, repeats: true) { [weak self] _ in
+            var level = vb_input_level_t()
+            guard vb_engine_get_input_level(&level) == VB_STATUS_SUCCESS else { return }
+            self?.audioLevel = min(level.rms * 10, 1.0) // Scale and clamp
+        }
+    }
+    
+    private func stopLevelMeter() {
+        levelTimer?.invalidate()
+        levelTimer = nil
     }
     
     func pauseRecording() {
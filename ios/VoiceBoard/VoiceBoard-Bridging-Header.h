@@ -0,0 +1,2 @@
+// Native engine API for the app's Swift code
+#include "../../whisper-engine/whisper_engine.h"
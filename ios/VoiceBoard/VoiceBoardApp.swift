@@ -23,42 +23,34 @@ struct VoiceBoardApp: App {
             object: nil,
             queue: .main
         ) { notification in
-            if let userInfo = notification.userInfo,
-               let requestId = userInfo["requestId"] as? String {
-                processDictationRequest(requestId: requestId)
+            if notification.userInfo?["requestId"] is String {
+                processDictationRequest()
             }
         }
     }
     
-    private func processDictationRequest(requestId: String) {
+    // Partials and finals reach the keyboard through the engine's shared
+    // transport as they are decoded (see WhisperManager)
+    private func processDictationRequest() {
         guard !audioEngine.isRecording else { return }
         
         Task {
+            // The session must be running before the tap delivers audio
+            guard await whisperManager.startTranscription() else { return }
+            
             do {
                 try await audioEngine.startRecording()
                 
                 // Wait for user to finish speaking (simplified for demo)
                 try await Task.sleep(nanoseconds: 5_000_000_000) // 5 seconds
                 
-                let audioData = try await audioEngine.stopRecording()
-                let transcription = await whisperManager.transcribe(audioData)
-                
-                // Send result back to keyboard via App Groups
-                await sendResultToKeyboard(transcription: transcription, requestId: requestId)
-                
+                try await audioEngine.stopRecording()
+                _ = await whisperManager.transcribe()
             } catch {
+                try? await audioEngine.stopRecording()
+                _ = await whisperManager.transcribe()
                 print("Dictation error: \(error)")
             }
         }
     }
-    
-    private func sendResultToKeyboard(transcription: String, requestId: String) async {
-        let sharedDefaults = UserDefaults(suiteName: "group.com.voiceboard.shared")
-        sharedDefaults?.set(transcription, forKey: "transcription_\(requestId)")
-        sharedDefaults?.set(Date(), forKey: "timestamp_\(requestId)")
-        
-        // Notify keyboard extension
-        let notification = Notification.Name("TranscriptionComplete")
-        NotificationCenter.default.post(name: notification, object: nil, userInfo: ["requestId": requestId])
-    }
 }
\ No newline at end of file
@@ -2,8 +2,6 @@ import Foundation
 import Combine
 
 class WhisperManager: ObservableObject {
-    private var whisperContext: OpaquePointer?
-    
     @Published var isModelReady = false
     @Published var isProcessing = false
     @Published var transcriptionProgress: Float = 0.0
@@ -12,13 +10,28 @@ class WhisperManager: ObservableObject {
     private let modelType: WhisperModelType = .base
     private let modelsDirectory: URL
     
+    // Final text of the running session, appended on the engine's worker thread
+    private let transcript = Transcript()
+    
+    // Results ring shared with the keyboard extension; nil without the App Group
+    private var transport: OpaquePointer?
+    
     enum WhisperModelType: String, CaseIterable {
         case tiny = "tiny.en"
         case base = "base.en"
         case small = "small.en"
         
+        var engineType: vb_model_type_t {
+            switch self {
+            case .tiny: return VB_MODEL_TINY_EN
+            case .base: return VB_MODEL_BASE_EN
+            case .small: return VB_MODEL_DISTIL_SMALL_EN
+            }
+        }
+        
+        // The engine's manifest names the files
         var fileName: String {
-            return "ggml-\(self.rawValue)-q5_1.bin"
+            return String(cString: vb_engine_get_model_filename(engineType))
         }
         
         var displayName: String {
@@ -30,11 +43,7 @@ class WhisperManager: ObservableObject {
         }
         
         var approximateSize: Int64 {
-            switch self {
-            case .tiny: return 39 * 1024 * 1024  // ~39MB
-            case .base: return 148 * 1024 * 1024 // ~148MB
-            case .small: return 244 * 1024 * 1024 // ~244MB
-            }
+            return vb_engine_get_model_size(engineType)
         }
     }
     
@@ -46,6 +55,26 @@ class WhisperManager: ObservableObject {
         // Create models directory if needed
         try? FileManager.default.createDirectory(at: modelsDirectory, withIntermediateDirectories: true)
         
+        var config = vb_engine_config_t()
+        config.model_type = modelType.engineType
+        config.use_gpu_acceleration = true
+        config.thread_policy = VB_THREADS_ADAPTIVE
+        // The capture tap must never wait on the decoder
+        config.overload_policy = VB_OVERLOAD_DROP_NEWEST
+        // Dictation is mostly a few seconds at a time; no need to encode 30
+        config.dynamic_audio_ctx = true
+        vb_engine_init(&config)
+        
+        // Every partial, final and error is written into the App Group
+        // container from the engine's worker thread, where the keyboard
+        // extension reads it (KeyboardViewController opens the same file)
+        if let container = FileManager.default.containerURL(
+            forSecurityApplicationGroupIdentifier: "group.com.voiceboard.shared") {
+            let path = container.appendingPathComponent("results.ring").path
+            transport = vb_transport_open(path, VB_TRANSPORT_HOST, 0)
+            vb_engine_set_transport(transport)
+        }
+        
         Task {
             await loadModel()
         }
@@ -53,145 +82,261 @@ class WhisperManager: ObservableObject {
     
     @MainActor
     private func loadModel() async {
-        let modelURL = modelsDirectory.appendingPathComponent(modelType.fileName)
+        let engineType = modelType.engineType
+        let directory = modelsDirectory.path
         
-        // Check if model exists, download if needed
-        if !FileManager.default.fileExists(atPath: modelURL.path) {
-            await downloadModel()
-            return
+        // Checked against the engine's index of verified models; a missing,
+        // corrupt or partly downloaded file is (re)fetched and verified
+        if !vb_engine_is_model_available(engineType, directory) {
+            guard await downloadModel() else { return }
         }
         
-        // Load the model
-        do {
-            // TODO: Integrate with actual whisper.cpp
-            // For now, simulate model loading
-            try await Task.sleep(nanoseconds: 1_000_000_000) // 1 second
-            
+        let modelPath = modelsDirectory.appendingPathComponent(modelType.fileName).path
+        let status = await Task.detached {
+            vb_engine_load_model(engineType, modelPath)
+        }.value
+        
+        if status == VB_STATUS_SUCCESS {
             self.isModelReady = true
             print("Whisper model loaded successfully")
-            
-        } catch {
-            self.error = .modelLoadFailed(error)
-            print("Failed to load Whisper model: \(error)")
+        } else {
+            self.error = .modelLoadFailed(EngineStatusError(status: status))
+            print("Failed to load Whisper model: \(EngineStatusError(status: status).localizedDescription)")
         }
     }
     
     @MainActor
-    private func downloadModel() async {
-        // TODO: Implement actual model download
-        // For now, simulate download
+    private func downloadModel() async -> Bool {
         print("Downloading Whisper model: \(modelType.displayName)")
         
-        do {
-            // Simulate download progress
-            for i in 0...100 {
-                transcriptionProgress = Float(i) / 100.0
-                try await Task.sleep(nanoseconds: 50_000_000) // 50ms
+        let engineType = modelType.engineType
+        let directory = modelsDirectory.path
+        let fetcher = ModelFetcher(totalBytes: modelType.approximateSize) { [weak self] progress in
+            DispatchQueue.main.async {
+                self?.transcriptionProgress = progress
             }
-            
-            // Simulate model file creation (in real app, this would be actual download)
-            let modelURL = modelsDirectory.appendingPathComponent(modelType.fileName)
-            try "dummy_model_data".write(to: modelURL, atomically: true, encoding: .utf8)
-            
-            await loadModel()
-            
-        } catch {
-            self.error = .modelDownloadFailed(error)
         }
+        
+        // Blocks until the file is in place and verified; resumes a download
+        // an earlier launch left unfinished
+        let status = await Task.detached { () -> vb_status_t in
+            withExtendedLifetime(fetcher) {
+                vb_engine_download_model(engineType, directory, fetchModelBytes,
+                                         Unmanaged.passUnretained(fetcher).toOpaque())
+            }
+        }.value
+        
+        transcriptionProgress = 0.0
+        guard status == VB_STATUS_SUCCESS else {
+            self.error = .modelDownloadFailed(EngineStatusError(status: status))
+            return false
+        }
+        return true
     }
     
-    func transcribe(_ audioData: [Float]) async -> String {
+    // Starts the engine session that AudioEngine's capture tap feeds; call it
+    // before starting the recording
+    @MainActor
+    func startTranscription() -> Bool {
         guard isModelReady else {
-            await MainActor.run {
-                self.error = .modelNotReady
-            }
-            return ""
+            self.error = .modelNotReady
+            return false
         }
         
+        transcript.reset()
+        let status = vb_engine_start_transcription(onTranscriptionResult, onTranscriptionError,
+                                                   Unmanaged.passUnretained(transcript).toOpaque())
+        guard status == VB_STATUS_SUCCESS else {
+            self.error = .transcriptionFailed(EngineStatusError(status: status))
+            return false
+        }
+        return true
+    }
+    
+    // Ends the session once the recording has stopped. The engine decodes the
+    // audio still buffered, and its final results arrive before stop returns.
+    func transcribe() async -> String {
         await MainActor.run {
             self.isProcessing = true
-            self.transcriptionProgress = 0.0
         }
         
         defer {
             Task { @MainActor in
                 self.isProcessing = false
-                self.transcriptionProgress = 0.0
             }
         }
         
-        do {
-            // TODO: Replace with actual Whisper transcription
-            // Simulate transcription processing
-            for i in 0...100 {
-                await MainActor.run {
-                    self.transcriptionProgress = Float(i) / 100.0
-                }
-                try await Task.sleep(nanoseconds: 20_000_000) // 20ms
-            }
-            
-            // Return dummy transcription for now
-            let dummyTranscriptions = [
-                "Hello, this is a test transcription.",
-                "Voice dictation is working perfectly.",
-                "The quick brown fox jumps over the lazy dog.",
-                "Testing offline speech recognition.",
-                "VoiceBoard provides private voice input."
-            ]
-            
-            return dummyTranscriptions.randomElement() ?? "Transcription complete."
-            
-        } catch {
-            await MainActor.run {
-                self.error = .transcriptionFailed(error)
-            }
-            return ""
-        }
+        let transcript = self.transcript
+        _ = await Task.detached {
+            vb_engine_stop_transcription()
+        }.value
+        return transcript.text.trimmingCharacters(in: .whitespaces)
     }
     
+    // Times every downloaded model natively (encoder pass plus decoder steps
+    // at several thread counts, on the CPU and each accelerated backend) and
+    // recommends the largest one that keeps up. Results are cached per device
+    // and model file, so only new or updated models cost benchmark time.
     func benchmarkDevice() async -> DeviceBenchmarkResult {
-        // TODO: Implement actual device benchmarking
-        let processorInfo = ProcessInfo.processInfo
+        let directory = modelsDirectory
+        let cachePath = directory.appendingPathComponent("benchmark.cache").path
         let deviceModel = await UIDevice.current.model
         
-        // Simulate benchmark
-        try? await Task.sleep(nanoseconds: 2_000_000_000) // 2 seconds
-        
-        // Simple heuristic based on available memory
-        let physicalMemory = processorInfo.physicalMemory
-        let memoryGB = Double(physicalMemory) / (1024 * 1024 * 1024)
+        let caps = await Task.detached { () -> vb_device_capabilities_t in
+            // Indexed by vb_model_type_t; models not downloaded stay nil
+            var paths = [UnsafeMutablePointer<CChar>?](repeating: nil, count: Int(VB_MODEL_TYPE_COUNT))
+            for model in WhisperModelType.allCases where vb_engine_is_model_available(model.engineType, directory.path) {
+                paths[Int(model.engineType.rawValue)] = strdup(directory.appendingPathComponent(model.fileName).path)
+            }
+            defer { paths.forEach { free($0) } }
+            
+            var caps = vb_device_capabilities_t()
+            let pathPointers = paths.map { UnsafePointer($0) }
+            if vb_engine_benchmark_models(pathPointers, cachePath, &caps) != VB_STATUS_SUCCESS {
+                // Nothing measured; the engine's estimate from the hardware alone
+                caps = vb_engine_benchmark_device()
+            }
+            return caps
+        }.value
         
-        let recommendedModel: WhisperModelType
-        if memoryGB >= 6 {
-            recommendedModel = .small
-        } else if memoryGB >= 4 {
-            recommendedModel = .base
-        } else {
-            recommendedModel = .tiny
+        var realTimeFactors: [WhisperModelType: Float] = [:]
+        withUnsafeBytes(of: caps.models) { raw in
+            let models = raw.bindMemory(to: vb_model_benchmark_t.self)
+            for model in WhisperModelType.allCases {
+                let rtf = models[Int(model.engineType.rawValue)].real_time_factor
+                if rtf > 0 {
+                    realTimeFactors[model] = rtf
+                }
+            }
         }
         
+        let recommendedModel = WhisperModelType.allCases.first {
+            $0.engineType == caps.recommended_model
+        } ?? .tiny
+        
         return DeviceBenchmarkResult(
             deviceModel: deviceModel,
-            memoryGB: memoryGB,
+            memoryGB: Double(caps.memory_mb) / 1024,
             recommendedModel: recommendedModel,
-            benchmarkScore: Float.random(in: 0.6...1.0)
+            benchmarkScore: caps.cpu_score,
+            recommendedThreads: Int(caps.recommended_n_threads),
+            realTimeFactors: realTimeFactors
         )
     }
     
     deinit {
-        // TODO: Cleanup whisper context
-        if whisperContext != nil {
-            // whisper_free(whisperContext)
+        vb_engine_cleanup()
+        if let transport = transport {
+            vb_engine_set_transport(nil)
+            vb_transport_close(transport)
         }
     }
 }
 
+// MARK: - Engine Callbacks
+
+// Final text of one session. The engine appends from its worker thread.
+private final class Transcript {
+    private let lock = NSLock()
+    private var value = ""
+    
+    var text: String {
+        lock.lock()
+        defer { lock.unlock() }
+        return value
+    }
+    
+    func reset() {
+        lock.lock()
+        value = ""
+        lock.unlock()
+    }
+    
+    func append(_ piece: String) {
+        lock.lock()
+        value += piece
+        lock.unlock()
+    }
+}
+
+// user_data is the session's Transcript; final results are append-only pieces
+private func onTranscriptionResult(_ result: UnsafeMutablePointer<vb_transcription_result_t>?,
+                                   _ userData: UnsafeMutableRawPointer?) {
+    guard let result = result, result.pointee.is_final,
+          let text = result.pointee.text, let userData = userData else { return }
+    Unmanaged<Transcript>.fromOpaque(userData).takeUnretainedValue().append(String(cString: text))
+}
+
+private func onTranscriptionError(_ status: vb_status_t, _ message: UnsafePointer<CChar>?,
+                                  _ userData: UnsafeMutableRawPointer?) {
+    let detail = message.map { String(cString: $0) } ?? ""
+    print("Transcription error: \(String(cString: vb_engine_status_to_string(status))): \(detail)")
+}
+
+// Transport for the engine's model download: each call is one ranged request
+// for the next chunk, made synchronously on the downloading thread
+private final class ModelFetcher {
+    private let totalBytes: Int64
+    private let progress: (Float) -> Void
+    
+    init(totalBytes: Int64, progress: @escaping (Float) -> Void) {
+        self.totalBytes = totalBytes
+        self.progress = progress
+    }
+    
+    func fetch(url: String, offset: Int64, into buffer: UnsafeMutableRawPointer, capacity: Int64) -> Int64 {
+        guard let requestURL = URL(string: url), capacity > 0 else { return -1 }
+        var request = URLRequest(url: requestURL)
+        request.setValue("bytes=\(offset)-\(offset + capacity - 1)", forHTTPHeaderField: "Range")
+        
+        let done = DispatchSemaphore(value: 0)
+        var copied: Int64 = -1
+        URLSession.shared.dataTask(with: request) { data, response, error in
+            defer { done.signal() }
+            guard error == nil, let data = data, let http = response as? HTTPURLResponse else { return }
+            if http.statusCode == 416 {
+                copied = 0 // past the end of the file
+                return
+            }
+            // A server that ignores the range sends the whole file from 0
+            guard http.statusCode == 206 || (http.statusCode == 200 && offset == 0) else { return }
+            let n = min(Int64(data.count), capacity)
+            data.copyBytes(to: buffer.assumingMemoryBound(to: UInt8.self), count: Int(n))
+            copied = n
+        }.resume()
+        done.wait()
+        
+        if copied > 0 && totalBytes > 0 {
+            progress(min(Float(offset + copied) / Float(totalBytes), 1.0))
+        }
+        return copied
+    }
+}
+
+private func fetchModelBytes(_ url: UnsafePointer<CChar>?, _ offset: Int64, _ buffer: UnsafeMutableRawPointer?,
+                             _ capacity: Int64, _ userData: UnsafeMutableRawPointer?) -> Int64 {
+    guard let url = url, let buffer = buffer, let userData = userData else { return -1 }
+    let fetcher = Unmanaged<ModelFetcher>.fromOpaque(userData).takeUnretainedValue()
+    return fetcher.fetch(url: String(cString: url), offset: offset, into: buffer, capacity: capacity)
+}
+
 // MARK: - Supporting Types
 struct DeviceBenchmarkResult {
     let deviceModel: String
     let memoryGB: Double
     let recommendedModel: WhisperManager.WhisperModelType
-    let benchmarkScore: Float
+    let benchmarkScore: Float                    // tiny.en audio seconds decoded per second, 0 = not measured
+    let recommendedThreads: Int
+    let realTimeFactors: [WhisperManager.WhisperModelType: Float]   // measured models only
+}
+
+// A vb_status_t the engine returned
+struct EngineStatusError: LocalizedError {
+    let status: vb_status_t
+    
+    var errorDescription: String? {
+        return String(cString: vb_engine_status_to_string(status))
+    }
 }
 
 enum WhisperError: LocalizedError {
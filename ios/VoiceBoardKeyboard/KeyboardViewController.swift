@@ -10,6 +10,11 @@ class KeyboardViewController: UIInputViewController {
     private var isRecording = false
     private var currentRequestId: String?
     
+    // The host app's results, read from the engine's shared transport
+    private lazy var resultReader = TransportReader { [weak self] type, text in
+        self?.handleResult(type: type, text: text)
+    }
+    
     override func updateViewConstraints() {
         super.updateViewConstraints()
         
@@ -21,7 +26,16 @@ class KeyboardViewController: UIInputViewController {
     override func viewDidLoad() {
         super.viewDidLoad()
         setupKeyboardView()
-        setupNotifications()
+    }
+    
+    override func viewWillAppear(_ animated: Bool) {
+        super.viewWillAppear(animated)
+        resultReader.start()
+    }
+    
+    override func viewWillDisappear(_ animated: Bool) {
+        super.viewWillDisappear(animated)
+        resultReader.stop()
     }
     
     private func setupKeyboardView() {
@@ -186,15 +200,6 @@ class KeyboardViewController: UIInputViewController {
         return button
     }
     
-    private func setupNotifications() {
-        NotificationCenter.default.addObserver(
-            self,
-            selector: #selector(transcriptionComplete),
-            name: Notification.Name("TranscriptionComplete"),
-            object: nil
-        )
-    }
-    
     // MARK: - Button Actions
     @objc private func micButtonPressed() {
         startDictation()
@@ -278,31 +283,93 @@ class KeyboardViewController: UIInputViewController {
         )
     }
     
-    @objc private func transcriptionComplete(notification: Notification) {
-        guard let userInfo = notification.userInfo,
-              let requestId = userInfo["requestId"] as? String,
-              requestId == currentRequestId else { return }
-        
-        // Get transcription result from App Groups
-        let sharedDefaults = UserDefaults(suiteName: "group.com.voiceboard.shared")
-        let transcription = sharedDefaults?.string(forKey: "transcription_\\(requestId)") ?? ""
-        
-        // Insert transcribed text
-        if !transcription.isEmpty {
-            textDocumentProxy.insertText(transcription)
+    // Partials show in the status line; finals are inserted as they arrive
+    private func handleResult(type: vb_message_type_t, text: String) {
+        switch type {
+        case VB_MESSAGE_PARTIAL:
+            statusLabel.text = text
+        case VB_MESSAGE_FINAL:
+            if !text.isEmpty {
+                textDocumentProxy.insertText(text)
+            }
+            if !isRecording {
+                currentRequestId = nil
+                statusLabel.text = "Tap and hold microphone to dictate"
+            }
+        case VB_MESSAGE_ERROR:
+            statusLabel.text = text
+        default:
+            break
         }
-        
-        // Clean up
-        currentRequestId = nil
-        statusLabel.text = "Tap and hold microphone to dictate"
-        
-        // Clean up shared data
-        sharedDefaults?.removeObject(forKey: "transcription_\\(requestId)")
-        sharedDefaults?.removeObject(forKey: "timestamp_\\(requestId)")
     }
     
     deinit {
-        NotificationCenter.default.removeObserver(self)
+        resultReader.stop()
+    }
+}
+
+// MARK: - TransportReader
+// Waits on the results ring in the App Group container on its own queue and
+// hands each message to the main queue. The host app creates the ring, so
+// until it has run there is nothing to map and the reader retries.
+private final class TransportReader {
+    private static let textCapacity = 4096
+    private static let waitMs: Int32 = 100
+    
+    private let handler: (vb_message_type_t, String) -> Void
+    private let queue = DispatchQueue(label: "com.voiceboard.keyboard.results")
+    private let lock = NSLock()
+    private var running = false
+    
+    init(handler: @escaping (vb_message_type_t, String) -> Void) {
+        self.handler = handler
+    }
+    
+    func start() {
+        lock.lock()
+        defer { lock.unlock() }
+        guard !running else { return }
+        running = true
+        queue.async { [self] in run() }
+    }
+    
+    func stop() {
+        lock.lock()
+        running = false
+        lock.unlock()
+    }
+    
+    private var isRunning: Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return running
+    }
+    
+    private func run() {
+        guard let container = FileManager.default.containerURL(
+            forSecurityApplicationGroupIdentifier: "group.com.voiceboard.shared") else { return }
+        let path = container.appendingPathComponent("results.ring").path
+        var transport: OpaquePointer?
+        var text = [CChar](repeating: 0, count: TransportReader.textCapacity)
+        
+        while isRunning {
+            guard let ring = transport ?? vb_transport_open(path, VB_TRANSPORT_CLIENT, 0) else {
+                Thread.sleep(forTimeInterval: Double(TransportReader.waitMs) / 1000.0)
+                continue
+            }
+            transport = ring
+            guard vb_transport_wait(ring, TransportReader.waitMs) else { continue }
+            
+            var message = vb_transport_message_t()
+            while text.withUnsafeMutableBufferPointer({
+                vb_transport_read(ring, &message, $0.baseAddress, Int32($0.count))
+            }) {
+                let type = message.type
+                let value = String(cString: text)
+                DispatchQueue.main.async { [handler] in handler(type, value) }
+            }
+        }
+        vb_transport_close(transport)
     }
 }
 
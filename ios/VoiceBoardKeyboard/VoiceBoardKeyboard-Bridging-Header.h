@@ -0,0 +1,2 @@
+// Native engine API; the extension links only the shared transport
+#include "../../whisper-engine/whisper_engine.h"
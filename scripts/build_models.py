@@ -16,19 +16,19 @@ MODELS = {
     "tiny.en": {
         "original": "https://openaipublic.azureedge.net/main/whisper/models/d3dd57d32accea0b295c96e26691aa14d8822fac7d9d27d5dc00b4ca2826dd03/tiny.en.pt",
         "ggml": "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-tiny.en-q5_1.bin",
-        "size_mb": 39,
+        "size_mb": 30.7,
         "description": "Fastest, lowest accuracy - good for testing"
     },
     "base.en": {
         "original": "https://openaipublic.azureedge.net/main/whisper/models/25a8566e1d0c1e2231d1c762132cd20e0f96a85d16145c3a00adf5d1ac670ead/base.en.pt",
         "ggml": "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-base.en-q5_1.bin", 
-        "size_mb": 148,
+        "size_mb": 57.0,
         "description": "Balanced speed and accuracy - recommended default"
     },
     "small.en": {
         "original": "https://openaipublic.azureedge.net/main/whisper/models/f953ad0fd29cacd07d5a9eda5624af0f6bcf2258be67c92b79389873d91e0872/small.en.pt",
         "ggml": "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-small.en-q5_1.bin",
-        "size_mb": 244, 
+        "size_mb": 181.3,
         "description": "Slower, higher accuracy - for powerful devices"
     }
 }
@@ -61,6 +61,39 @@ def download_file(url: str, filepath: Path, description: str = "") -> bool:
             filepath.unlink()
         return False
 
+def sha256_of(filepath: Path) -> str:
+    """SHA-256 of a file, checked by the native model registry on download"""
+    digest = hashlib.sha256()
+    with open(filepath, 'rb') as file:
+        for chunk in iter(lambda: file.read(1024 * 1024), b''):
+            digest.update(chunk)
+    return digest.hexdigest()
+
+def write_registry_manifest(manifest: dict, registry_path: Path) -> bool:
+    """Regenerate kManifest in model_registry.cpp from manifest.json, so the
+    native registry checks downloads against the same sizes and hashes"""
+    source = registry_path.read_text()
+    begin = source.find("static const ModelSpec kManifest[VB_MODEL_TYPE_COUNT] = {\n")
+    end = source.find("};\n", begin)
+    if begin < 0 or end < 0:
+        return False
+
+    # Rows follow vb_model_type_t, which MODELS lists in order
+    rows = []
+    for model_name in MODELS:
+        entry = manifest["models"].get(model_name)
+        if entry is None:
+            return False
+        rows.append(
+            f'    {{"{model_name}", "{entry["filename"]}", {entry["size_bytes"]},\n'
+            f'     "{entry["sha256"]}",\n'
+            f'     "{entry["url"]}"}},\n'
+        )
+
+    header = source[begin:source.index("\n", begin) + 1]
+    registry_path.write_text(source[:begin] + header + "".join(rows) + source[end:])
+    return True
+
 def verify_file_size(filepath: Path, expected_size_mb: int, tolerance: float = 0.1) -> bool:
     """Verify downloaded file size"""
     if not filepath.exists():
@@ -127,6 +160,8 @@ def main():
         if ggml_filepath.exists():
             manifest["models"][model_name] = {
                 "filename": ggml_filename,
+                "url": model_info['ggml'],
+                "sha256": sha256_of(ggml_filepath),
                 "size_bytes": ggml_filepath.stat().st_size,
                 "size_mb": round(ggml_filepath.stat().st_size / (1024 * 1024), 1),
                 "description": model_info['description'],
@@ -139,6 +174,12 @@ def main():
         json.dump(manifest, f, indent=2)
     
     print(f"📋 Created model manifest: {manifest_path}")
+    
+    registry_path = project_root / "whisper-engine" / "model_registry.cpp"
+    if write_registry_manifest(manifest, registry_path):
+        print(f"📋 Updated native manifest: {registry_path}")
+    else:
+        print(f"⚠️  Could not update {registry_path}; some models are missing")
     print()
     
     # Summary
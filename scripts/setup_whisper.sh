@@ -42,12 +42,16 @@ if [[ "$OSTYPE" == "darwin"* ]]; then
         -DWHISPER_NO_AVX2=ON \
         -DWHISPER_NO_FMA=ON \
         -DWHISPER_NO_F16C=ON \
-        -DWHISPER_METAL=ON
+        -DWHISPER_METAL=ON \
+        -DWHISPER_COREML=ON \
+        -DWHISPER_COREML_ALLOW_FALLBACK=ON
         
     make -j$(sysctl -n hw.ncpu)
     
     # Copy library to iOS project
     cp libwhisper.a "$PROJECT_ROOT/ios/VoiceBoard/libwhisper.a"
+    # Core ML encoder bridge; the VoiceBoard target links it with CoreML.framework
+    cp libwhisper.coreml.a "$PROJECT_ROOT/ios/VoiceBoard/libwhisper.coreml.a"
     
     cd ..
     
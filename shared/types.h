@@ -15,12 +15,36 @@ typedef enum {
     VB_MODEL_DISTIL_SMALL_EN = 2
 } vb_model_type_t;
 
+#define VB_MODEL_TYPE_COUNT 3
+
+// Where a model runs. Core ML takes the encoder to the Neural Engine, with the
+// decoder on Metal or the CPU.
+typedef enum {
+    VB_BACKEND_CPU = 0,
+    VB_BACKEND_METAL = 1,
+    VB_BACKEND_COREML = 2
+} vb_backend_t;
+
+#define VB_BACKEND_COUNT 3
+
+// Weight quantization of a model file. The manifest ships q5_1; the other
+// variants are converted on the device from the downloaded file.
+typedef enum {
+    VB_QUANT_Q5_1 = 0,
+    VB_QUANT_Q8_0 = 1,          // largest; fastest on CPUs with int8 dot products
+    VB_QUANT_Q4_0 = 2           // smallest; for devices where q5_1 does not stay resident
+} vb_quantization_t;
+
+#define VB_QUANT_COUNT 3
+
 typedef enum {
     VB_STATUS_SUCCESS = 0,
     VB_STATUS_ERROR = -1,
     VB_STATUS_MODEL_NOT_LOADED = -2,
     VB_STATUS_AUDIO_ERROR = -3,
-    VB_STATUS_INSUFFICIENT_MEMORY = -4
+    VB_STATUS_INSUFFICIENT_MEMORY = -4,
+    VB_STATUS_OVERLOADED = -5,        // decoding fell behind real time (error callback only)
+    VB_STATUS_INTEGRITY_ERROR = -6    // model file does not match its manifest size, hash or format
 } vb_status_t;
 
 typedef struct {
@@ -29,33 +53,210 @@ typedef struct {
     int32_t sample_rate;
 } vb_audio_buffer_t;
 
+// Raw 16-bit PCM as delivered by AudioRecord / AVAudioEngine
+typedef struct {
+    const int16_t* samples;
+    int32_t n_samples;
+    int32_t sample_rate;
+} vb_audio_buffer_i16_t;
+
+// Level of the most recent capture buffer, for an input meter
+typedef struct {
+    float rms;
+    float peak;
+} vb_input_level_t;
+
+typedef enum {
+    VB_NORMALIZE_NONE = 0,
+    VB_NORMALIZE_PEAK = 1,
+    VB_NORMALIZE_RMS = 2
+} vb_normalize_mode_t;
+
+// One decoder token of a transcription result
+typedef struct {
+    int32_t id;                 // whisper token id
+    const char* text;           // piece of the result text, leading space included; may end inside a UTF-8 sequence
+    int64_t t0_ms;              // session time of the token, as whisper estimates it
+    int64_t t1_ms;
+    float p;                    // decoder probability of the token
+} vb_token_t;
+
+// With partial results enabled, final results are append-only deltas of
+// committed text; a partial result replaces the previous partial and covers
+// only the not yet committed tail.
 typedef struct {
     char* text;
-    float confidence;
+    float confidence;           // geometric mean of the token probabilities, 1 without tokens
     int64_t timestamp_ms;
-    bool is_final;
+    bool is_final;              // stable: final text is never revised, a partial is replaced by the next result
+    const vb_token_t* tokens;   // the text's tokens, valid during the callback; NULL for text shed under overload
+    int32_t n_tokens;
 } vb_transcription_result_t;
 
+// Decoder thread scheduling
+typedef enum {
+    VB_THREADS_FIXED = 0,       // always n_threads (0 = up to 4)
+    VB_THREADS_ADAPTIVE = 1     // pinned to performance cores, count tuned from measured decode time
+} vb_thread_policy_t;
+
+// Thermal pressure reported by the host (ProcessInfo.thermalState, PowerManager thermal status)
+typedef enum {
+    VB_THERMAL_NOMINAL = 0,
+    VB_THERMAL_FAIR = 1,
+    VB_THERMAL_SERIOUS = 2,
+    VB_THERMAL_CRITICAL = 3
+} vb_thermal_state_t;
+
+// Memory pressure reported by the host (onTrimMemory, didReceiveMemoryWarning)
+typedef enum {
+    VB_TRIM_NONE = 0,
+    VB_TRIM_STATES = 1,         // free decoder states (KV caches, compute buffers) not in use
+    VB_TRIM_MODELS = 2          // also unload cached models no session is using
+} vb_trim_level_t;
+
+// Model residency between sessions
+typedef struct {
+    int32_t idle_timeout_ms;    // unused cached models stay loaded this long, 0 = default (2 min), < 0 = unload at once
+    bool warm_up;               // run a short decode right after loading so the first utterance starts warm
+} vb_residency_config_t;
+
+// What a session does when decoding falls behind real time. Overload means
+// more than max_queue_ms of captured audio is waiting for a decode; each
+// overload is reported through the error callback with VB_STATUS_OVERLOADED.
+typedef enum {
+    VB_OVERLOAD_DROP_NEWEST = 0,      // audio that does not fit the capture ring is rejected (VB_STATUS_AUDIO_ERROR)
+    VB_OVERLOAD_BLOCK = 1,            // vb_engine_process_audio waits for room in the capture ring
+    VB_OVERLOAD_DROP_OLDEST = 2,      // the oldest waiting audio is discarded; streaming commits its last hypothesis first
+    VB_OVERLOAD_COALESCE = 3,         // streaming skips partial updates and decodes the backlog in one longer pass
+    VB_OVERLOAD_DOWNGRADE = 4         // the session switches to its fallback model (vb_engine_set_fallback_model)
+} vb_overload_policy_t;
+
+// Voice activity detection
+typedef enum {
+    VB_VAD_OFF = 0,
+    VB_VAD_ENERGY = 1,      // built-in energy + zero-crossing detector
+    VB_VAD_CUSTOM = 2       // classifier supplied via vb_engine_set_vad_classifier
+} vb_vad_mode_t;
+
+typedef enum {
+    VB_VAD_EVENT_SPEECH_START = 0,
+    VB_VAD_EVENT_SPEECH_END = 1,
+    VB_VAD_EVENT_ENDPOINT = 2   // utterance finalized after sustained silence
+} vb_vad_event_type_t;
+
+typedef struct {
+    vb_vad_event_type_t type;
+    int64_t timestamp_ms;       // session time of the event
+} vb_vad_event_t;
+
 typedef struct {
     vb_model_type_t model_type;
-    bool use_gpu_acceleration;
+    bool use_gpu_acceleration;        // legacy vb_engine_load_model: load on the fastest accelerated backend, CPU fallback
     int32_t n_threads;
-    bool enable_partial_results;
-    int32_t partial_update_interval_ms;
+    vb_thread_policy_t thread_policy; // adaptive: n_threads is the upper bound, 0 = performance cores
+    bool enable_partial_results;      // streaming mode: re-decode a rolling window
+    int32_t partial_update_interval_ms; // 0 = default (300ms)
+    int32_t ring_buffer_ms;           // capture ring capacity, 0 = default (10s)
+    float pre_emphasis;               // pre-emphasis coefficient applied on ingest, 0 = off (typ. 0.97)
+    vb_normalize_mode_t normalize_mode;
+    float normalize_target;           // peak or RMS target level, 0 = default (1.0 peak, 0.1 RMS)
+    vb_vad_mode_t vad_mode;           // silence is skipped before whisper when enabled
+    float vad_threshold_db;           // energy above the noise floor, 0 = default (10dB)
+    int32_t vad_hangover_ms;          // silence kept after speech, 0 = default (300ms)
+    int32_t vad_endpoint_ms;          // silence that finalizes an utterance, 0 = default (800ms)
+    int32_t n_decode_states;          // whisper_state objects preallocated at load, 0 = default (1)
+    int32_t prompt_history_tokens;    // committed tokens fed back as decoder prompt, 0 = default (64), < 0 = off
+    int32_t encoder_refresh_ms;       // streaming: re-encode the window only after this much new audio, 0 = every partial update
+    vb_overload_policy_t overload_policy;
+    int32_t max_queue_ms;             // undecoded audio before the session counts as overloaded, 0 = default (3s)
+    int32_t batch_workers;            // batch: encoder windows decoded at once on their own states, 0 = model default
+    int32_t draft_tokens;             // cascade: tokens the session model drafts per rescoring model step, 0 = no speculative decoding; needs a whisper.cpp built with WHISPER_BATCHED_LOGITS
+    bool dynamic_audio_ctx;           // encode only as much of the 30s encoder window as the audio needs
+    int32_t min_audio_ctx_ms;         // dynamic_audio_ctx: shortest encoded window, 0 = default (2s)
 } vb_engine_config_t;
 
 // Device Benchmarking
 typedef struct {
-    float cpu_score;
-    float memory_mb;
-    bool has_neural_engine;  // iOS only
-    bool has_gpu_acceleration;
+    float real_time_factor;      // processing time / audio time of a 30s window, 0 = not measured
+    int32_t best_n_threads;
+    float encode_ms;             // one encoder pass at best_n_threads
+    float decode_token_ms;       // one decoder step at best_n_threads
+    float memory_mb;             // resident memory added by the model and one decoder state
+    vb_backend_t backend;        // fastest backend that passed its probe; the timings above are on it
+} vb_model_benchmark_t;
+
+typedef struct {
+    float cpu_score;             // tiny.en audio seconds decoded per second, 0 = not measured
+    float memory_mb;             // physical memory
+    bool has_neural_engine;  // iOS only; a Core ML encoder loaded and passed its probe
+    bool has_gpu_acceleration;   // a GPU backend is built in; after a benchmark, one passed its probe
     vb_model_type_t recommended_model;
+    int32_t recommended_n_threads;
+    float peak_memory_mb;        // peak resident set of the process during the benchmark
+    vb_model_benchmark_t models[VB_MODEL_TYPE_COUNT];  // indexed by vb_model_type_t
 } vb_device_capabilities_t;
 
+// Engine metrics. Each summary covers the most recent samples of a sliding
+// window (see vb_engine_get_metrics); count is the number of samples in it.
+typedef struct {
+    float p50;
+    float p90;
+    float p99;
+    float max;
+    int32_t count;
+} vb_metric_summary_t;
+
+typedef struct {
+    vb_metric_summary_t queue_depth_ms;           // audio waiting in the capture ring when drained
+    vb_metric_summary_t queue_lag_ms;             // captured audio not yet decoded, per worker wakeup
+    vb_metric_summary_t first_partial_latency_ms; // speech onset to first text of an utterance
+    vb_metric_summary_t mel_ms;                   // per decode pass
+    vb_metric_summary_t encode_ms;
+    vb_metric_summary_t decode_ms;
+    vb_metric_summary_t tokens_per_second;
+    vb_metric_summary_t real_time_factor;         // pass time / audio time of the pass
+    vb_metric_summary_t draft_acceptance;         // speculative passes: share of drafted tokens the rescoring model kept
+    float peak_memory_mb;                         // peak resident set of the process
+    uint64_t dropped_samples;                     // lost to capture ring overflows or shed under overload since start
+    uint64_t n_passes;                            // decode passes since start
+    uint64_t n_overloads;                         // overload events reported since start
+} vb_engine_metrics_t;
+
+// Cross-process transport (see vb_transport_open)
+typedef enum {
+    VB_TRANSPORT_HOST = 0,      // the app running the engine: creates the file, writes results, reads commands
+    VB_TRANSPORT_CLIENT = 1     // the keyboard extension: writes commands, reads results
+} vb_transport_role_t;
+
+typedef enum {
+    VB_MESSAGE_PARTIAL = 0,
+    VB_MESSAGE_FINAL = 1,
+    VB_MESSAGE_ERROR = 2,       // status holds the vb_status_t, text the message
+    VB_MESSAGE_COMMAND = 3      // client to host; status and text are up to the apps
+} vb_message_type_t;
+
+typedef struct {
+    vb_message_type_t type;
+    int32_t status;
+    int64_t timestamp_ms;
+    float confidence;
+    uint32_t sequence;          // per direction, counts every message written; a gap means messages were dropped
+    char* text;                 // written: NUL-terminated; read: the caller's buffer, truncated to its capacity
+    int32_t text_length;        // read: full length of the message text
+} vb_transport_message_t;
+
 // Callback function types
 typedef void (*vb_transcription_callback_t)(vb_transcription_result_t* result, void* user_data);
 typedef void (*vb_error_callback_t)(vb_status_t status, const char* message, void* user_data);
+typedef void (*vb_vad_callback_t)(const vb_vad_event_t* event, void* user_data);
+typedef void (*vb_metrics_callback_t)(const vb_engine_metrics_t* metrics, void* user_data);
+// Returns the probability that a frame of 16kHz audio contains speech
+typedef float (*vb_vad_classifier_t)(const float* frame, int32_t n_samples, void* user_data);
+// Model download transport, supplied by the platform: copy up to capacity
+// bytes of url starting at offset into buffer. Returns the bytes copied, 0 at
+// the end of the file, or a negative value on failure.
+typedef int64_t (*vb_model_fetch_callback_t)(const char* url, int64_t offset, void* buffer,
+                                             int64_t capacity, void* user_data);
 
 #ifdef __cplusplus
 }
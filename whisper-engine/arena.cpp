@@ -0,0 +1,53 @@
+#include "arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    if (!blocks_.empty()) {
+        const size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= blocks_.back().size) {
+            used_ = offset + size;
+            return blocks_.back().data.get() + offset;
+        }
+    }
+
+    // Blocks come from new[], aligned for any fundamental type
+    Block block;
+    block.size = std::max(block_size_, size);
+    block.data.reset(new char[block.size]);
+    blocks_.push_back(std::move(block));
+    used_ = size;
+    return blocks_.back().data.get();
+}
+
+void Arena::reset() {
+    if (blocks_.size() > 1) {
+        const size_t total = capacity();
+        blocks_.clear();
+        Block block;
+        block.size = total;
+        block.data.reset(new char[total]);
+        blocks_.push_back(std::move(block));
+    }
+    used_ = 0;
+}
+
+void Arena::reserve(size_t bytes) {
+    reset();
+    if (capacity() < bytes) {
+        blocks_.clear();
+        Block block;
+        block.size = bytes;
+        block.data.reset(new char[bytes]);
+        blocks_.push_back(std::move(block));
+    }
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (const Block& block : blocks_) {
+        total += block.size;
+    }
+    return total;
+}
@@ -0,0 +1,75 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for transient data of one decode pass (hypothesis words,
+// result text, token arrays). Allocation is a pointer bump; nothing is freed
+// until reset(), which releases everything at once. Not thread safe: each
+// arena belongs to one thread.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 64 * 1024);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocate_array(size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // Frees everything. Overflow blocks are merged into one, so once an arena
+    // has seen its working set it stops calling malloc.
+    void reset();
+
+    // Frees everything and makes sure one block holds at least bytes
+    void reserve(size_t bytes);
+    size_t capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    size_t used_ = 0;                            // bytes taken from the last block
+    size_t block_size_;
+};
+
+// Standard allocator over an arena; deallocate is a no-op. Containers copy,
+// move and swap their arena along with their contents.
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    Arena* arena = nullptr;
+
+    ArenaAllocator() noexcept = default;
+    ArenaAllocator(Arena* a) noexcept : arena(a) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) { return arena->allocate_array<T>(n); }
+    void deallocate(T*, size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+#endif // ARENA_H
@@ -0,0 +1,336 @@
+#include "audio_dsp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VB_DSP_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VB_DSP_SSE2 1
+#endif
+
+static const float kPcm16Scale = 1.0f / 32768.0f;
+static const float kDefaultPeakTarget = 1.0f;
+static const float kDefaultRmsTarget = 0.1f;
+static const float kSilencePeak = 1e-4f;  // below this there is nothing worth amplifying
+
+// Scalar tail shared by all paths
+template <typename T>
+static void preprocess_scalar(const T* in, float* out, size_t begin, size_t n, float scale,
+                              float alpha, float prev, float* peak, double* sum_squares) {
+    for (size_t i = begin; i < n; ++i) {
+        const float x = in[i] * scale;
+        const float y = x - alpha * prev;
+        prev = x;
+        out[i] = y;
+        const float a = std::fabs(y);
+        if (a > *peak) {
+            *peak = a;
+        }
+        *sum_squares += (double) y * y;
+    }
+}
+
+#if defined(VB_DSP_NEON)
+static inline void accumulate_neon(float32x4_t y, float32x4_t* vpeak, float32x4_t* vsum) {
+    *vpeak = vmaxq_f32(*vpeak, vabsq_f32(y));
+    *vsum = vmlaq_f32(*vsum, y, y);
+}
+
+static inline void reduce_neon(float32x4_t vpeak, float32x4_t vsum, float* peak, double* sum_squares) {
+    float lanes_peak[4];
+    float lanes_sum[4];
+    vst1q_f32(lanes_peak, vpeak);
+    vst1q_f32(lanes_sum, vsum);
+    for (int k = 0; k < 4; ++k) {
+        if (lanes_peak[k] > *peak) {
+            *peak = lanes_peak[k];
+        }
+        *sum_squares += lanes_sum[k];
+    }
+}
+#elif defined(VB_DSP_SSE2)
+static inline void accumulate_sse(__m128 y, __m128* vpeak, __m128* vsum) {
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    *vpeak = _mm_max_ps(*vpeak, _mm_and_ps(y, abs_mask));
+    *vsum = _mm_add_ps(*vsum, _mm_mul_ps(y, y));
+}
+
+static inline void reduce_sse(__m128 vpeak, __m128 vsum, float* peak, double* sum_squares) {
+    float lanes_peak[4];
+    float lanes_sum[4];
+    _mm_storeu_ps(lanes_peak, vpeak);
+    _mm_storeu_ps(lanes_sum, vsum);
+    for (int k = 0; k < 4; ++k) {
+        if (lanes_peak[k] > *peak) {
+            *peak = lanes_peak[k];
+        }
+        *sum_squares += lanes_sum[k];
+    }
+}
+
+static inline __m128 pcm16_lo_sse(__m128i v, __m128 scale) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale);
+}
+
+static inline __m128 pcm16_hi_sse(__m128i v, __m128 scale) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale);
+}
+#endif
+
+void dsp_convert_pcm16(const int16_t* in, float* out, size_t n,
+                       float pre_emphasis, float* prev, AudioLevelStats* stats) {
+    if (n == 0) {
+        return;
+    }
+
+    float peak = stats->peak;
+    double sum_squares = 0.0;
+
+    // The first sample pairs with the previous chunk; after that x[n-1] is
+    // read with an unaligned load one sample behind the current one
+    preprocess_scalar(in, out, 0, 1, kPcm16Scale, pre_emphasis, *prev, &peak, &sum_squares);
+    size_t i = 1;
+
+#if defined(VB_DSP_NEON)
+    const float32x4_t alpha = vdupq_n_f32(pre_emphasis);
+    float32x4_t vpeak = vdupq_n_f32(0.0f);
+    float32x4_t vsum = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t cur = vld1q_s16(in + i);
+        const int16x8_t prv = vld1q_s16(in + i - 1);
+        const float32x4_t x_lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(cur))), kPcm16Scale);
+        const float32x4_t x_hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(cur))), kPcm16Scale);
+        const float32x4_t p_lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(prv))), kPcm16Scale);
+        const float32x4_t p_hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(prv))), kPcm16Scale);
+        const float32x4_t y_lo = vmlsq_f32(x_lo, alpha, p_lo);
+        const float32x4_t y_hi = vmlsq_f32(x_hi, alpha, p_hi);
+        vst1q_f32(out + i, y_lo);
+        vst1q_f32(out + i + 4, y_hi);
+        accumulate_neon(y_lo, &vpeak, &vsum);
+        accumulate_neon(y_hi, &vpeak, &vsum);
+    }
+    reduce_neon(vpeak, vsum, &peak, &sum_squares);
+#elif defined(VB_DSP_SSE2)
+    const __m128 scale = _mm_set1_ps(kPcm16Scale);
+    const __m128 alpha = _mm_set1_ps(pre_emphasis);
+    __m128 vpeak = _mm_setzero_ps();
+    __m128 vsum = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        const __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i prv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i - 1));
+        const __m128 y_lo = _mm_sub_ps(pcm16_lo_sse(cur, scale), _mm_mul_ps(alpha, pcm16_lo_sse(prv, scale)));
+        const __m128 y_hi = _mm_sub_ps(pcm16_hi_sse(cur, scale), _mm_mul_ps(alpha, pcm16_hi_sse(prv, scale)));
+        _mm_storeu_ps(out + i, y_lo);
+        _mm_storeu_ps(out + i + 4, y_hi);
+        accumulate_sse(y_lo, &vpeak, &vsum);
+        accumulate_sse(y_hi, &vpeak, &vsum);
+    }
+    reduce_sse(vpeak, vsum, &peak, &sum_squares);
+#endif
+
+    preprocess_scalar(in, out, i, n, kPcm16Scale, pre_emphasis, in[i - 1] * kPcm16Scale,
+                      &peak, &sum_squares);
+
+    *prev = in[n - 1] * kPcm16Scale;
+    stats->peak = peak;
+    stats->sum_squares += sum_squares;
+    stats->n_samples += n;
+}
+
+void dsp_preprocess_f32(const float* in, float* out, size_t n,
+                        float pre_emphasis, float* prev, AudioLevelStats* stats) {
+    if (n == 0) {
+        return;
+    }
+
+    float peak = stats->peak;
+    double sum_squares = 0.0;
+
+    preprocess_scalar(in, out, 0, 1, 1.0f, pre_emphasis, *prev, &peak, &sum_squares);
+    size_t i = 1;
+
+#if defined(VB_DSP_NEON)
+    const float32x4_t alpha = vdupq_n_f32(pre_emphasis);
+    float32x4_t vpeak = vdupq_n_f32(0.0f);
+    float32x4_t vsum = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t y = vmlsq_f32(vld1q_f32(in + i), alpha, vld1q_f32(in + i - 1));
+        vst1q_f32(out + i, y);
+        accumulate_neon(y, &vpeak, &vsum);
+    }
+    reduce_neon(vpeak, vsum, &peak, &sum_squares);
+#elif defined(VB_DSP_SSE2)
+    const __m128 alpha = _mm_set1_ps(pre_emphasis);
+    __m128 vpeak = _mm_setzero_ps();
+    __m128 vsum = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        const __m128 y = _mm_sub_ps(_mm_loadu_ps(in + i), _mm_mul_ps(alpha, _mm_loadu_ps(in + i - 1)));
+        _mm_storeu_ps(out + i, y);
+        accumulate_sse(y, &vpeak, &vsum);
+    }
+    reduce_sse(vpeak, vsum, &peak, &sum_squares);
+#endif
+
+    preprocess_scalar(in, out, i, n, 1.0f, pre_emphasis, in[i - 1], &peak, &sum_squares);
+
+    *prev = in[n - 1];
+    stats->peak = peak;
+    stats->sum_squares += sum_squares;
+    stats->n_samples += n;
+}
+
+void dsp_measure_level(const float* in, size_t n, AudioLevelStats* stats) {
+    float peak = stats->peak;
+    double sum_squares = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        peak = std::max(peak, std::fabs(in[i]));
+        sum_squares += (double) in[i] * in[i];
+    }
+    stats->peak = peak;
+    stats->sum_squares += sum_squares;
+    stats->n_samples += n;
+}
+
+void dsp_scale(const float* in, float* out, size_t n, float gain) {
+    size_t i = 0;
+#if defined(VB_DSP_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), gain));
+    }
+#elif defined(VB_DSP_SSE2)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), g));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+float dsp_normalization_gain(const AudioLevelStats& stats, vb_normalize_mode_t mode, float target) {
+    if (mode == VB_NORMALIZE_NONE || stats.n_samples == 0 || stats.peak < kSilencePeak) {
+        return 1.0f;
+    }
+
+    const float peak_limit = 1.0f / stats.peak;
+
+    if (mode == VB_NORMALIZE_PEAK) {
+        return (target > 0.0f ? target : kDefaultPeakTarget) * peak_limit;
+    }
+
+    const float rms = (float) std::sqrt(stats.sum_squares / (double) stats.n_samples);
+    const float gain = (target > 0.0f ? target : kDefaultRmsTarget) / rms;
+    return gain < peak_limit ? gain : peak_limit;
+}
+
+// Sum of a[i] * b[i] over n = Resampler::kTaps values, a multiple of 4
+static float dot_taps(const float* a, const float* b, size_t n) {
+#if defined(VB_DSP_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < n; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float lanes[4];
+    vst1q_f32(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(VB_DSP_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (size_t i = 0; i < n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+bool Resampler::configure(int32_t in_rate, int32_t out_rate) {
+    if (in_rate < kMinRate || in_rate > kMaxRate || out_rate < kMinRate || out_rate > kMaxRate) {
+        return false;
+    }
+    if (in_rate != in_rate_ || out_rate != out_rate_) {
+        in_rate_ = in_rate;
+        out_rate_ = out_rate;
+        step_ = (double) in_rate / (double) out_rate;
+
+        // Cutoff a little under the lower Nyquist rate, in cycles per input
+        // sample; Blackman window over the taps, each phase normalized to
+        // unit gain. Tap j of phase p sits j - (kTaps / 2 - 1) - p / kPhases
+        // samples from the output position.
+        const double cutoff = 0.45 * std::min(1.0, 1.0 / step_);
+        for (int p = 0; p <= kPhases; ++p) {
+            float* taps = table_ + (size_t) p * kTaps;
+            double sum = 0.0;
+            for (int j = 0; j < kTaps; ++j) {
+                const double t = (double) (j - (kTaps / 2 - 1)) - (double) p / kPhases;
+                const double x = 2.0 * M_PI * cutoff * t;
+                const double sinc = t == 0.0 ? 1.0 : std::sin(x) / x;
+                const double w = (t + kTaps / 2.0) / kTaps;
+                const double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * w) + 0.08 * std::cos(4.0 * M_PI * w);
+                taps[j] = (float) (sinc * window);
+                sum += taps[j];
+            }
+            for (int j = 0; j < kTaps; ++j) {
+                taps[j] = (float) (taps[j] / sum);
+            }
+        }
+    }
+    reset();
+    return true;
+}
+
+void Resampler::reset() {
+    // Half a window of silence ahead of the first sample lines the first
+    // output up with it
+    std::fill(buffer_, buffer_ + kTaps + kBlock, 0.0f);
+    n_buffered_ = kTaps / 2 - 1;
+    position_ = 0.0;
+}
+
+size_t Resampler::process(const float* in, size_t n, float* out, AudioLevelStats* stats) {
+    float peak = stats->peak;
+    double sum_squares = 0.0;
+    size_t n_out = 0;
+
+    while (n > 0) {
+        const size_t take = std::min(n, kTaps + kBlock - n_buffered_);
+        memcpy(buffer_ + n_buffered_, in, take * sizeof(float));
+        n_buffered_ += take;
+        in += take;
+        n -= take;
+
+        while (position_ + kTaps <= (double) n_buffered_) {
+            const size_t first = (size_t) position_;
+            const int phase = (int) ((position_ - (double) first) * kPhases + 0.5);
+            const float y = dot_taps(buffer_ + first, table_ + (size_t) phase * kTaps, kTaps);
+            out[n_out++] = y;
+            const float a = std::fabs(y);
+            if (a > peak) {
+                peak = a;
+            }
+            sum_squares += (double) y * y;
+            position_ += step_;
+        }
+
+        // Keep what the next outputs' windows still cover
+        const size_t consumed = std::min((size_t) position_, n_buffered_);
+        memmove(buffer_, buffer_ + consumed, (n_buffered_ - consumed) * sizeof(float));
+        n_buffered_ -= consumed;
+        position_ -= (double) consumed;
+    }
+
+    stats->peak = peak;
+    stats->sum_squares += sum_squares;
+    stats->n_samples += n_out;
+    return n_out;
+}
@@ -0,0 +1,83 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include "../shared/types.h"
+#include <cstddef>
+#include <cstdint>
+
+// Running level statistics of preprocessed audio
+struct AudioLevelStats {
+    float peak = 0.0f;
+    double sum_squares = 0.0;
+    uint64_t n_samples = 0;
+
+    void merge(const AudioLevelStats& other) {
+        if (other.peak > peak) {
+            peak = other.peak;
+        }
+        sum_squares += other.sum_squares;
+        n_samples += other.n_samples;
+    }
+};
+
+// Fused single pass over a chunk: int16 -> float in [-1, 1), optional
+// pre-emphasis y[n] = x[n] - alpha * x[n-1] (alpha = 0 disables it), and
+// peak/energy accumulation of the output. prev carries x[n-1] across chunks.
+// out may not alias in.
+void dsp_convert_pcm16(const int16_t* in, float* out, size_t n,
+                       float pre_emphasis, float* prev, AudioLevelStats* stats);
+
+// Same as dsp_convert_pcm16 for float input
+void dsp_preprocess_f32(const float* in, float* out, size_t n,
+                        float pre_emphasis, float* prev, AudioLevelStats* stats);
+
+// Peak/energy accumulation of float audio without producing output
+void dsp_measure_level(const float* in, size_t n, AudioLevelStats* stats);
+
+// out[i] = in[i] * gain; out may alias in
+void dsp_scale(const float* in, float* out, size_t n, float gain);
+
+// Gain that brings audio with the given statistics to the normalization
+// target, never pushing the peak above full scale. Returns 1 for silence.
+float dsp_normalization_gain(const AudioLevelStats& stats, vb_normalize_mode_t mode, float target);
+
+// Streaming conversion of capture audio from the device rate to another rate
+// (16kHz for whisper): each output is a windowed-sinc lowpass at the lower
+// Nyquist rate, evaluated at the output position from a table of fractional
+// offsets. The taps of the last chunk carry over, so chunk boundaries are
+// seamless. State is fixed-size; nothing allocates after construction.
+class Resampler {
+public:
+    static const int kTaps = 32;
+    static const int kPhases = 64;
+    static const int32_t kMinRate = 8000;
+    static const int32_t kMaxRate = 192000;
+
+    // Resets the stream and, when the rates change, rebuilds the filter.
+    // False for rates outside [kMinRate, kMaxRate].
+    bool configure(int32_t in_rate, int32_t out_rate);
+    void reset();
+
+    int32_t in_rate() const { return in_rate_; }
+    bool passthrough() const { return in_rate_ == out_rate_; }
+
+    // Most output samples n more input samples can produce
+    size_t max_output(size_t n) const { return (size_t) ((double) (n + kTaps) / step_) + 1; }
+
+    // Converts n input samples into out, which must hold max_output(n), and
+    // adds the output's peak and energy to stats. Returns the samples written.
+    size_t process(const float* in, size_t n, float* out, AudioLevelStats* stats);
+
+private:
+    static const size_t kBlock = 1024;
+
+    int32_t in_rate_ = 0;
+    int32_t out_rate_ = 0;
+    double step_ = 1.0;                          // input samples per output sample
+    double position_ = 0.0;                      // first tap of the next output, in buffer_
+    size_t n_buffered_ = 0;
+    float table_[(kPhases + 1) * kTaps] = {};
+    float buffer_[kTaps + kBlock] = {};
+};
+
+#endif // AUDIO_DSP_H
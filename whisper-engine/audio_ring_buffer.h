@@ -0,0 +1,158 @@
+#ifndef AUDIO_RING_BUFFER_H
+#define AUDIO_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
+
+// Single-producer/single-consumer ring of float samples.
+// The producer (audio capture thread) never blocks or allocates; storage is
+// allocated up front by allocate() while no thread is using the ring.
+class AudioRingBuffer {
+public:
+    AudioRingBuffer() = default;
+    AudioRingBuffer(const AudioRingBuffer&) = delete;
+    AudioRingBuffer& operator=(const AudioRingBuffer&) = delete;
+
+    // Capacity is rounded up to a power of two. Not thread safe.
+    void allocate(size_t min_capacity) {
+        size_t capacity = 1;
+        while (capacity < min_capacity) {
+            capacity <<= 1;
+        }
+        if (capacity != buffer_.size()) {
+            buffer_.assign(capacity, 0.0f);
+            mask_ = capacity - 1;
+        }
+        reset();
+    }
+
+    // Not thread safe; call while neither side is running.
+    void reset() {
+        write_pos_.store(0, std::memory_order_relaxed);
+        read_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return buffer_.size(); }
+
+    // Consumer side: samples ready to read
+    size_t available() const {
+        return write_pos_.load(std::memory_order_acquire) - read_pos_.load(std::memory_order_relaxed);
+    }
+
+    // Producer side: room left for writing
+    size_t free_space() const {
+        return buffer_.size() - (write_pos_.load(std::memory_order_relaxed) -
+                                 read_pos_.load(std::memory_order_acquire));
+    }
+
+    // Producer: copy up to n samples in, returns the number written
+    size_t write(const float* data, size_t n) {
+        const size_t w = write_pos_.load(std::memory_order_relaxed);
+        const size_t space = buffer_.size() - (w - read_pos_.load(std::memory_order_acquire));
+        if (n > space) {
+            n = space;
+        }
+        copy_in(w, data, n);
+        write_pos_.store(w + n, std::memory_order_release);
+        return n;
+    }
+
+    // Producer: borrow a contiguous writable span of up to n samples inside the
+    // ring. The span may be shorter than n when it would wrap; publish the
+    // samples actually written with commit_write().
+    float* acquire_write(size_t n, size_t* granted) {
+        const size_t w = write_pos_.load(std::memory_order_relaxed);
+        const size_t space = buffer_.size() - (w - read_pos_.load(std::memory_order_acquire));
+        const size_t start = w & mask_;
+        const size_t contiguous = buffer_.size() - start;
+        if (n > space) {
+            n = space;
+        }
+        if (n > contiguous) {
+            n = contiguous;
+        }
+        *granted = n;
+        return buffer_.data() + start;
+    }
+
+    // Producer: publish n samples written into the last acquired span
+    void commit_write(size_t n) {
+        write_pos_.store(write_pos_.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Consumer: copy up to n samples out, returns the number read
+    size_t read(float* out, size_t n) {
+        const size_t r = read_pos_.load(std::memory_order_relaxed);
+        const size_t ready = write_pos_.load(std::memory_order_acquire) - r;
+        if (n > ready) {
+            n = ready;
+        }
+        copy_out(r, out, n);
+        read_pos_.store(r + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    void copy_in(size_t pos, const float* data, size_t n) {
+        const size_t start = pos & mask_;
+        const size_t first = n < buffer_.size() - start ? n : buffer_.size() - start;
+        memcpy(buffer_.data() + start, data, first * sizeof(float));
+        memcpy(buffer_.data(), data + first, (n - first) * sizeof(float));
+    }
+
+    void copy_out(size_t pos, float* out, size_t n) const {
+        const size_t start = pos & mask_;
+        const size_t first = n < buffer_.size() - start ? n : buffer_.size() - start;
+        memcpy(out, buffer_.data() + start, first * sizeof(float));
+        memcpy(out + first, buffer_.data(), (n - first) * sizeof(float));
+    }
+
+    std::vector<float> buffer_;
+    size_t mask_ = 0;
+
+    // Positions grow monotonically and are masked on access; keep them on
+    // separate cache lines so producer and consumer don't false-share
+    alignas(64) std::atomic<size_t> write_pos_{0};
+    alignas(64) std::atomic<size_t> read_pos_{0};
+};
+
+// Counting wakeup signal. notify() is a non-blocking syscall that is safe to
+// call from the audio thread; a notify() that races ahead of wait() is not lost.
+class WakeupSignal {
+public:
+#if defined(__APPLE__)
+    WakeupSignal() : sem_(dispatch_semaphore_create(0)) {}
+    ~WakeupSignal() { dispatch_release(sem_); }
+    void notify() { dispatch_semaphore_signal(sem_); }
+    void wait() { dispatch_semaphore_wait(sem_, DISPATCH_TIME_FOREVER); }
+#else
+    WakeupSignal() { sem_init(&sem_, 0, 0); }
+    ~WakeupSignal() { sem_destroy(&sem_); }
+    void notify() { sem_post(&sem_); }
+    void wait() {
+        while (sem_wait(&sem_) != 0) {
+            // retry on EINTR
+        }
+    }
+#endif
+
+    WakeupSignal(const WakeupSignal&) = delete;
+    WakeupSignal& operator=(const WakeupSignal&) = delete;
+
+private:
+#if defined(__APPLE__)
+    dispatch_semaphore_t sem_;
+#else
+    sem_t sem_;
+#endif
+};
+
+#endif // AUDIO_RING_BUFFER_H
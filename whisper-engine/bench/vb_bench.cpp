@@ -0,0 +1,748 @@
+// vb_bench: replay a directory of WAV files through the engine for every model
+// in models/manifest.json and report latency, real-time factor, WER and memory
+// as JSON that can be diffed between builds.
+//
+// usage: vb_bench --corpus DIR [--models DIR] [--manifest FILE] [--model NAME]...
+//                 [--realtime] [--batch] [--gpu] [--threads N] [--chunk-ms MS] [--output FILE]
+//
+// Each foo.wav in the corpus may have a reference transcript in foo.txt.
+
+#include "whisper_engine.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kSampleRate = 16000;
+static const int kDefaultChunkMs = 20;
+static const int kRingSlackMs = 2000;
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_between(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// ---------------------------------------------------------------------------
+// Options
+
+struct Options {
+    std::string corpus_dir;
+    std::string models_dir;
+    std::string manifest_path;
+    std::vector<std::string> model_names;      // empty = every model in the manifest
+    std::string output_path;
+    bool realtime = false;
+    bool streaming = true;
+    bool use_gpu = false;
+    int n_threads = 0;
+    int chunk_ms = kDefaultChunkMs;
+};
+
+static void print_usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --corpus DIR [--models DIR] [--manifest FILE] [--model NAME]...\n"
+            "          [--realtime] [--batch] [--gpu] [--threads N] [--chunk-ms MS] [--output FILE]\n"
+            "\n"
+            "  --corpus DIR     WAV files to replay; foo.txt next to foo.wav is its reference\n"
+            "  --models DIR     model files (default: directory of the manifest)\n"
+            "  --manifest FILE  model manifest (default: models/manifest.json)\n"
+            "  --model NAME     only run this manifest entry (repeatable)\n"
+            "  --realtime       feed audio at capture speed instead of as fast as possible\n"
+            "  --batch          disable partial results\n"
+            "  --gpu            load models on an accelerated backend when one works\n"
+            "  --threads N      decoder threads (default: engine default)\n"
+            "  --chunk-ms MS    capture chunk size (default: %d)\n"
+            "  --output FILE    write JSON here instead of stdout\n",
+            argv0, kDefaultChunkMs);
+}
+
+static bool parse_options(int argc, char** argv, Options* opts) {
+    opts->manifest_path = "models/manifest.json";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--corpus" && has_value) {
+            opts->corpus_dir = argv[++i];
+        } else if (arg == "--models" && has_value) {
+            opts->models_dir = argv[++i];
+        } else if (arg == "--manifest" && has_value) {
+            opts->manifest_path = argv[++i];
+        } else if (arg == "--model" && has_value) {
+            opts->model_names.push_back(argv[++i]);
+        } else if (arg == "--output" && has_value) {
+            opts->output_path = argv[++i];
+        } else if (arg == "--threads" && has_value) {
+            opts->n_threads = atoi(argv[++i]);
+        } else if (arg == "--chunk-ms" && has_value) {
+            opts->chunk_ms = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--realtime") {
+            opts->realtime = true;
+        } else if (arg == "--batch") {
+            opts->streaming = false;
+        } else if (arg == "--gpu") {
+            opts->use_gpu = true;
+        } else {
+            return false;
+        }
+    }
+    if (opts->models_dir.empty()) {
+        const size_t slash = opts->manifest_path.find_last_of('/');
+        opts->models_dir = slash == std::string::npos ? "." : opts->manifest_path.substr(0, slash);
+    }
+    return !opts->corpus_dir.empty();
+}
+
+// ---------------------------------------------------------------------------
+// Manifest: just enough JSON to read models.<name>.filename
+
+struct ManifestModel {
+    std::string name;
+    std::string filename;
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : text_(text) {}
+
+    // Calls on_member(key) for each member of the object at the cursor; the
+    // callback must consume the value (or call skip_value)
+    template <typename F>
+    bool read_object(F on_member) {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            std::string key;
+            if (!read_string(&key) || !consume(':') || !on_member(key)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+    bool read_string(std::string* out) {
+        if (!consume('"')) {
+            return false;
+        }
+        out->clear();
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                ++pos_;
+            }
+            out->push_back(text_[pos_++]);
+        }
+        return consume('"');
+    }
+
+    bool skip_value() {
+        skip_whitespace();
+        if (pos_ >= text_.size()) {
+            return false;
+        }
+        const char c = text_[pos_];
+        if (c == '"') {
+            std::string ignored;
+            return read_string(&ignored);
+        }
+        if (c == '{') {
+            return read_object([this](const std::string&) { return skip_value(); });
+        }
+        if (c == '[') {
+            ++pos_;
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                if (!skip_value()) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(']');
+        }
+        // number, true, false, null
+        while (pos_ < text_.size() && !strchr(",}] \t\r\n", text_[pos_])) {
+            ++pos_;
+        }
+        return true;
+    }
+
+    bool peek(char c) {
+        skip_whitespace();
+        return pos_ < text_.size() && text_[pos_] == c;
+    }
+
+private:
+    void skip_whitespace() {
+        while (pos_ < text_.size() && isspace((unsigned char) text_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char c) {
+        if (!peek(c)) {
+            return false;
+        }
+        ++pos_;
+        return true;
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+static bool load_manifest(const std::string& path, std::vector<ManifestModel>* models) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    JsonReader json(text);
+    return json.read_object([&](const std::string& key) {
+        if (key != "models") {
+            return json.skip_value();
+        }
+        return json.read_object([&](const std::string& name) {
+            ManifestModel model;
+            model.name = name;
+            const bool ok = json.read_object([&](const std::string& field) {
+                if (field == "filename" && json.peek('"')) {
+                    return json.read_string(&model.filename);
+                }
+                return json.skip_value();
+            });
+            if (ok && !model.filename.empty()) {
+                models->push_back(model);
+            }
+            return ok;
+        });
+    });
+}
+
+static vb_model_type_t model_type_for_name(const std::string& name) {
+    if (name.find("tiny") != std::string::npos) {
+        return VB_MODEL_TINY_EN;
+    }
+    if (name.find("base") != std::string::npos) {
+        return VB_MODEL_BASE_EN;
+    }
+    return VB_MODEL_DISTIL_SMALL_EN;
+}
+
+// ---------------------------------------------------------------------------
+// Corpus
+
+struct Utterance {
+    std::string name;
+    std::vector<int16_t> samples;              // 16kHz mono
+    std::string reference;                     // empty when there is no transcript
+    bool has_reference = false;
+};
+
+static uint32_t read_le32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+// 16-bit PCM WAV, any channel count and rate; downmixed and linearly resampled to 16kHz mono
+static bool load_wav(const std::string& path, std::vector<int16_t>* out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    int channels = 0;
+    int rate = 0;
+    int bits = 0;
+    const uint8_t* pcm = nullptr;
+    size_t pcm_bytes = 0;
+
+    size_t pos = 12;
+    while (pos + 8 <= data.size()) {
+        const uint8_t* chunk = data.data() + pos;
+        const size_t size = read_le32(chunk + 4);
+        const size_t body = pos + 8;
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && body + 16 <= data.size()) {
+            if (read_le16(data.data() + body) != 1) {
+                return false;                  // not integer PCM
+            }
+            channels = read_le16(data.data() + body + 2);
+            rate = (int) read_le32(data.data() + body + 4);
+            bits = read_le16(data.data() + body + 14);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            pcm = data.data() + body;
+            pcm_bytes = std::min(size, data.size() - body);
+        }
+        pos = body + size + (size & 1);
+    }
+
+    if (!pcm || channels <= 0 || rate <= 0 || bits != 16) {
+        return false;
+    }
+
+    const size_t n_frames = pcm_bytes / (2 * channels);
+    std::vector<float> mono(n_frames);
+    for (size_t i = 0; i < n_frames; ++i) {
+        int sum = 0;
+        for (int c = 0; c < channels; ++c) {
+            sum += (int16_t) read_le16(pcm + 2 * (i * channels + c));
+        }
+        mono[i] = (float) sum / channels;
+    }
+
+    if (rate == kSampleRate) {
+        out->resize(n_frames);
+        for (size_t i = 0; i < n_frames; ++i) {
+            (*out)[i] = (int16_t) mono[i];
+        }
+        return true;
+    }
+
+    const size_t n_out = (size_t) ((double) n_frames * kSampleRate / rate);
+    out->resize(n_out);
+    for (size_t i = 0; i < n_out; ++i) {
+        const double src = (double) i * rate / kSampleRate;
+        const size_t i0 = std::min((size_t) src, n_frames - 1);
+        const size_t i1 = std::min(i0 + 1, n_frames - 1);
+        const double frac = src - (double) i0;
+        (*out)[i] = (int16_t) (mono[i0] * (1.0 - frac) + mono[i1] * frac);
+    }
+    return true;
+}
+
+static bool load_corpus(const std::string& dir, std::vector<Utterance>* corpus) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) {
+            names.push_back(name.substr(0, name.size() - 4));
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string& name : names) {
+        Utterance utt;
+        utt.name = name;
+        if (!load_wav(dir + "/" + name + ".wav", &utt.samples)) {
+            fprintf(stderr, "skipping %s.wav: not 16-bit PCM\n", name.c_str());
+            continue;
+        }
+        std::ifstream ref(dir + "/" + name + ".txt");
+        if (ref) {
+            std::stringstream buffer;
+            buffer << ref.rdbuf();
+            utt.reference = buffer.str();
+            utt.has_reference = true;
+        }
+        corpus->push_back(std::move(utt));
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// WER
+
+static std::vector<std::string> normalize_words(const std::string& text) {
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : text) {
+        if (isalnum((unsigned char) c) || c == '\'') {
+            word.push_back((char) tolower((unsigned char) c));
+        } else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// Word-level Levenshtein distance
+static size_t word_errors(const std::vector<std::string>& ref, const std::vector<std::string>& hyp) {
+    std::vector<size_t> prev(hyp.size() + 1);
+    std::vector<size_t> cur(hyp.size() + 1);
+    for (size_t j = 0; j <= hyp.size(); ++j) {
+        prev[j] = j;
+    }
+    for (size_t i = 1; i <= ref.size(); ++i) {
+        cur[0] = i;
+        for (size_t j = 1; j <= hyp.size(); ++j) {
+            const size_t substitution = prev[j - 1] + (ref[i - 1] == hyp[j - 1] ? 0 : 1);
+            cur[j] = std::min({prev[j] + 1, cur[j - 1] + 1, substitution});
+        }
+        std::swap(prev, cur);
+    }
+    return prev[hyp.size()];
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+
+struct Capture {
+    std::mutex mutex;
+    std::string final_text;
+    std::string last_partial;
+    bool got_result = false;
+    Clock::time_point first_result;
+    Clock::time_point last_final;
+    float peak_resident_mb = 0.0f;             // sampled at each push and result
+};
+
+static void sample_resident(Capture* capture) {
+    const float resident = process_resident_mb();
+    std::lock_guard<std::mutex> lock(capture->mutex);
+    capture->peak_resident_mb = std::max(capture->peak_resident_mb, resident);
+}
+
+static void on_result(vb_transcription_result_t* result, void* user_data) {
+    Capture* capture = static_cast<Capture*>(user_data);
+    const Clock::time_point now = Clock::now();
+    const float resident = process_resident_mb();
+    std::lock_guard<std::mutex> lock(capture->mutex);
+    capture->peak_resident_mb = std::max(capture->peak_resident_mb, resident);
+    if (!capture->got_result) {
+        capture->first_result = now;
+        capture->got_result = true;
+    }
+    if (result->is_final) {
+        capture->final_text += result->text;
+        capture->last_partial.clear();
+        capture->last_final = now;
+    } else {
+        capture->last_partial = result->text;
+    }
+}
+
+static void on_error(vb_status_t status, const char* message, void*) {
+    fprintf(stderr, "engine error %s: %s\n", vb_engine_status_to_string(status), message);
+}
+
+struct FileResult {
+    std::string name;
+    double duration_ms = 0.0;
+    double wall_ms = 0.0;
+    double rtf = 0.0;
+    double first_result_ms = -1.0;             // feed start to first result
+    double final_latency_ms = -1.0;            // end of audio to last final
+    bool has_reference = false;
+    size_t errors = 0;
+    size_t ref_words = 0;
+    uint64_t dropped_samples = 0;
+    float peak_memory_mb = 0.0f;               // above the resident set before the model loaded
+    std::string hypothesis;
+    vb_engine_metrics_t metrics = {};
+};
+
+// baseline_mb is the resident set before the model was loaded; memory is
+// reported above it, since the process peak carries over between models
+static bool replay(vb_model_t* model, const Options& opts, const Utterance& utt, float baseline_mb,
+                   FileResult* out) {
+    const double duration_ms = (double) utt.samples.size() * 1000.0 / kSampleRate;
+
+    vb_engine_config_t config = {};
+    config.n_threads = opts.n_threads;
+    config.enable_partial_results = opts.streaming;
+    // As fast as possible pushes the whole file at once; size the ring for it
+    config.ring_buffer_ms = opts.realtime ? 0 : (int32_t) duration_ms + kRingSlackMs;
+
+    vb_engine_t* engine = vb_engine_create(&config, model);
+    if (!engine) {
+        return false;
+    }
+
+    Capture capture;
+    if (vb_engine_session_start(engine, on_result, on_error, &capture) != VB_STATUS_SUCCESS) {
+        vb_engine_destroy(engine);
+        return false;
+    }
+
+    const size_t chunk = (size_t) opts.chunk_ms * kSampleRate / 1000;
+    const Clock::time_point start = Clock::now();
+    for (size_t pos = 0; pos < utt.samples.size(); pos += chunk) {
+        vb_audio_buffer_i16_t buffer;
+        buffer.samples = utt.samples.data() + pos;
+        buffer.n_samples = (int32_t) std::min(chunk, utt.samples.size() - pos);
+        buffer.sample_rate = kSampleRate;
+        vb_engine_session_process_audio_i16(engine, &buffer);
+        sample_resident(&capture);
+
+        if (opts.realtime) {
+            const double due_ms = (double) (pos + buffer.n_samples) * 1000.0 / kSampleRate;
+            std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t) (due_ms * 1000.0)));
+        }
+    }
+    const Clock::time_point audio_end = Clock::now();
+    vb_engine_session_stop(engine);
+    const Clock::time_point end = Clock::now();
+    sample_resident(&capture);
+
+    vb_engine_session_get_metrics(engine, &out->metrics);
+    vb_engine_destroy(engine);
+
+    out->name = utt.name;
+    out->duration_ms = duration_ms;
+    out->wall_ms = ms_between(start, end);
+    out->rtf = duration_ms > 0.0 ? out->wall_ms / duration_ms : 0.0;
+    out->dropped_samples = out->metrics.dropped_samples;
+    out->peak_memory_mb = std::max(0.0f, capture.peak_resident_mb - baseline_mb);
+    out->hypothesis = capture.final_text;
+    if (capture.got_result) {
+        out->first_result_ms = ms_between(start, capture.first_result);
+    }
+    if (!capture.final_text.empty()) {
+        out->final_latency_ms = std::max(0.0, ms_between(audio_end, capture.last_final));
+    }
+
+    if (utt.has_reference) {
+        const std::vector<std::string> ref = normalize_words(utt.reference);
+        out->has_reference = true;
+        out->ref_words = ref.size();
+        out->errors = word_errors(ref, normalize_words(capture.final_text));
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// JSON output
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+static void write_summary(std::ostream& os, const vb_metric_summary_t& s) {
+    os << "{\"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99
+       << ", \"max\": " << s.max << ", \"count\": " << s.count << "}";
+}
+
+static vb_metric_summary_t summarize(const std::vector<double>& values) {
+    MetricWindow window(std::max<size_t>(values.size(), 1));
+    for (double v : values) {
+        window.add((float) v);
+    }
+    return window.summary();
+}
+
+struct ModelReport {
+    ManifestModel model;
+    std::string path;
+    bool loaded = false;
+    vb_backend_t backend = VB_BACKEND_CPU;
+    double load_ms = 0.0;
+    float memory_after_load_mb = 0.0f;         // resident set growth over the load
+    std::vector<FileResult> files;
+};
+
+static void write_report(std::ostream& os, const Options& opts, const std::vector<ModelReport>& reports) {
+    os << "{\n";
+    os << "  \"engine\": \"" << json_escape(vb_engine_get_version()) << "\",\n";
+    os << "  \"mode\": {\"realtime\": " << (opts.realtime ? "true" : "false")
+       << ", \"streaming\": " << (opts.streaming ? "true" : "false")
+       << ", \"gpu\": " << (opts.use_gpu ? "true" : "false")
+       << ", \"threads\": " << opts.n_threads << ", \"chunk_ms\": " << opts.chunk_ms << "},\n";
+    os << "  \"models\": [";
+
+    for (size_t m = 0; m < reports.size(); ++m) {
+        const ModelReport& report = reports[m];
+        os << (m ? ",\n" : "\n") << "    {\n";
+        os << "      \"name\": \"" << json_escape(report.model.name) << "\",\n";
+        os << "      \"file\": \"" << json_escape(report.model.filename) << "\",\n";
+        os << "      \"loaded\": " << (report.loaded ? "true" : "false") << ",\n";
+        os << "      \"backend\": \"" << vb_engine_backend_to_string(report.backend) << "\",\n";
+        os << "      \"load_ms\": " << report.load_ms << ",\n";
+        os << "      \"memory_after_load_mb\": " << report.memory_after_load_mb << ",\n";
+
+        std::vector<double> rtf;
+        std::vector<double> first_result;
+        std::vector<double> final_latency;
+        std::vector<double> encode_p50;
+        size_t errors = 0;
+        size_t ref_words = 0;
+        uint64_t dropped = 0;
+        float peak_memory = 0.0f;
+
+        os << "      \"files\": [";
+        for (size_t f = 0; f < report.files.size(); ++f) {
+            const FileResult& r = report.files[f];
+            rtf.push_back(r.rtf);
+            if (r.first_result_ms >= 0.0) {
+                first_result.push_back(r.first_result_ms);
+            }
+            if (r.final_latency_ms >= 0.0) {
+                final_latency.push_back(r.final_latency_ms);
+            }
+            if (r.metrics.encode_ms.count > 0) {
+                encode_p50.push_back(r.metrics.encode_ms.p50);
+            }
+            errors += r.errors;
+            ref_words += r.ref_words;
+            dropped += r.dropped_samples;
+            peak_memory = std::max(peak_memory, r.peak_memory_mb);
+
+            os << (f ? ",\n" : "\n") << "        {";
+            os << "\"name\": \"" << json_escape(r.name) << "\", ";
+            os << "\"duration_ms\": " << r.duration_ms << ", ";
+            os << "\"wall_ms\": " << r.wall_ms << ", ";
+            os << "\"rtf\": " << r.rtf << ", ";
+            os << "\"first_result_ms\": " << r.first_result_ms << ", ";
+            os << "\"final_latency_ms\": " << r.final_latency_ms << ", ";
+            if (r.has_reference) {
+                os << "\"wer\": " << (r.ref_words ? (double) r.errors / r.ref_words : 0.0) << ", ";
+                os << "\"errors\": " << r.errors << ", \"ref_words\": " << r.ref_words << ", ";
+            }
+            os << "\"dropped_samples\": " << r.dropped_samples << ", ";
+            os << "\"peak_memory_mb\": " << r.peak_memory_mb << ", ";
+            os << "\"passes\": " << r.metrics.n_passes << ", ";
+            os << "\"first_partial_latency_ms\": ";
+            write_summary(os, r.metrics.first_partial_latency_ms);
+            os << ", \"encode_ms\": ";
+            write_summary(os, r.metrics.encode_ms);
+            os << ", \"decode_ms\": ";
+            write_summary(os, r.metrics.decode_ms);
+            os << ", \"hypothesis\": \"" << json_escape(r.hypothesis) << "\"}";
+        }
+        os << (report.files.empty() ? "],\n" : "\n      ],\n");
+
+        os << "      \"summary\": {";
+        os << "\"wer\": " << (ref_words ? (double) errors / ref_words : 0.0) << ", ";
+        os << "\"errors\": " << errors << ", \"ref_words\": " << ref_words << ", ";
+        os << "\"rtf\": ";
+        write_summary(os, summarize(rtf));
+        os << ", \"first_result_ms\": ";
+        write_summary(os, summarize(first_result));
+        os << ", \"final_latency_ms\": ";
+        write_summary(os, summarize(final_latency));
+        os << ", \"encode_ms_p50\": ";
+        write_summary(os, summarize(encode_p50));
+        os << ", \"dropped_samples\": " << dropped;
+        os << ", \"peak_memory_mb\": " << peak_memory << "}\n";
+        os << "    }";
+    }
+    os << (reports.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_options(argc, argv, &opts)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<ManifestModel> models;
+    if (!load_manifest(opts.manifest_path, &models)) {
+        fprintf(stderr, "cannot read manifest %s\n", opts.manifest_path.c_str());
+        return 1;
+    }
+    if (!opts.model_names.empty()) {
+        models.erase(std::remove_if(models.begin(), models.end(), [&](const ManifestModel& m) {
+            return std::find(opts.model_names.begin(), opts.model_names.end(), m.name) == opts.model_names.end();
+        }), models.end());
+    }
+
+    std::vector<Utterance> corpus;
+    if (!load_corpus(opts.corpus_dir, &corpus) || corpus.empty()) {
+        fprintf(stderr, "no WAV files in %s\n", opts.corpus_dir.c_str());
+        return 1;
+    }
+
+    vb_engine_config_t init_config = {};
+    vb_engine_init(&init_config);
+
+    std::vector<ModelReport> reports;
+    for (const ManifestModel& entry : models) {
+        ModelReport report;
+        report.model = entry;
+        report.path = opts.models_dir + "/" + entry.filename;
+
+        const float baseline_mb = process_resident_mb();
+        const Clock::time_point load_start = Clock::now();
+        vb_model_t* model = vb_model_load(model_type_for_name(entry.name), report.path.c_str(), 1, opts.use_gpu);
+        report.load_ms = ms_between(load_start, Clock::now());
+        report.loaded = model != nullptr;
+        report.backend = vb_model_get_backend(model);
+        report.memory_after_load_mb = std::max(0.0f, process_resident_mb() - baseline_mb);
+
+        if (!model) {
+            fprintf(stderr, "cannot load %s\n", report.path.c_str());
+            reports.push_back(report);
+            continue;
+        }
+
+        for (const Utterance& utt : corpus) {
+            FileResult result;
+            if (replay(model, opts, utt, baseline_mb, &result)) {
+                fprintf(stderr, "%s %s: rtf %.3f\n", entry.name.c_str(), utt.name.c_str(), result.rtf);
+                report.files.push_back(result);
+            }
+        }
+
+        vb_model_release(model);
+        reports.push_back(report);
+    }
+
+    if (opts.output_path.empty()) {
+        std::ostringstream os;
+        write_report(os, opts, reports);
+        fputs(os.str().c_str(), stdout);
+    } else {
+        std::ofstream file(opts.output_path);
+        write_report(file, opts, reports);
+        if (!file) {
+            fprintf(stderr, "cannot write %s\n", opts.output_path.c_str());
+            return 1;
+        }
+    }
+
+    vb_engine_cleanup();
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "compute_backend.h"
+#include "model_loader.h"
+#include <cmath>
+#include <string>
+#include <sys/stat.h>
+
+static const int kProbeMelFrames = 3000;           // one 30s encoder window
+
+#if defined(WHISPER_USE_COREML)
+// Where whisper_init_state looks for the Core ML encoder: the model path
+// without its extension and quantization suffix ("-q5_1"), plus
+// "-encoder.mlmodelc"
+static std::string coreml_encoder_path(const char* model_path) {
+    std::string path = model_path;
+    const size_t dot = path.rfind('.');
+    if (dot != std::string::npos) {
+        path.erase(dot);
+    }
+    const size_t dash = path.rfind('-');
+    if (dash != std::string::npos && path.size() - dash == 5 && path[dash + 1] == 'q' && path[dash + 3] == '_') {
+        path.erase(dash);
+    }
+    return path + "-encoder.mlmodelc";
+}
+#endif
+
+bool backend_available(vb_backend_t backend, const char* model_path) {
+    switch (backend) {
+        case VB_BACKEND_CPU:
+            return true;
+        case VB_BACKEND_METAL:
+#if defined(GGML_USE_METAL)
+            return true;
+#else
+            return false;
+#endif
+        case VB_BACKEND_COREML: {
+#if defined(WHISPER_USE_COREML)
+            struct stat st;
+            return model_path && stat(coreml_encoder_path(model_path).c_str(), &st) == 0;
+#else
+            (void) model_path;
+            return false;
+#endif
+        }
+    }
+    return false;
+}
+
+std::vector<vb_backend_t> backend_candidates(const char* model_path) {
+    std::vector<vb_backend_t> backends;
+    for (vb_backend_t backend : {VB_BACKEND_COREML, VB_BACKEND_METAL}) {
+        if (backend_available(backend, model_path)) {
+            backends.push_back(backend);
+        }
+    }
+    return backends;
+}
+
+whisper_context* backend_init_context(const char* model_path, vb_backend_t backend) {
+    whisper_context_params params = whisper_context_default_params();
+    params.use_gpu = backend != VB_BACKEND_CPU;
+    if (backend == VB_BACKEND_COREML) {
+        return whisper_init_from_file_with_params_no_state(model_path, params);
+    }
+    return model_loader_init(model_path, params, false);
+}
+
+static bool all_finite(const float* values, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isfinite(values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool backend_probe(whisper_context* ctx, whisper_state* state, int n_threads) {
+    // The values only need to be in the range of a normalized log-mel
+    const int n_mels = whisper_model_n_mels(ctx);
+    std::vector<float> mel((size_t) n_mels * kProbeMelFrames);
+    for (size_t i = 0; i < mel.size(); ++i) {
+        mel[i] = (float) (i % 97) / 97.0f - 0.5f;
+    }
+    if (whisper_set_mel_with_state(ctx, state, mel.data(), kProbeMelFrames, n_mels) != 0 ||
+        whisper_encode_with_state(ctx, state, 0, n_threads) != 0) {
+        return false;
+    }
+
+    const whisper_token sot = whisper_token_sot(ctx);
+    if (whisper_decode_with_state(ctx, state, &sot, 1, 0, n_threads) != 0) {
+        return false;
+    }
+    return all_finite(whisper_get_logits_from_state(state), (size_t) whisper_n_vocab(ctx));
+}
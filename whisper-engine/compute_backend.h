@@ -0,0 +1,34 @@
+#ifndef COMPUTE_BACKEND_H
+#define COMPUTE_BACKEND_H
+
+#include "../shared/types.h"
+#include "whisper.h"
+#include <vector>
+
+// Backends a whisper.cpp v1.5.4 build can switch between at load time. Metal
+// (GGML_USE_METAL) runs the whole model on the GPU; Core ML
+// (WHISPER_USE_COREML) runs the encoder from a compiled model next to the
+// ggml file; whisper must be built with WHISPER_COREML_ALLOW_FALLBACK so that
+// contexts on the other backends still get states. Android builds run on the
+// CPU: v1.5.4 has no Vulkan backend, and its CLBlast offload applies to every
+// context with no CPU fallback.
+
+// Whether this build has backend and, for Core ML, model_path has its
+// compiled encoder
+bool backend_available(vb_backend_t backend, const char* model_path);
+
+// Accelerated backends available for model_path, fastest first; never CPU
+std::vector<vb_backend_t> backend_candidates(const char* model_path);
+
+// Weights only, on backend. Core ML finds its encoder through the model path,
+// which only whisper's own file loader records; the other backends load
+// through the mmap loader.
+whisper_context* backend_init_context(const char* model_path, vb_backend_t backend);
+
+// One encoder pass over a synthetic window and one decoder step on state. A
+// GPU that fails to set up its kernels or computes non-finite values fails
+// here instead of in the first dictation. The state's mel and decoder cache
+// are overwritten.
+bool backend_probe(whisper_context* ctx, whisper_state* state, int n_threads);
+
+#endif // COMPUTE_BACKEND_H
@@ -0,0 +1,196 @@
+#include "cpu_scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sched.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && !defined(HWCAP_ASIMDDP)
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+
+static const int kProbeIntervalPasses = 8;
+static const double kCostSmoothing = 0.3;
+static const double kPreferFewerThreshold = 1.05;  // fewer threads win unless >5% slower
+
+static std::atomic<int> g_thermal_state{VB_THERMAL_NOMINAL};
+
+#if defined(__linux__)
+static long read_max_freq_khz(int cpu) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    long khz = 0;
+    if (fscanf(f, "%ld", &khz) != 1) {
+        khz = 0;
+    }
+    fclose(f);
+    return khz;
+}
+#endif
+
+static CpuTopology detect_topology() {
+    CpuTopology topology;
+    const long n_cpus = std::max(1L, sysconf(_SC_NPROCESSORS_CONF));
+
+#if defined(__APPLE__)
+    // Core ids are not exposed; only the cluster sizes matter
+    int n_performance = 0;
+    size_t size = sizeof(n_performance);
+    if (sysctlbyname("hw.perflevel0.logicalcpu", &n_performance, &size, nullptr, 0) != 0 ||
+        n_performance <= 0 || n_performance > n_cpus) {
+        n_performance = (int) n_cpus;
+    }
+    for (int cpu = 0; cpu < n_cpus; ++cpu) {
+        (cpu < n_performance ? topology.performance_cores : topology.efficiency_cores).push_back(cpu);
+    }
+#elif defined(__linux__)
+    // The slowest cluster is the efficiency cluster; prime and big cores both count as fast
+    std::vector<long> freqs((size_t) n_cpus);
+    long min_freq = 0;
+    long max_freq = 0;
+    bool known = true;
+    for (int cpu = 0; cpu < n_cpus; ++cpu) {
+        freqs[cpu] = read_max_freq_khz(cpu);
+        if (freqs[cpu] <= 0) {
+            known = false;
+            break;
+        }
+        min_freq = cpu == 0 ? freqs[cpu] : std::min(min_freq, freqs[cpu]);
+        max_freq = std::max(max_freq, freqs[cpu]);
+    }
+    for (int cpu = 0; cpu < n_cpus; ++cpu) {
+        const bool efficiency = known && min_freq < max_freq && freqs[cpu] == min_freq;
+        (efficiency ? topology.efficiency_cores : topology.performance_cores).push_back(cpu);
+    }
+#else
+    for (int cpu = 0; cpu < n_cpus; ++cpu) {
+        topology.performance_cores.push_back(cpu);
+    }
+#endif
+
+    return topology;
+}
+
+const CpuTopology& cpu_topology() {
+    static const CpuTopology topology = detect_topology();
+    return topology;
+}
+
+bool cpu_has_int8_dot() {
+#if defined(__APPLE__) && defined(__aarch64__)
+    int dot = 0;
+    size_t size = sizeof(dot);
+    return sysctlbyname("hw.optional.arm.FEAT_DotProd", &dot, &size, nullptr, 0) == 0 && dot != 0;
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0;
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+bool pin_to_performance_cores() {
+#if defined(__APPLE__)
+    return pthread_set_qos_class_self_np(QOS_CLASS_USER_INITIATED, 0) == 0;
+#elif defined(__linux__)
+    const CpuTopology& topology = cpu_topology();
+    if (topology.efficiency_cores.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : topology.performance_cores) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+void set_thermal_state(vb_thermal_state_t state) {
+    g_thermal_state.store(state, std::memory_order_relaxed);
+}
+
+vb_thermal_state_t thermal_state() {
+    return (vb_thermal_state_t) g_thermal_state.load(std::memory_order_relaxed);
+}
+
+int thermal_thread_limit(int max_threads) {
+    switch (thermal_state()) {
+        case VB_THERMAL_FAIR: return std::max(1, max_threads - 1);
+        case VB_THERMAL_SERIOUS: return std::max(1, max_threads / 2);
+        case VB_THERMAL_CRITICAL: return 1;
+        default: return std::max(1, max_threads);
+    }
+}
+
+void ThreadTuner::reset(int max_threads) {
+    max_threads_ = std::max(1, max_threads);
+    current_ = max_threads_;
+    probe_ = 0;
+    probe_up_ = false;
+    passes_since_probe_ = 0;
+    cost_.assign((size_t) max_threads_ + 1, 0.0);
+}
+
+int ThreadTuner::threads() const {
+    const int n = probe_ > 0 ? probe_ : current_;
+    return std::min(n, thermal_thread_limit(max_threads_));
+}
+
+void ThreadTuner::record(int n_threads, double pass_ms, double audio_ms) {
+    if (n_threads < 1 || n_threads > max_threads_ || pass_ms <= 0.0 || audio_ms <= 0.0) {
+        return;
+    }
+
+    const double rtf = pass_ms / audio_ms;
+    double& cost = cost_[n_threads];
+    cost = cost == 0.0 ? rtf : cost + kCostSmoothing * (rtf - cost);
+
+    // A thermal cap pushed us below the current count; carry on from there
+    if (probe_ == 0 && n_threads < current_) {
+        current_ = n_threads;
+    }
+
+    if (probe_ > 0) {
+        const int lo = std::min(current_, probe_);
+        const int hi = std::max(current_, probe_);
+        if (cost_[lo] > 0.0 && cost_[hi] > 0.0) {
+            current_ = cost_[lo] <= cost_[hi] * kPreferFewerThreshold ? lo : hi;
+        }
+        probe_ = 0;
+        passes_since_probe_ = 0;
+        return;
+    }
+
+    if (++passes_since_probe_ < kProbeIntervalPasses) {
+        return;
+    }
+
+    // Alternate between trying one more and one fewer thread
+    const int limit = thermal_thread_limit(max_threads_);
+    probe_up_ = !probe_up_;
+    int candidate = current_ + (probe_up_ ? 1 : -1);
+    if (candidate < 1 || candidate > limit) {
+        candidate = current_ + (probe_up_ ? -1 : 1);
+    }
+    if (candidate >= 1 && candidate <= limit && candidate != current_) {
+        probe_ = candidate;
+    }
+    passes_since_probe_ = 0;
+}
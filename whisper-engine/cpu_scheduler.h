@@ -0,0 +1,55 @@
+#ifndef CPU_SCHEDULER_H
+#define CPU_SCHEDULER_H
+
+#include "../shared/types.h"
+#include <vector>
+
+// CPU clusters by maximum frequency. On symmetric or unknown systems every
+// core counts as a performance core and efficiency_cores is empty.
+struct CpuTopology {
+    std::vector<int> performance_cores;
+    std::vector<int> efficiency_cores;
+};
+
+// Detected once, on first use
+const CpuTopology& cpu_topology();
+
+// Whether the CPU has int8 dot-product instructions (ARMv8.2 SDOT, x86 AVX2),
+// which make ggml's q8_0 matrix products faster than the 5-bit ones
+bool cpu_has_int8_dot();
+
+// Restrict the calling thread to the performance cores. Threads it creates
+// afterwards (ggml's graph workers) inherit the mask. On Apple platforms,
+// where affinity is not available, the thread is raised to a QoS class the
+// scheduler places on performance cores. Best effort.
+bool pin_to_performance_cores();
+
+// Process-wide thermal pressure, set by the host
+void set_thermal_state(vb_thermal_state_t state);
+vb_thermal_state_t thermal_state();
+
+// Upper bound on decoder threads under the current thermal state
+int thermal_thread_limit(int max_threads);
+
+// Picks the decoder thread count from measured real-time factors (pass time
+// over the audio it decoded, so windows of different lengths compare). The
+// current count is periodically compared against a neighbouring one and the
+// faster wins;
+// when two counts are within a few percent the smaller one is kept to save
+// power. The result is always capped by thermal_thread_limit().
+class ThreadTuner {
+public:
+    void reset(int max_threads);
+    int threads() const;
+    void record(int n_threads, double pass_ms, double audio_ms);
+
+private:
+    std::vector<double> cost_;       // smoothed real-time factor per thread count, 0 = unmeasured
+    int max_threads_ = 1;
+    int current_ = 1;
+    int probe_ = 0;                  // count being tried on the next pass, 0 = none
+    bool probe_up_ = false;
+    int passes_since_probe_ = 0;
+};
+
+#endif // CPU_SCHEDULER_H
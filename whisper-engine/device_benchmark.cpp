@@ -0,0 +1,402 @@
+#include "device_benchmark.h"
+#include "compute_backend.h"
+#include "cpu_scheduler.h"
+#include "metrics.h"
+#include "whisper.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+static const int kBenchMelFrames = 3000;           // one 30s encoder window
+static const float kBenchWindowMs = 30000.0f;
+static const int kBenchDecodeSteps = 8;
+static const int kBenchTokensPerWindow = 100;      // ~30s of dictated English
+static const float kMaxRecommendedRtf = 0.15f;     // streaming re-decodes each window many times
+static const float kMaxModelMemoryShare = 0.25f;   // of physical memory
+static const size_t kHashSampleBytes = 64 * 1024;  // model file hashed at both ends plus its size
+static const char* kCacheHeader = "# voiceboard benchmark cache v2";
+
+// Storage per weight of each quantization (block bytes / 32 weights), indexed by vb_quantization_t
+static const float kQuantBitsPerWeight[VB_QUANT_COUNT] = {6.0f, 8.5f, 4.5f};
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static float physical_memory_mb() {
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return 0.0f;
+    }
+    return (float) ((double) pages * page_size / (1024.0 * 1024.0));
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t n) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static const uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+
+// Changes when the device, OS build or core count changes
+static uint64_t device_fingerprint() {
+    uint64_t hash = kFnvOffset;
+    struct utsname name;
+    if (uname(&name) == 0) {
+        hash = fnv1a(hash, name.sysname, strlen(name.sysname));
+        hash = fnv1a(hash, name.release, strlen(name.release));
+        hash = fnv1a(hash, name.machine, strlen(name.machine));
+    }
+    const uint32_t n_cpus = std::thread::hardware_concurrency();
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    hash = fnv1a(hash, &n_cpus, sizeof(n_cpus));
+    hash = fnv1a(hash, &pages, sizeof(pages));
+    return hash;
+}
+
+static bool model_fingerprint(const char* path, uint64_t* hash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    const uint64_t size = (uint64_t) file.tellg();
+
+    std::vector<char> buffer(kHashSampleBytes);
+    uint64_t h = fnv1a(kFnvOffset, &size, sizeof(size));
+
+    file.seekg(0);
+    file.read(buffer.data(), (std::streamsize) std::min<uint64_t>(size, kHashSampleBytes));
+    h = fnv1a(h, buffer.data(), (size_t) file.gcount());
+
+    if (size > kHashSampleBytes) {
+        file.clear();
+        file.seekg((std::streamoff) (size - kHashSampleBytes));
+        file.read(buffer.data(), (std::streamsize) kHashSampleBytes);
+        h = fnv1a(h, buffer.data(), (size_t) file.gcount());
+    }
+
+    *hash = h;
+    return true;
+}
+
+struct CacheEntry {
+    uint64_t device = 0;
+    uint64_t model = 0;
+    vb_model_benchmark_t result = {};
+};
+
+static std::vector<CacheEntry> load_cache(const char* path) {
+    std::vector<CacheEntry> entries;
+    if (!path) {
+        return entries;
+    }
+
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) {
+        return entries;
+    }
+
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        CacheEntry entry;
+        vb_model_benchmark_t& r = entry.result;
+        int backend = VB_BACKEND_CPU;
+        iss >> std::hex >> entry.device >> entry.model >> std::dec
+            >> r.real_time_factor >> r.best_n_threads >> r.encode_ms >> r.decode_token_ms >> r.memory_mb >> backend;
+        r.backend = (vb_backend_t) backend;
+        if (iss && r.real_time_factor > 0.0f) {
+            entries.push_back(entry);
+        }
+    }
+    return entries;
+}
+
+// Written to a temporary file first so a crash never leaves a torn cache
+static void save_cache(const char* path, const std::vector<CacheEntry>& entries) {
+    if (!path) {
+        return;
+    }
+
+    const std::string tmp_path = std::string(path) + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file << kCacheHeader << '\n';
+        for (const CacheEntry& entry : entries) {
+            const vb_model_benchmark_t& r = entry.result;
+            file << std::hex << entry.device << ' ' << entry.model << std::dec << ' '
+                 << r.real_time_factor << ' ' << r.best_n_threads << ' ' << r.encode_ms << ' '
+                 << r.decode_token_ms << ' ' << r.memory_mb << ' ' << (int) r.backend << '\n';
+        }
+        if (!file) {
+            return;
+        }
+    }
+    rename(tmp_path.c_str(), path);
+}
+
+static std::vector<int> candidate_thread_counts() {
+    const int n_cpus = std::max<int>(1, (int) std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for (int n : {1, 2, 4, 8}) {
+        if (n <= n_cpus) {
+            counts.push_back(n);
+        }
+    }
+    if (counts.back() != n_cpus) {
+        counts.push_back(n_cpus);
+    }
+    return counts;
+}
+
+// Log-mel-like noise; the encoder cost does not depend on the content
+static std::vector<float> synthetic_mel(int n_mel) {
+    std::vector<float> mel((size_t) n_mel * kBenchMelFrames);
+    uint32_t seed = 0x12345678u;
+    for (float& v : mel) {
+        seed = seed * 1664525u + 1013904223u;
+        v = (float) (seed >> 8) / (float) (1u << 24) - 0.5f;
+    }
+    return mel;
+}
+
+// Measure the model on one backend. *probe_failed is set when an accelerated
+// backend loaded but failed its probe.
+static bool benchmark_backend(const char* path, vb_backend_t backend, vb_model_benchmark_t* out,
+                              bool* probe_failed) {
+    const float rss_before = process_resident_mb();
+
+    whisper_context* ctx = backend_init_context(path, backend);
+    if (!ctx) {
+        return false;
+    }
+    whisper_state* state = whisper_init_state(ctx);
+    if (!state) {
+        whisper_free(ctx);
+        return false;
+    }
+
+    const std::vector<int> thread_counts = candidate_thread_counts();
+    const std::vector<float> mel = synthetic_mel(whisper_model_n_mels(ctx));
+    const whisper_token sot = whisper_token_sot(ctx);
+
+    // A backend that computes garbage is not worth timing
+    bool ok = backend == VB_BACKEND_CPU || backend_probe(ctx, state, thread_counts.back());
+    *probe_failed = !ok;
+
+    ok = ok && whisper_set_mel_with_state(ctx, state, mel.data(), kBenchMelFrames,
+                                          whisper_model_n_mels(ctx)) == 0;
+
+    // Warm-up pass: first-touch of the weights and compute buffers is not timed
+    ok = ok && whisper_encode_with_state(ctx, state, 0, thread_counts.back()) == 0;
+
+    vb_model_benchmark_t best = {};
+    best.backend = backend;
+    for (size_t i = 0; ok && i < thread_counts.size(); ++i) {
+        const int n_threads = thread_counts[i];
+
+        const double t0 = now_ms();
+        ok = whisper_encode_with_state(ctx, state, 0, n_threads) == 0;
+        const double t1 = now_ms();
+        for (int step = 0; ok && step < kBenchDecodeSteps; ++step) {
+            ok = whisper_decode_with_state(ctx, state, &sot, 1, step, n_threads) == 0;
+        }
+        const double t2 = now_ms();
+        if (!ok) {
+            break;
+        }
+
+        const float encode_ms = (float) (t1 - t0);
+        const float token_ms = (float) (t2 - t1) / kBenchDecodeSteps;
+        const float rtf = (encode_ms + kBenchTokensPerWindow * token_ms) / kBenchWindowMs;
+        if (best.real_time_factor == 0.0f || rtf < best.real_time_factor) {
+            best.real_time_factor = rtf;
+            best.best_n_threads = n_threads;
+            best.encode_ms = encode_ms;
+            best.decode_token_ms = token_ms;
+        }
+    }
+
+    best.memory_mb = std::max(0.0f, process_resident_mb() - rss_before);
+
+    whisper_free_state(state);
+    whisper_free(ctx);
+
+    if (!ok || best.real_time_factor == 0.0f) {
+        return false;
+    }
+    *out = best;
+    return true;
+}
+
+// Fastest of the CPU and the accelerated backends available for the model.
+// usable[backend] becomes 1 when an accelerated backend passed its probe and
+// -1 when it failed, unless another model already passed on it.
+static bool benchmark_model(const char* path, vb_model_benchmark_t* out, int* usable) {
+    std::vector<vb_backend_t> backends = backend_candidates(path);
+    backends.insert(backends.begin(), VB_BACKEND_CPU);
+
+    bool any = false;
+    for (vb_backend_t backend : backends) {
+        vb_model_benchmark_t result = {};
+        bool probe_failed = false;
+        const bool ok = benchmark_backend(path, backend, &result, &probe_failed);
+        if (backend != VB_BACKEND_CPU && (ok || probe_failed)) {
+            usable[backend] = ok || usable[backend] == 1 ? 1 : -1;
+        }
+        if (ok && (!any || result.real_time_factor < out->real_time_factor)) {
+            *out = result;
+            any = true;
+        }
+    }
+    return any;
+}
+
+vb_device_capabilities_t device_benchmark_defaults(void) {
+    vb_device_capabilities_t caps = {};
+    caps.memory_mb = physical_memory_mb();
+#if defined(WHISPER_USE_COREML)
+    caps.has_neural_engine = true;
+#endif
+#if defined(GGML_USE_METAL)
+    caps.has_gpu_acceleration = true;
+#endif
+    caps.recommended_n_threads = std::min<int>(4, std::max<int>(1, (int) std::thread::hardware_concurrency()));
+    caps.recommended_model = VB_MODEL_TINY_EN;
+    caps.peak_memory_mb = process_peak_resident_mb();
+    return caps;
+}
+
+vb_status_t device_benchmark_run(const char* const* model_paths, const char* cache_path,
+                                 vb_device_capabilities_t* caps) {
+    if (!model_paths || !caps) {
+        return VB_STATUS_ERROR;
+    }
+
+    *caps = device_benchmark_defaults();
+
+    const uint64_t device = device_fingerprint();
+    std::vector<CacheEntry> cache = load_cache(cache_path);
+    bool cache_dirty = false;
+    bool any_measured = false;
+    int usable[VB_BACKEND_COUNT] = {};              // see benchmark_model
+
+    for (int type = 0; type < VB_MODEL_TYPE_COUNT; ++type) {
+        uint64_t model = 0;
+        if (!model_paths[type] || !model_fingerprint(model_paths[type], &model)) {
+            continue;
+        }
+
+        auto cached = std::find_if(cache.begin(), cache.end(), [&](const CacheEntry& entry) {
+            return entry.device == device && entry.model == model;
+        });
+        if (cached != cache.end()) {
+            caps->models[type] = cached->result;
+            if (cached->result.backend != VB_BACKEND_CPU) {
+                usable[cached->result.backend] = 1;
+            }
+            any_measured = true;
+            continue;
+        }
+
+        CacheEntry entry;
+        entry.device = device;
+        entry.model = model;
+        if (!benchmark_model(model_paths[type], &entry.result, usable)) {
+            continue;
+        }
+        caps->models[type] = entry.result;
+        cache.push_back(entry);
+        cache_dirty = true;
+        any_measured = true;
+    }
+
+    if (cache_dirty) {
+        save_cache(cache_path, cache);
+    }
+
+    // Built-in backends stay reported until a probe shows they do not work
+    if (usable[VB_BACKEND_METAL] != 0) {
+        caps->has_gpu_acceleration = usable[VB_BACKEND_METAL] > 0;
+    }
+    if (usable[VB_BACKEND_COREML] != 0) {
+        caps->has_neural_engine = usable[VB_BACKEND_COREML] > 0;
+    }
+    caps->peak_memory_mb = process_peak_resident_mb();
+
+    if (!any_measured) {
+        return VB_STATUS_MODEL_NOT_LOADED;
+    }
+
+    const vb_model_benchmark_t& tiny = caps->models[VB_MODEL_TINY_EN];
+    if (tiny.real_time_factor > 0.0f) {
+        caps->cpu_score = 1.0f / tiny.real_time_factor;
+    }
+
+    // Largest model that keeps up with streaming and fits comfortably in memory
+    for (int type = 0; type < VB_MODEL_TYPE_COUNT; ++type) {
+        const vb_model_benchmark_t& r = caps->models[type];
+        if (r.real_time_factor <= 0.0f || r.real_time_factor > kMaxRecommendedRtf) {
+            continue;
+        }
+        if (caps->memory_mb > 0.0f && r.memory_mb > caps->memory_mb * kMaxModelMemoryShare) {
+            continue;
+        }
+        caps->recommended_model = (vb_model_type_t) type;
+        caps->recommended_n_threads = r.best_n_threads;
+    }
+
+    return VB_STATUS_SUCCESS;
+}
+
+vb_quantization_t device_benchmark_quantization(const vb_device_capabilities_t& caps, vb_model_type_t model_type,
+                                                int64_t model_bytes, int64_t budget_bytes) {
+    if ((int) model_type < 0 || (int) model_type >= VB_MODEL_TYPE_COUNT || model_bytes <= 0) {
+        return VB_QUANT_Q5_1;
+    }
+
+    const vb_model_benchmark_t& r = caps.models[model_type];
+    const float budget_mb = budget_bytes > 0 ? (float) ((double) budget_bytes / (1024.0 * 1024.0))
+                                             : caps.memory_mb * kMaxModelMemoryShare;
+    const float weights_mb = (float) ((double) model_bytes / (1024.0 * 1024.0));
+    // Decoder state and compute buffers do not shrink with the weights
+    const float overhead_mb = std::max(0.0f, r.memory_mb - weights_mb);
+    auto footprint_mb = [&](vb_quantization_t q) {
+        return overhead_mb + weights_mb * kQuantBitsPerWeight[q] / kQuantBitsPerWeight[VB_QUANT_Q5_1];
+    };
+
+    // q4_0 when q5_1 would not stay resident, or decodes too slowly to keep up
+    if (budget_mb > 0.0f && footprint_mb(VB_QUANT_Q5_1) > budget_mb) {
+        return VB_QUANT_Q4_0;
+    }
+    if (r.real_time_factor > kMaxRecommendedRtf) {
+        return VB_QUANT_Q4_0;
+    }
+
+    // q8_0 is faster with int8 dot products or on the GPU; converted from the
+    // q5_1 download it keeps q5_1 accuracy. It needs a measurement to know it fits
+    const bool fast_q8 = cpu_has_int8_dot() || r.backend != VB_BACKEND_CPU;
+    if (fast_q8 && r.memory_mb > 0.0f && (budget_mb <= 0.0f || footprint_mb(VB_QUANT_Q8_0) <= budget_mb)) {
+        return VB_QUANT_Q8_0;
+    }
+    return VB_QUANT_Q5_1;
+}
@@ -0,0 +1,27 @@
+#ifndef DEVICE_BENCHMARK_H
+#define DEVICE_BENCHMARK_H
+
+#include "../shared/types.h"
+
+// Time an encoder pass and a few decoder steps on synthetic input for every
+// model in model_paths (indexed by vb_model_type_t, NULL entries skipped) at
+// several thread counts, on the CPU and on every accelerated backend the
+// build and the model files offer. Each model keeps its fastest backend that
+// passed a probe. Results are cached in cache_path (may be NULL) keyed
+// by a device fingerprint and a hash of the model file, so a model is only
+// measured again when the file or the device changes.
+vb_status_t device_benchmark_run(const char* const* model_paths, const char* cache_path,
+                                 vb_device_capabilities_t* caps);
+
+// Hardware-only estimate used before any model has been measured
+vb_device_capabilities_t device_benchmark_defaults(void);
+
+// Quantization of model_type that fits budget_bytes of resident memory (0 =
+// the recommendation share of physical memory) and decodes fastest here.
+// model_bytes is the size of its q5_1 file; the measurement in caps, taken on
+// that file, gives what the model needs beyond its weights. Without one, only
+// the file size counts.
+vb_quantization_t device_benchmark_quantization(const vb_device_capabilities_t& caps, vb_model_type_t model_type,
+                                                int64_t model_bytes, int64_t budget_bytes);
+
+#endif // DEVICE_BENCHMARK_H
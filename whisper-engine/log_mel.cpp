@@ -0,0 +1,336 @@
+#include "log_mel.h"
+#include "whisper.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VB_MEL_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VB_MEL_SSE2 1
+#endif
+
+static const int kFftSize = WHISPER_N_FFT;
+static const int kFftBins = WHISPER_N_FFT / 2 + 1;
+static const int kHopSamples = WHISPER_HOP_LENGTH;
+static const int kCenterPad = WHISPER_N_FFT / 2;                      // frames are centered on their hop
+static const int kPaddingFrames = WHISPER_CHUNK_SIZE * WHISPER_SAMPLE_RATE / WHISPER_HOP_LENGTH;
+
+// The 400-point FFT is split by radix-2 into 16 interleaved 25-point DFTs
+static const int kLeaves = 16;
+static const int kLeafSize = kFftSize / kLeaves;
+
+// Cached energies keep a lower floor than whisper's 1e-10 so the decode gain
+// can be applied afterwards in the log domain
+static const float kCacheFloorLog = -20.0f;
+static const float kSilenceLog = -10.0f;
+static const float kDynamicRangeLog = 8.0f;
+
+// librosa's Slaney mel scale: linear below 1kHz, logarithmic above
+static double hz_to_mel(double hz) {
+    const double f_sp = 200.0 / 3.0;
+    const double log_step = std::log(6.4) / 27.0;
+    if (hz < 1000.0) {
+        return hz / f_sp;
+    }
+    return 1000.0 / f_sp + std::log(hz / 1000.0) / log_step;
+}
+
+static double mel_to_hz(double mel) {
+    const double f_sp = 200.0 / 3.0;
+    const double log_step = std::log(6.4) / 27.0;
+    const double min_log_mel = 1000.0 / f_sp;
+    if (mel < min_log_mel) {
+        return mel * f_sp;
+    }
+    return 1000.0 * std::exp(log_step * (mel - min_log_mel));
+}
+
+static int reverse_leaf_bits(int p) {
+    return ((p & 1) << 3) | ((p & 2) << 1) | ((p & 4) >> 1) | ((p & 8) >> 3);
+}
+
+void LogMelStream::init(int n_mels) {
+    if (n_mels != n_mels_) {
+        n_mels_ = n_mels;
+
+        hann_.resize(kFftSize);
+        cos_.resize(kFftSize);
+        sin_.resize(kFftSize);
+        for (int i = 0; i < kFftSize; ++i) {
+            const double phase = 2.0 * M_PI * i / kFftSize;
+            hann_[i] = (float) (0.5 * (1.0 - std::cos(phase)));
+            cos_[i] = (float) std::cos(phase);
+            sin_[i] = (float) std::sin(phase);
+        }
+
+        // Triangular filters between n_mels + 2 points evenly spaced in mel,
+        // area-normalized (librosa.filters.mel, as shipped in whisper models)
+        const double nyquist = WHISPER_SAMPLE_RATE / 2.0;
+        const double mel_max = hz_to_mel(nyquist);
+        std::vector<double> edges(n_mels + 2);
+        for (int i = 0; i < n_mels + 2; ++i) {
+            edges[i] = mel_to_hz(mel_max * i / (n_mels + 1));
+        }
+
+        filter_begin_.assign(n_mels, 0);
+        filter_size_.assign(n_mels, 0);
+        filter_offset_.assign(n_mels, 0);
+        filter_weights_.clear();
+        for (int m = 0; m < n_mels; ++m) {
+            const double norm = 2.0 / (edges[m + 2] - edges[m]);
+            filter_offset_[m] = (int) filter_weights_.size();
+            for (int k = 0; k < kFftBins; ++k) {
+                const double hz = (double) k * WHISPER_SAMPLE_RATE / kFftSize;
+                const double lower = (hz - edges[m]) / (edges[m + 1] - edges[m]);
+                const double upper = (edges[m + 2] - hz) / (edges[m + 2] - edges[m + 1]);
+                const double weight = std::max(0.0, std::min(lower, upper)) * norm;
+                if (weight <= 0.0) {
+                    continue;
+                }
+                if (filter_size_[m] == 0) {
+                    filter_begin_[m] = k;
+                }
+                filter_weights_.push_back((float) weight);
+                filter_size_[m] = k - filter_begin_[m] + 1;
+            }
+        }
+
+        input_.resize(kFftSize);
+        leaf_re_.resize(kFftSize);
+        leaf_im_.resize(kFftSize);
+        re_.resize(kFftSize);
+        im_.resize(kFftSize);
+        power_.resize(kFftBins);
+
+        frames_.clear();
+        capacity_ = 0;
+    }
+    reset();
+}
+
+void LogMelStream::reset() {
+    head_ = 0;
+    n_frames_ = 0;
+    n_stable_ = 0;
+    head_dirty_ = false;
+    n_seen_ = 0;
+}
+
+void LogMelStream::drop_front(size_t n_samples) {
+    if (n_samples == 0) {
+        return;
+    }
+    if (n_samples % kHopSamples != 0 || n_samples > n_seen_) {
+        reset();
+        return;
+    }
+
+    const size_t shift = n_samples / kHopSamples;
+    n_seen_ -= n_samples;
+    if (shift >= n_stable_) {
+        n_frames_ = 0;
+        n_stable_ = 0;
+        head_ = 0;
+        return;
+    }
+    head_ = (head_ + shift) % capacity_;
+    n_frames_ -= shift;
+    n_stable_ -= shift;
+    // Frames within half an FFT of the new start saw the dropped audio where
+    // whisper reflects the window start instead
+    head_dirty_ = true;
+}
+
+void LogMelStream::reserve(size_t n_frames) {
+    reserve_frames(n_frames);
+    mel_.reserve((size_t) n_mels_ * (n_frames + kPaddingFrames));
+}
+
+void LogMelStream::reserve_frames(size_t n_frames) {
+    if (n_frames <= capacity_) {
+        return;
+    }
+
+    const size_t capacity = std::max<size_t>({n_frames, capacity_ * 2, 256});
+    std::vector<float> grown(capacity * n_mels_);
+    for (size_t i = 0; i < n_frames_; ++i) {
+        std::copy(frame(i), frame(i) + n_mels_, &grown[i * n_mels_]);
+    }
+    frames_.swap(grown);
+    capacity_ = capacity;
+    head_ = 0;
+}
+
+// |X[k]|^2 for k <= N/2 of the FFT of input_. Decimation in time: the leaves
+// are 25-point DFTs of the samples with index = r (mod 16), computed for all
+// 16 residues at once with the residues in SIMD lanes, then four radix-2
+// stages combine them in place.
+void LogMelStream::power_spectrum() {
+    for (int k = 0; k < kLeafSize; ++k) {
+        float* acc_re = &leaf_re_[k * kLeaves];
+        float* acc_im = &leaf_im_[k * kLeaves];
+#if defined(VB_MEL_NEON)
+        float32x4_t vre[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+        float32x4_t vim[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+        for (int m = 0; m < kLeafSize; ++m) {
+            const int w = ((k * m) % kLeafSize) * kLeaves;
+            const float* row = &input_[m * kLeaves];
+            for (int g = 0; g < 4; ++g) {
+                const float32x4_t x = vld1q_f32(row + 4 * g);
+                vre[g] = vmlaq_n_f32(vre[g], x, cos_[w]);
+                vim[g] = vmlsq_n_f32(vim[g], x, sin_[w]);
+            }
+        }
+        for (int g = 0; g < 4; ++g) {
+            vst1q_f32(acc_re + 4 * g, vre[g]);
+            vst1q_f32(acc_im + 4 * g, vim[g]);
+        }
+#elif defined(VB_MEL_SSE2)
+        __m128 vre[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        __m128 vim[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+        for (int m = 0; m < kLeafSize; ++m) {
+            const int w = ((k * m) % kLeafSize) * kLeaves;
+            const __m128 c = _mm_set1_ps(cos_[w]);
+            const __m128 s = _mm_set1_ps(sin_[w]);
+            const float* row = &input_[m * kLeaves];
+            for (int g = 0; g < 4; ++g) {
+                const __m128 x = _mm_loadu_ps(row + 4 * g);
+                vre[g] = _mm_add_ps(vre[g], _mm_mul_ps(x, c));
+                vim[g] = _mm_sub_ps(vim[g], _mm_mul_ps(x, s));
+            }
+        }
+        for (int g = 0; g < 4; ++g) {
+            _mm_storeu_ps(acc_re + 4 * g, vre[g]);
+            _mm_storeu_ps(acc_im + 4 * g, vim[g]);
+        }
+#else
+        std::fill(acc_re, acc_re + kLeaves, 0.0f);
+        std::fill(acc_im, acc_im + kLeaves, 0.0f);
+        for (int m = 0; m < kLeafSize; ++m) {
+            const int w = ((k * m) % kLeafSize) * kLeaves;
+            const float* row = &input_[m * kLeaves];
+            for (int r = 0; r < kLeaves; ++r) {
+                acc_re[r] += row[r] * cos_[w];
+                acc_im[r] -= row[r] * sin_[w];
+            }
+        }
+#endif
+    }
+
+    // Leaf block p holds residue reverse(p), so sibling blocks are adjacent
+    for (int p = 0; p < kLeaves; ++p) {
+        const int r = reverse_leaf_bits(p);
+        for (int k = 0; k < kLeafSize; ++k) {
+            re_[p * kLeafSize + k] = leaf_re_[k * kLeaves + r];
+            im_[p * kLeafSize + k] = leaf_im_[k * kLeaves + r];
+        }
+    }
+
+    for (int half = kLeafSize; half < kFftSize; half *= 2) {
+        const int stride = kFftSize / (2 * half);
+        for (int base = 0; base < kFftSize; base += 2 * half) {
+            float* even_re = &re_[base];
+            float* even_im = &im_[base];
+            float* odd_re = &re_[base + half];
+            float* odd_im = &im_[base + half];
+            for (int k = 0; k < half; ++k) {
+                const float wr = cos_[k * stride];
+                const float wi = -sin_[k * stride];
+                const float tr = odd_re[k] * wr - odd_im[k] * wi;
+                const float ti = odd_re[k] * wi + odd_im[k] * wr;
+                odd_re[k] = even_re[k] - tr;
+                odd_im[k] = even_im[k] - ti;
+                even_re[k] += tr;
+                even_im[k] += ti;
+            }
+        }
+    }
+
+    for (int k = 0; k < kFftBins; ++k) {
+        power_[k] = re_[k] * re_[k] + im_[k] * im_[k];
+    }
+}
+
+// Frame i covers samples [i * hop - N/2, i * hop + N/2); whisper reflects the
+// window start and zero-pads the end
+void LogMelStream::compute_frame(const float* samples, size_t n_samples, size_t i) {
+    const int64_t start = (int64_t) i * kHopSamples - kCenterPad;
+    for (int t = 0; t < kFftSize; ++t) {
+        int64_t s = start + t;
+        if (s < 0) {
+            s = -s;
+        }
+        input_[t] = s < (int64_t) n_samples ? samples[s] * hann_[t] : 0.0f;
+    }
+
+    power_spectrum();
+
+    float* out = frame(i);
+    for (int m = 0; m < n_mels_; ++m) {
+        const float* weights = &filter_weights_[filter_offset_[m]];
+        const float* power = &power_[filter_begin_[m]];
+        float sum = 0.0f;
+        for (int k = 0; k < filter_size_[m]; ++k) {
+            sum += power[k] * weights[k];
+        }
+        out[m] = sum > 0.0f ? std::max(std::log10(sum), kCacheFloorLog) : kCacheFloorLog;
+    }
+}
+
+const float* LogMelStream::compute(const float* samples, size_t n_samples, float gain,
+                                   int* n_len, int* n_audio_frames) {
+    if (n_samples < n_seen_) {
+        reset();
+    }
+    n_seen_ = n_samples;
+
+    // Frames reaching into the audio, and those of them that will not change
+    // as more arrives
+    const size_t n_frames = (n_samples + kCenterPad + kHopSamples - 1) / kHopSamples;
+    const size_t n_stable = n_samples > (size_t) kCenterPad
+        ? std::min(n_frames, (n_samples - kCenterPad - 1) / kHopSamples + 1) : 0;
+
+    reserve_frames(n_frames);
+
+    size_t first = std::min(n_stable_, n_frames);
+    if (head_dirty_) {
+        const size_t n_reflected = (kCenterPad + kHopSamples - 1) / kHopSamples;
+        for (size_t i = 0; i < std::min(first, n_reflected); ++i) {
+            compute_frame(samples, n_samples, i);
+        }
+        head_dirty_ = false;
+    }
+    for (size_t i = first; i < n_frames; ++i) {
+        compute_frame(samples, n_samples, i);
+    }
+    n_frames_ = n_frames;
+    n_stable_ = n_stable;
+
+    // whisper_pcm_to_mel: 30s of silence appended, energies floored at 1e-10,
+    // clamped to 8 orders of magnitude below the loudest value, then scaled
+    const int length = (int) (n_samples / kHopSamples) + kPaddingFrames;
+    const float gain_log = gain > 0.0f ? 2.0f * std::log10(gain) : 0.0f;
+    mel_.resize((size_t) n_mels_ * length);
+
+    float peak = kSilenceLog;
+    for (int i = 0; i < length; ++i) {
+        const float* values = (size_t) i < n_frames_ ? frame(i) : nullptr;
+        for (int m = 0; m < n_mels_; ++m) {
+            const float v = values ? std::max(values[m] + gain_log, kSilenceLog) : kSilenceLog;
+            mel_[(size_t) m * length + i] = v;
+            peak = std::max(peak, v);
+        }
+    }
+
+    const float floor = peak - kDynamicRangeLog;
+    for (float& v : mel_) {
+        v = (std::max(v, floor) + 4.0f) / 4.0f;
+    }
+
+    *n_len = length;
+    *n_audio_frames = n_samples >= (size_t) kCenterPad
+        ? 1 + (int) ((n_samples - kCenterPad) / kHopSamples) : 0;
+    return mel_.data();
+}
@@ -0,0 +1,75 @@
+#ifndef LOG_MEL_H
+#define LOG_MEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-mel spectrogram of a sliding window of 16kHz audio, computed the way
+// whisper_pcm_to_mel does it (400-point FFT of Hann-windowed frames every
+// 160 samples, Slaney mel filters) but kept across decodes. Frames are cached
+// as the window grows and shift with it when its head is dropped, so an
+// overlapping re-decode only transforms the frames that cover new audio.
+class LogMelStream {
+public:
+    // Builds the filter bank for n_mels bands (whisper_model_n_mels) and
+    // clears the cache
+    void init(int n_mels);
+    int n_mels() const { return n_mels_; }
+
+    // The window was emptied or replaced
+    void reset();
+
+    // Allocate the cache and the result for windows of up to n_frames frames,
+    // so compute does not grow them while decoding
+    void reserve(size_t n_frames);
+
+    // The first n_samples of the window were dropped. Cached frames are kept
+    // when n_samples is a whole number of hops, otherwise the cache is cleared.
+    void drop_front(size_t n_samples);
+
+    // Brings the cache up to date with the window samples[0, n_samples) and
+    // returns its normalized spectrogram for whisper_set_mel_with_state:
+    // band-major, *n_len frames per band including the 30s of silence whisper
+    // appends. Samples seen by earlier calls must not have changed. gain is the
+    // level normalization of the decode. *n_audio_frames gets the frames that
+    // cover audio, as whisper counts them.
+    const float* compute(const float* samples, size_t n_samples, float gain,
+                         int* n_len, int* n_audio_frames);
+
+private:
+    float* frame(size_t i) { return &frames_[((head_ + i) % capacity_) * n_mels_]; }
+    void reserve_frames(size_t n_frames);
+    void compute_frame(const float* samples, size_t n_samples, size_t i);
+    void power_spectrum();
+
+    int n_mels_ = 0;
+    std::vector<float> hann_;
+    std::vector<float> cos_;                     // cos(2 pi k / N), k < N
+    std::vector<float> sin_;
+    std::vector<int> filter_begin_;              // first FFT bin of each band
+    std::vector<int> filter_size_;
+    std::vector<int> filter_offset_;             // into filter_weights_
+    std::vector<float> filter_weights_;
+
+    // Ring of cached frames, n_mels_ log10 energies each, before normalization
+    std::vector<float> frames_;
+    size_t capacity_ = 0;
+    size_t head_ = 0;
+    size_t n_frames_ = 0;
+    size_t n_stable_ = 0;                        // leading frames whose samples have all arrived
+    bool head_dirty_ = false;                    // the first frames reflect the window start and need redoing
+    size_t n_seen_ = 0;                          // window length at the last compute
+
+    // Per-frame scratch
+    std::vector<float> input_;
+    std::vector<float> leaf_re_;
+    std::vector<float> leaf_im_;
+    std::vector<float> re_;
+    std::vector<float> im_;
+    std::vector<float> power_;
+
+    std::vector<float> mel_;                     // last compute result
+};
+
+#endif // LOG_MEL_H
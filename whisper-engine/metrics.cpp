@@ -0,0 +1,161 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+static const size_t kMetricWindowSize = 256;
+
+MetricWindow::MetricWindow(size_t capacity) : values_(capacity, 0.0f) {}
+
+void MetricWindow::reset() {
+    next_ = 0;
+    count_ = 0;
+}
+
+void MetricWindow::add(float value) {
+    values_[next_] = value;
+    next_ = (next_ + 1) % values_.size();
+    count_ = std::min(count_ + 1, values_.size());
+}
+
+static float percentile(std::vector<float>& sorted, float p) {
+    const size_t rank = (size_t) (p * (float) (sorted.size() - 1) + 0.5f);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+vb_metric_summary_t MetricWindow::summary() const {
+    vb_metric_summary_t summary = {};
+    summary.count = (int32_t) count_;
+    if (count_ == 0) {
+        return summary;
+    }
+
+    std::vector<float> sorted(values_.begin(), values_.begin() + count_);
+    std::sort(sorted.begin(), sorted.end());
+    summary.p50 = percentile(sorted, 0.50f);
+    summary.p90 = percentile(sorted, 0.90f);
+    summary.p99 = percentile(sorted, 0.99f);
+    summary.max = sorted.back();
+    return summary;
+}
+
+EngineMetrics::EngineMetrics()
+    : queue_depth_ms_(kMetricWindowSize),
+      queue_lag_ms_(kMetricWindowSize),
+      first_partial_ms_(kMetricWindowSize),
+      mel_ms_(kMetricWindowSize),
+      encode_ms_(kMetricWindowSize),
+      decode_ms_(kMetricWindowSize),
+      tokens_per_second_(kMetricWindowSize),
+      real_time_factor_(kMetricWindowSize),
+      draft_acceptance_(kMetricWindowSize) {}
+
+void EngineMetrics::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_depth_ms_.reset();
+    queue_lag_ms_.reset();
+    first_partial_ms_.reset();
+    mel_ms_.reset();
+    encode_ms_.reset();
+    decode_ms_.reset();
+    tokens_per_second_.reset();
+    real_time_factor_.reset();
+    draft_acceptance_.reset();
+    n_passes_ = 0;
+    n_overloads_ = 0;
+}
+
+void EngineMetrics::record_queue_depth(double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_depth_ms_.add((float) ms);
+}
+
+void EngineMetrics::record_queue_lag(double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_lag_ms_.add((float) ms);
+}
+
+void EngineMetrics::record_overload() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++n_overloads_;
+}
+
+void EngineMetrics::record_first_partial(double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    first_partial_ms_.add((float) std::max(0.0, ms));
+}
+
+void EngineMetrics::record_pass(const PassTiming& pass) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    mel_ms_.add((float) pass.mel_ms);
+    encode_ms_.add((float) pass.encode_ms);
+    decode_ms_.add((float) pass.decode_ms);
+    if (pass.decode_ms > 0.0) {
+        tokens_per_second_.add((float) (pass.n_tokens * 1000.0 / pass.decode_ms));
+    }
+    if (pass.audio_ms > 0.0) {
+        real_time_factor_.add((float) (pass.total_ms / pass.audio_ms));
+    }
+    if (pass.n_drafted > 0) {
+        draft_acceptance_.add((float) pass.n_accepted / (float) pass.n_drafted);
+    }
+    ++n_passes_;
+}
+
+void EngineMetrics::snapshot(uint64_t dropped_samples, vb_engine_metrics_t* out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out->queue_depth_ms = queue_depth_ms_.summary();
+    out->queue_lag_ms = queue_lag_ms_.summary();
+    out->first_partial_latency_ms = first_partial_ms_.summary();
+    out->mel_ms = mel_ms_.summary();
+    out->encode_ms = encode_ms_.summary();
+    out->decode_ms = decode_ms_.summary();
+    out->tokens_per_second = tokens_per_second_.summary();
+    out->real_time_factor = real_time_factor_.summary();
+    out->draft_acceptance = draft_acceptance_.summary();
+    out->peak_memory_mb = process_peak_resident_mb();
+    out->dropped_samples = dropped_samples;
+    out->n_passes = n_passes_;
+    out->n_overloads = n_overloads_;
+}
+
+float process_resident_mb() {
+#if defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) {
+        return 0.0f;
+    }
+    return (float) (info.resident_size / (1024.0 * 1024.0));
+#else
+    long total = 0;
+    long resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return 0.0f;
+    }
+    const int n = fscanf(f, "%ld %ld", &total, &resident);
+    fclose(f);
+    if (n != 2) {
+        return 0.0f;
+    }
+    return (float) ((double) resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0));
+#endif
+}
+
+float process_peak_resident_mb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0f;
+    }
+#if defined(__APPLE__)
+    return (float) (usage.ru_maxrss / (1024.0 * 1024.0));  // bytes
+#else
+    return (float) (usage.ru_maxrss / 1024.0);             // kilobytes
+#endif
+}
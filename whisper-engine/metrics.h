@@ -0,0 +1,73 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../shared/types.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Fixed-size window of the most recent samples of one metric
+class MetricWindow {
+public:
+    explicit MetricWindow(size_t capacity);
+    void reset();
+    void add(float value);
+    vb_metric_summary_t summary() const;
+
+private:
+    std::vector<float> values_;
+    size_t next_ = 0;
+    size_t count_ = 0;
+};
+
+// Stage timings of one whisper_full or speculative decoding pass
+struct PassTiming {
+    double total_ms = 0.0;
+    double mel_ms = 0.0;
+    double encode_ms = 0.0;      // includes the first decoder step
+    double decode_ms = 0.0;
+    int n_tokens = 0;
+    double audio_ms = 0.0;       // unpadded audio decoded by the pass
+    int n_drafted = 0;           // speculative passes: tokens proposed by the draft model
+    int n_accepted = 0;
+};
+
+// Metrics of one session. Written by the processing thread, read from any thread.
+class EngineMetrics {
+public:
+    EngineMetrics();
+    void reset();
+
+    void record_queue_depth(double ms);
+    void record_queue_lag(double ms);
+    void record_overload();
+    void record_first_partial(double ms);
+    void record_pass(const PassTiming& pass);
+
+    // dropped_samples is owned by the capture path and passed in
+    void snapshot(uint64_t dropped_samples, vb_engine_metrics_t* out) const;
+
+private:
+    mutable std::mutex mutex_;
+    MetricWindow queue_depth_ms_;
+    MetricWindow queue_lag_ms_;
+    MetricWindow first_partial_ms_;
+    MetricWindow mel_ms_;
+    MetricWindow encode_ms_;
+    MetricWindow decode_ms_;
+    MetricWindow tokens_per_second_;
+    MetricWindow real_time_factor_;
+    MetricWindow draft_acceptance_;
+    uint64_t n_passes_ = 0;
+    uint64_t n_overloads_ = 0;
+};
+
+// Current resident set of the process in MB, 0 when unavailable
+float process_resident_mb();
+
+// Peak resident set of the process in MB, 0 when unavailable. A high-water
+// mark over the process lifetime; diff process_resident_mb to attribute memory.
+float process_peak_resident_mb();
+
+#endif // METRICS_H
@@ -0,0 +1,116 @@
+#include "model_loader.h"
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t kReleaseChunkBytes = 4 * 1024 * 1024;  // drop consumed pages in 4MB steps
+
+// Read cursor over a mapped model file; owns the mapping until close()
+struct MappedModelFile {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    size_t released = 0;                         // prefix already returned to the kernel
+    size_t page_size = 4096;
+};
+
+static bool map_file(const char* path, MappedModelFile* file) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    
+    void* addr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    
+    file->data = static_cast<uint8_t*>(addr);
+    file->size = (size_t) st.st_size;
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size > 0) {
+        file->page_size = (size_t) page_size;
+    }
+    
+    // Tensors are read front to back exactly once
+    madvise(file->data, file->size, MADV_SEQUENTIAL);
+    return true;
+}
+
+// Hand consumed whole pages back; the data stays in the page cache
+static void release_consumed(MappedModelFile* file, bool all) {
+    size_t end;
+    if (all) {
+        end = (file->size + file->page_size - 1) / file->page_size * file->page_size;
+    } else {
+        end = file->pos - file->pos % file->page_size;
+        if (end - file->released < kReleaseChunkBytes) {
+            return;
+        }
+    }
+    if (end > file->released) {
+        madvise(file->data + file->released, end - file->released, MADV_DONTNEED);
+        file->released = end;
+    }
+}
+
+static size_t mapped_read(void* ctx, void* output, size_t read_size) {
+    MappedModelFile* file = static_cast<MappedModelFile*>(ctx);
+    const size_t n = read_size < file->size - file->pos ? read_size : file->size - file->pos;
+    memcpy(output, file->data + file->pos, n);
+    file->pos += n;
+    release_consumed(file, false);
+    return n;
+}
+
+static bool mapped_eof(void* ctx) {
+    const MappedModelFile* file = static_cast<const MappedModelFile*>(ctx);
+    return file->pos >= file->size;
+}
+
+static void mapped_close(void* ctx) {
+    MappedModelFile* file = static_cast<MappedModelFile*>(ctx);
+    if (file->data) {
+        release_consumed(file, true);
+        munmap(file->data, file->size);
+        file->data = nullptr;
+    }
+}
+
+whisper_context* model_loader_init(const char* path, whisper_context_params params,
+                                   bool with_default_state) {
+    if (!path) {
+        return nullptr;
+    }
+    
+    MappedModelFile file;
+    if (!map_file(path, &file)) {
+        return with_default_state
+            ? whisper_init_from_file_with_params(path, params)
+            : whisper_init_from_file_with_params_no_state(path, params);
+    }
+    
+    whisper_model_loader loader = {};
+    loader.context = &file;
+    loader.read = mapped_read;
+    loader.eof = mapped_eof;
+    loader.close = mapped_close;
+    
+    // whisper closes the loader on success and failure alike
+    whisper_context* ctx = with_default_state
+        ? whisper_init_with_params(&loader, params)
+        : whisper_init_with_params_no_state(&loader, params);
+    mapped_close(&file);
+    return ctx;
+}
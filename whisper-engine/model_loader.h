@@ -0,0 +1,16 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "whisper.h"
+
+// Load a ggml model through a read-only mmap of the file instead of buffered
+// stream reads. Pages are faulted in with sequential readahead and dropped
+// once their bytes are consumed, which avoids the stream's read buffers and a
+// second copy of the file in the process while loading. whisper.cpp still
+// copies every tensor into its own heap buffers, so the loaded weights cost
+// the same resident memory as before and are not shared between processes.
+// Falls back to whisper's own file loader when the file cannot be mapped.
+whisper_context* model_loader_init(const char* path, whisper_context_params params,
+                                   bool with_default_state);
+
+#endif // MODEL_LOADER_H
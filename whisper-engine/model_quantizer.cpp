@@ -0,0 +1,266 @@
+#include "model_quantizer.h"
+#include "ggml.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static const uint32_t kGgmlMagic = 0x67676d6c;      // "ggml"
+static const int kHparamCount = 11;                 // ftype is the last one
+static const int kMaxDims = 4;
+static const int32_t kMaxNameBytes = 256;
+static const size_t kChunkElements = 1 << 20;       // converted per pass; 4MB of floats
+static const char* kPartSuffix = ".part";
+
+// Matrices whisper.cpp's quantize tool leaves alone; the loader expects them
+// at their original types
+static const char* kKeepTypeTensors[] = {
+    "encoder.conv1.bias",
+    "encoder.conv2.bias",
+    "encoder.positional_embedding",
+    "decoder.positional_embedding",
+};
+
+static ggml_ftype quantization_ftype(vb_quantization_t quantization) {
+    switch (quantization) {
+        case VB_QUANT_Q5_1:
+            return GGML_FTYPE_MOSTLY_Q5_1;
+        case VB_QUANT_Q8_0:
+            return GGML_FTYPE_MOSTLY_Q8_0;
+        case VB_QUANT_Q4_0:
+            return GGML_FTYPE_MOSTLY_Q4_0;
+    }
+    return GGML_FTYPE_UNKNOWN;
+}
+
+// Type of the weight matrices of a file with this (version-stripped) ftype;
+// false for types this tool does not handle
+static bool weight_type(int32_t ftype, ggml_type* type) {
+    switch (ftype) {
+        case GGML_FTYPE_ALL_F32:
+            *type = GGML_TYPE_F32;
+            return true;
+        case GGML_FTYPE_MOSTLY_F16:
+            *type = GGML_TYPE_F16;
+            return true;
+        case GGML_FTYPE_MOSTLY_Q4_0:
+            *type = GGML_TYPE_Q4_0;
+            return true;
+        case GGML_FTYPE_MOSTLY_Q4_1:
+            *type = GGML_TYPE_Q4_1;
+            return true;
+        case GGML_FTYPE_MOSTLY_Q5_0:
+            *type = GGML_TYPE_Q5_0;
+            return true;
+        case GGML_FTYPE_MOSTLY_Q5_1:
+            *type = GGML_TYPE_Q5_1;
+            return true;
+        case GGML_FTYPE_MOSTLY_Q8_0:
+            *type = GGML_TYPE_Q8_0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool read_exact(FILE* f, void* data, size_t n) {
+    return fread(data, 1, n, f) == n;
+}
+
+static bool write_exact(FILE* f, const void* data, size_t n) {
+    return fwrite(data, 1, n, f) == n;
+}
+
+// Copy n bytes from src to dst through buffer
+static bool copy_bytes(FILE* src, FILE* dst, size_t n, std::vector<uint8_t>& buffer) {
+    while (n > 0) {
+        const size_t take = std::min(n, buffer.size());
+        if (!read_exact(src, buffer.data(), take) || !write_exact(dst, buffer.data(), take)) {
+            return false;
+        }
+        n -= take;
+    }
+    return true;
+}
+
+static bool keeps_type(const std::string& name) {
+    for (const char* keep : kKeepTypeTensors) {
+        if (name == keep) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Convert one tensor of n_rows rows of row_elements values from src_type to
+// dst_type, a whole number of rows per pass
+static bool convert_tensor(FILE* src, FILE* dst, ggml_type src_type, ggml_type dst_type, int64_t row_elements,
+                           int64_t n_rows, std::vector<uint8_t>& in, std::vector<float>& values,
+                           std::vector<uint8_t>& out) {
+    const size_t src_row_bytes = (size_t) row_elements / ggml_blck_size(src_type) * ggml_type_size(src_type);
+    const int64_t rows_per_pass = std::max<int64_t>(1, (int64_t) kChunkElements / row_elements);
+    const ggml_type_traits_t traits = ggml_internal_get_type_traits(src_type);
+    if (src_type != GGML_TYPE_F32 && !traits.to_float) {
+        return false;
+    }
+
+    int64_t hist[16] = {};
+    for (int64_t row = 0; row < n_rows; row += rows_per_pass) {
+        const int64_t rows = std::min(rows_per_pass, n_rows - row);
+        const size_t n_values = (size_t) (rows * row_elements);
+        in.resize((size_t) rows * src_row_bytes);
+        values.resize(n_values);
+        out.resize(n_values / ggml_blck_size(dst_type) * ggml_type_size(dst_type));
+        if (!read_exact(src, in.data(), in.size())) {
+            return false;
+        }
+
+        if (src_type == GGML_TYPE_F32) {
+            memcpy(values.data(), in.data(), n_values * sizeof(float));
+        } else {
+            traits.to_float(in.data(), values.data(), (int) n_values);
+        }
+        const size_t n_bytes = ggml_quantize_chunk(dst_type, values.data(), out.data(), 0, (int) n_values, hist);
+        if (n_bytes != out.size() || !write_exact(dst, out.data(), out.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static vb_status_t quantize_stream(FILE* src, FILE* dst, vb_quantization_t quantization) {
+    std::vector<uint8_t> buffer(kChunkElements);
+
+    // Header: magic and hparams
+    uint32_t magic = 0;
+    int32_t hparams[kHparamCount];
+    if (!read_exact(src, &magic, sizeof(magic)) || magic != kGgmlMagic ||
+        !read_exact(src, hparams, sizeof(hparams))) {
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+    const ggml_ftype dst_ftype = quantization_ftype(quantization);
+    ggml_type src_wtype;
+    ggml_type dst_wtype;
+    if (!weight_type(hparams[kHparamCount - 1] % GGML_QNT_VERSION_FACTOR, &src_wtype) ||
+        !weight_type(dst_ftype, &dst_wtype)) {
+        return VB_STATUS_ERROR;
+    }
+    hparams[kHparamCount - 1] = (int32_t) dst_ftype + GGML_QNT_VERSION * GGML_QNT_VERSION_FACTOR;
+    if (!write_exact(dst, &magic, sizeof(magic)) || !write_exact(dst, hparams, sizeof(hparams))) {
+        return VB_STATUS_ERROR;
+    }
+
+    // Mel filters and vocabulary are copied as they are
+    int32_t mel_shape[2];
+    if (!read_exact(src, mel_shape, sizeof(mel_shape)) || mel_shape[0] < 0 || mel_shape[1] < 0 ||
+        !write_exact(dst, mel_shape, sizeof(mel_shape)) ||
+        !copy_bytes(src, dst, (size_t) mel_shape[0] * mel_shape[1] * sizeof(float), buffer)) {
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+    int32_t n_vocab = 0;
+    if (!read_exact(src, &n_vocab, sizeof(n_vocab)) || n_vocab < 0 || !write_exact(dst, &n_vocab, sizeof(n_vocab))) {
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+    for (int32_t i = 0; i < n_vocab; ++i) {
+        uint32_t length = 0;
+        if (!read_exact(src, &length, sizeof(length)) || !write_exact(dst, &length, sizeof(length)) ||
+            !copy_bytes(src, dst, length, buffer)) {
+            return VB_STATUS_INTEGRITY_ERROR;
+        }
+    }
+
+    // Tensors until the end of the file
+    std::vector<uint8_t> in;
+    std::vector<float> values;
+    std::vector<uint8_t> out;
+    for (;;) {
+        int32_t meta[3];                             // n_dims, name length, type
+        const size_t n_meta = fread(meta, 1, sizeof(meta), src);
+        if (n_meta == 0 && feof(src)) {
+            break;
+        }
+        const int32_t n_dims = meta[0];
+        const int32_t name_length = meta[1];
+        if (n_meta != sizeof(meta) || n_dims < 1 || n_dims > kMaxDims || name_length <= 0 ||
+            name_length > kMaxNameBytes || meta[2] < 0 || meta[2] >= GGML_TYPE_COUNT) {
+            return VB_STATUS_INTEGRITY_ERROR;
+        }
+        int32_t ne[kMaxDims] = {1, 1, 1, 1};
+        std::string name((size_t) name_length, '\0');
+        if (!read_exact(src, ne, sizeof(int32_t) * n_dims) || !read_exact(src, &name[0], name.size())) {
+            return VB_STATUS_INTEGRITY_ERROR;
+        }
+
+        const ggml_type src_type = (ggml_type) meta[2];
+        int64_t n_elements = 1;
+        for (int d = 0; d < n_dims; ++d) {
+            if (ne[d] <= 0) {
+                return VB_STATUS_INTEGRITY_ERROR;
+            }
+            n_elements *= ne[d];
+        }
+        if (ggml_blck_size(src_type) <= 0 || ggml_type_size(src_type) == 0 ||
+            ne[0] % ggml_blck_size(src_type) != 0) {
+            return VB_STATUS_INTEGRITY_ERROR;
+        }
+
+        // The loader creates every weight matrix at the file's type
+        const bool convert = n_dims == 2 && src_type == src_wtype && !keeps_type(name);
+        const ggml_type dst_type = convert ? dst_wtype : src_type;
+        if (convert && ne[0] % ggml_blck_size(dst_type) != 0) {
+            return VB_STATUS_ERROR;
+        }
+        meta[2] = (int32_t) dst_type;
+        if (!write_exact(dst, meta, sizeof(meta)) || !write_exact(dst, ne, sizeof(int32_t) * n_dims) ||
+            !write_exact(dst, name.data(), name.size())) {
+            return VB_STATUS_ERROR;
+        }
+
+        const bool ok = convert && dst_type != src_type
+            ? convert_tensor(src, dst, src_type, dst_type, ne[0], n_elements / ne[0], in, values, out)
+            : copy_bytes(src, dst, (size_t) n_elements / ggml_blck_size(src_type) * ggml_type_size(src_type),
+                         buffer);
+        if (!ok) {
+            return VB_STATUS_INTEGRITY_ERROR;
+        }
+    }
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t model_quantize(const char* src_path, const char* dst_path, vb_quantization_t quantization) {
+    if (!src_path || !dst_path) {
+        return VB_STATUS_ERROR;
+    }
+
+    // ggml fills its f16 conversion tables on first init
+    const ggml_init_params params = {0, nullptr, true};
+    ggml_free(ggml_init(params));
+
+    FILE* src = fopen(src_path, "rb");
+    if (!src) {
+        return VB_STATUS_MODEL_NOT_LOADED;
+    }
+    const std::string part_path = std::string(dst_path) + kPartSuffix;
+    FILE* dst = fopen(part_path.c_str(), "wb");
+    if (!dst) {
+        fclose(src);
+        return VB_STATUS_ERROR;
+    }
+
+    vb_status_t status = quantize_stream(src, dst, quantization);
+    fclose(src);
+    if (status == VB_STATUS_SUCCESS && (fflush(dst) != 0 || fsync(fileno(dst)) != 0)) {
+        status = VB_STATUS_ERROR;
+    }
+    fclose(dst);
+
+    if (status == VB_STATUS_SUCCESS && rename(part_path.c_str(), dst_path) != 0) {
+        status = VB_STATUS_ERROR;
+    }
+    if (status != VB_STATUS_SUCCESS) {
+        unlink(part_path.c_str());
+    }
+    return status;
+}
@@ -0,0 +1,15 @@
+#ifndef MODEL_QUANTIZER_H
+#define MODEL_QUANTIZER_H
+
+#include "../shared/types.h"
+
+// Rewrites a whisper.cpp ggml model with its weight matrices in another
+// quantization, the way whisper.cpp's quantize tool lays them out: the same
+// 2D tensors are converted (positional embeddings and biases keep their
+// types) and the header's ftype names the new type. The source may be f32,
+// f16 or any quantization ggml can dequantize. Tensors stream through a few
+// rows at a time, so memory stays flat whatever the model size. The output
+// is written next to dst_path and renamed over it once complete.
+vb_status_t model_quantize(const char* src_path, const char* dst_path, vb_quantization_t quantization);
+
+#endif // MODEL_QUANTIZER_H
@@ -0,0 +1,596 @@
+#include "model_registry.h"
+#include "model_quantizer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* kIndexFile = "models.index";
+static const char* kIndexHeader = "# voiceboard model index v1";
+static const char* kPartSuffix = ".part";
+static const size_t kFetchChunkBytes = 1024 * 1024;
+static const size_t kHeaderBytes = 48;             // ggml magic and the 11 whisper hparams
+static const uint32_t kGgmlMagic = 0x67676d6c;      // "ggml", stored little endian
+
+// Generated from models/manifest.json by scripts/build_models.py, which
+// records the SHA-256 of every file it fetches; tests/test_model_registry.cpp
+// checks that the two agree. An empty hash means the first verified download
+// is trusted.
+static const ModelSpec kManifest[VB_MODEL_TYPE_COUNT] = {
+    {"tiny.en", "ggml-tiny.en-q5_1.bin", 32166155,
+     "",
+     "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-tiny.en-q5_1.bin"},
+    {"base.en", "ggml-base.en-q5_1.bin", 59721011,
+     "",
+     "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-base.en-q5_1.bin"},
+    {"small.en", "ggml-small.en-q5_1.bin", 190098681,
+     "",
+     "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-small.en-q5_1.bin"},
+};
+
+// Indexed by vb_model_type_t, then vb_quantization_t; the q5_1 names are the manifest's
+static const char* kVariantFilenames[VB_MODEL_TYPE_COUNT][VB_QUANT_COUNT] = {
+    {"ggml-tiny.en-q5_1.bin", "ggml-tiny.en-q8_0.bin", "ggml-tiny.en-q4_0.bin"},
+    {"ggml-base.en-q5_1.bin", "ggml-base.en-q8_0.bin", "ggml-base.en-q4_0.bin"},
+    {"ggml-small.en-q5_1.bin", "ggml-small.en-q8_0.bin", "ggml-small.en-q4_0.bin"},
+};
+
+// In-process writers of the index; other processes only ever see it replaced whole
+static std::mutex g_index_mutex;
+// One download or conversion at a time, so two callers never write the same .part file
+static std::mutex g_download_mutex;
+
+// ---------------------------------------------------------------------------
+// SHA-256 (FIPS 180-4), fed incrementally as the file streams past
+
+static const uint32_t kSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+struct Sha256 {
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buffer[64];
+    size_t buffered = 0;
+    uint64_t n_bytes = 0;
+
+    void update(const uint8_t* data, size_t n);
+    std::string hex_digest();                    // finishes the hash
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(uint32_t* state, const uint8_t* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t) p[4 * i] << 24) | ((uint32_t) p[4 * i + 1] << 16) |
+               ((uint32_t) p[4 * i + 2] << 8) | (uint32_t) p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+                            kSha256K[i] + w[i];
+        const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void Sha256::update(const uint8_t* data, size_t n) {
+    n_bytes += n;
+    if (buffered > 0) {
+        const size_t take = std::min(n, sizeof(buffer) - buffered);
+        memcpy(buffer + buffered, data, take);
+        buffered += take;
+        data += take;
+        n -= take;
+        if (buffered < sizeof(buffer)) {
+            return;
+        }
+        sha256_block(state, buffer);
+        buffered = 0;
+    }
+    for (; n >= sizeof(buffer); data += sizeof(buffer), n -= sizeof(buffer)) {
+        sha256_block(state, data);
+    }
+    memcpy(buffer, data, n);
+    buffered = n;
+}
+
+std::string Sha256::hex_digest() {
+    const uint64_t n_bits = n_bytes * 8;
+    const uint8_t pad = 0x80;
+    const uint8_t zero = 0;
+    update(&pad, 1);
+    while (buffered != 56) {
+        update(&zero, 1);
+    }
+    uint8_t length[8];
+    for (int i = 0; i < 8; ++i) {
+        length[i] = (uint8_t) (n_bits >> (56 - 8 * i));
+    }
+    update(length, 8);
+
+    char hex[65];
+    for (int i = 0; i < 8; ++i) {
+        snprintf(hex + 8 * i, 9, "%08x", state[i]);
+    }
+    return std::string(hex, 64);
+}
+
+// ---------------------------------------------------------------------------
+// Files
+
+struct FileStamp {
+    int64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+static FileStamp file_stamp(const struct stat& st) {
+    FileStamp stamp;
+    stamp.size = (int64_t) st.st_size;
+#if defined(__APPLE__)
+    stamp.mtime_ns = (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return stamp;
+}
+
+static bool stat_file(const std::string& path, FileStamp* stamp) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    *stamp = file_stamp(st);
+    return true;
+}
+
+// The ggml header as hex; false when the file is too short or not a ggml model
+static bool read_header(int fd, std::string* hex) {
+    uint8_t header[kHeaderBytes];
+    if (pread(fd, header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+        return false;
+    }
+    const uint32_t magic = (uint32_t) header[0] | ((uint32_t) header[1] << 8) |
+                           ((uint32_t) header[2] << 16) | ((uint32_t) header[3] << 24);
+    if (magic != kGgmlMagic) {
+        return false;
+    }
+
+    char digits[2 * kHeaderBytes + 1];
+    for (size_t i = 0; i < kHeaderBytes; ++i) {
+        snprintf(digits + 2 * i, 3, "%02x", header[i]);
+    }
+    hex->assign(digits, 2 * kHeaderBytes);
+    return true;
+}
+
+// Hash the first n_bytes of fd
+static bool hash_file(int fd, int64_t n_bytes, Sha256* sha) {
+    std::vector<uint8_t> buffer(kFetchChunkBytes);
+    int64_t offset = 0;
+    while (offset < n_bytes) {
+        const size_t want = (size_t) std::min<int64_t>((int64_t) buffer.size(), n_bytes - offset);
+        const ssize_t n = pread(fd, buffer.data(), want, offset);
+        if (n <= 0) {
+            return false;
+        }
+        sha->update(buffer.data(), (size_t) n);
+        offset += n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t n) {
+    while (n > 0) {
+        const ssize_t written = write(fd, data, n);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        n -= (size_t) written;
+    }
+    return true;
+}
+
+// Make a rename in dir durable
+static void sync_dir(const char* dir) {
+    const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static std::string model_path(const char* models_dir, const ModelSpec* spec) {
+    return std::string(models_dir) + "/" + spec->filename;
+}
+
+// ---------------------------------------------------------------------------
+// Index of verified models
+
+struct IndexEntry {
+    std::string filename;
+    FileStamp stamp;
+    std::string sha256;
+    std::string header;                          // hex of the first kHeaderBytes
+};
+
+static std::string index_path(const char* models_dir) {
+    return std::string(models_dir) + "/" + kIndexFile;
+}
+
+static std::vector<IndexEntry> load_index(const std::string& path) {
+    std::vector<IndexEntry> entries;
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != kIndexHeader) {
+        return entries;
+    }
+
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        IndexEntry entry;
+        iss >> entry.filename >> entry.stamp.size >> entry.stamp.mtime_ns >> entry.sha256 >> entry.header;
+        if (iss) {
+            entries.push_back(entry);
+        }
+    }
+    return entries;
+}
+
+// Written to a temporary file first, so a reader in another process (the
+// keyboard next to the app) sees the old index or the new one, never a torn one
+static void save_index(const std::string& path, const std::vector<IndexEntry>& entries) {
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        file << kIndexHeader << '\n';
+        for (const IndexEntry& entry : entries) {
+            file << entry.filename << ' ' << entry.stamp.size << ' ' << entry.stamp.mtime_ns << ' '
+                 << entry.sha256 << ' ' << entry.header << '\n';
+        }
+        if (!file) {
+            return;
+        }
+    }
+    rename(tmp_path.c_str(), path.c_str());
+}
+
+static const IndexEntry* find_entry(const std::vector<IndexEntry>& entries, const char* filename) {
+    for (const IndexEntry& entry : entries) {
+        if (entry.filename == filename) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Replace the index entry of entry.filename. Caller holds g_index_mutex.
+static void update_index(const char* models_dir, const IndexEntry& entry) {
+    const std::string path = index_path(models_dir);
+    std::vector<IndexEntry> entries;
+    for (const IndexEntry& e : load_index(path)) {
+        if (e.filename != entry.filename) {
+            entries.push_back(e);
+        }
+    }
+    entries.push_back(entry);
+    save_index(path, entries);
+}
+
+// Hash a file must have: the manifest's, else the one first verified for it,
+// else empty (anything goes). Caller holds g_index_mutex.
+static std::string expected_hash(const char* models_dir, const ModelSpec* spec) {
+    if (spec->sha256[0] != '\0') {
+        return spec->sha256;
+    }
+    const std::vector<IndexEntry> entries = load_index(index_path(models_dir));
+    const IndexEntry* known = find_entry(entries, spec->filename);
+    return known ? known->sha256 : std::string();
+}
+
+// ---------------------------------------------------------------------------
+
+const ModelSpec* model_registry_spec(vb_model_type_t model_type) {
+    if ((int) model_type < 0 || (int) model_type >= VB_MODEL_TYPE_COUNT) {
+        return nullptr;
+    }
+    return &kManifest[model_type];
+}
+
+bool model_registry_is_available(vb_model_type_t model_type, const char* models_dir) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    if (!spec || !models_dir) {
+        return false;
+    }
+
+    const std::string path = model_path(models_dir, spec);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    std::string header;
+    const bool readable = fstat(fd, &st) == 0 && read_header(fd, &header);
+    close(fd);
+    if (!readable) {
+        return false;
+    }
+    const FileStamp stamp = file_stamp(st);
+    if (stamp.size != spec->size_bytes) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    const std::vector<IndexEntry> entries = load_index(index_path(models_dir));
+    const IndexEntry* entry = find_entry(entries, spec->filename);
+    return entry && entry->stamp.size == stamp.size && entry->stamp.mtime_ns == stamp.mtime_ns &&
+           entry->header == header && (spec->sha256[0] == '\0' || entry->sha256 == spec->sha256);
+}
+
+vb_status_t model_registry_verify(vb_model_type_t model_type, const char* models_dir) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    if (!spec || !models_dir) {
+        return VB_STATUS_ERROR;
+    }
+
+    const std::string path = model_path(models_dir, spec);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return VB_STATUS_ERROR;
+    }
+
+    IndexEntry verified;
+    verified.filename = spec->filename;
+    struct stat st = {};
+    Sha256 sha;
+    const bool intact = fstat(fd, &st) == 0 && (int64_t) st.st_size == spec->size_bytes &&
+                  read_header(fd, &verified.header) && hash_file(fd, spec->size_bytes, &sha);
+    close(fd);
+    verified.stamp = file_stamp(st);
+    verified.sha256 = sha.hex_digest();
+
+    if (!intact) {
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+
+    // A failed check leaves the index alone: its stale entry already fails
+    // availability, and its hash stays the reference for the next copy
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    const std::string expected = expected_hash(models_dir, spec);
+    if (!expected.empty() && verified.sha256 != expected) {
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+    update_index(models_dir, verified);
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t model_registry_download(vb_model_type_t model_type, const char* models_dir,
+                                    vb_model_fetch_callback_t fetch, void* user_data) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    if (!spec || !models_dir || !fetch) {
+        return VB_STATUS_ERROR;
+    }
+
+    std::lock_guard<std::mutex> download_lock(g_download_mutex);
+    if (model_registry_is_available(model_type, models_dir)) {
+        return VB_STATUS_SUCCESS;
+    }
+
+    // A file already in place but not indexed (copied in, or fetched before
+    // the index existed) is kept when it verifies
+    const std::string path = model_path(models_dir, spec);
+    if (access(path.c_str(), F_OK) == 0) {
+        if (model_registry_verify(model_type, models_dir) == VB_STATUS_SUCCESS) {
+            return VB_STATUS_SUCCESS;
+        }
+        unlink(path.c_str());
+    }
+
+    const std::string part_path = path + kPartSuffix;
+    const int fd = open(part_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return VB_STATUS_ERROR;
+    }
+
+    // Resume after the bytes a previous attempt left, which go through the hash first
+    Sha256 sha;
+    struct stat st = {};
+    int64_t offset = fstat(fd, &st) == 0 ? (int64_t) st.st_size : 0;
+    if (offset > spec->size_bytes || !hash_file(fd, offset, &sha)) {
+        sha = Sha256();
+        offset = 0;
+    }
+    if (ftruncate(fd, offset) != 0 || lseek(fd, offset, SEEK_SET) != offset) {
+        close(fd);
+        return VB_STATUS_ERROR;
+    }
+
+    std::vector<uint8_t> buffer(kFetchChunkBytes);
+    while (offset < spec->size_bytes) {
+        const int64_t n = fetch(spec->url, offset, buffer.data(), (int64_t) buffer.size(), user_data);
+        if (n == 0) {
+            break;
+        }
+        // Network and disk failures keep the .part file for the next attempt
+        if (n < 0 || n > (int64_t) buffer.size() || !write_all(fd, buffer.data(), (size_t) n)) {
+            close(fd);
+            return VB_STATUS_ERROR;
+        }
+        sha.update(buffer.data(), (size_t) n);
+        offset += n;
+    }
+
+    // The connection closed early; what arrived is kept for the next attempt
+    if (offset < spec->size_bytes) {
+        fsync(fd);
+        close(fd);
+        return VB_STATUS_ERROR;
+    }
+
+    IndexEntry verified;
+    verified.filename = spec->filename;
+    verified.sha256 = sha.hex_digest();
+    std::string expected;
+    {
+        std::lock_guard<std::mutex> lock(g_index_mutex);
+        expected = expected_hash(models_dir, spec);
+    }
+    const bool intact = read_header(fd, &verified.header) &&
+                        (expected.empty() || verified.sha256 == expected);
+    if (!intact) {
+        // A complete file that fails the checks is wrong, not incomplete;
+        // resuming it would not help
+        close(fd);
+        unlink(part_path.c_str());
+        return VB_STATUS_INTEGRITY_ERROR;
+    }
+
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+    if (!synced || rename(part_path.c_str(), path.c_str()) != 0) {
+        return VB_STATUS_ERROR;
+    }
+    sync_dir(models_dir);
+
+    if (!stat_file(path, &verified.stamp)) {
+        return VB_STATUS_ERROR;
+    }
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    update_index(models_dir, verified);
+    return VB_STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// Quantization variants
+
+const char* model_registry_variant_filename(vb_model_type_t model_type, vb_quantization_t quantization) {
+    if (!model_registry_spec(model_type) || (int) quantization < 0 || (int) quantization >= VB_QUANT_COUNT) {
+        return nullptr;
+    }
+    return kVariantFilenames[model_type][quantization];
+}
+
+// Index entry of a file as it is on disk now, hash included
+static bool describe_file(const std::string& path, const char* filename, IndexEntry* entry) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st = {};
+    Sha256 sha;
+    const bool ok = fstat(fd, &st) == 0 && read_header(fd, &entry->header) &&
+                    hash_file(fd, (int64_t) st.st_size, &sha);
+    close(fd);
+    entry->filename = filename;
+    entry->stamp = file_stamp(st);
+    entry->sha256 = sha.hex_digest();
+    return ok;
+}
+
+bool model_registry_is_variant_available(vb_model_type_t model_type, vb_quantization_t quantization,
+                                         const char* models_dir) {
+    const char* filename = model_registry_variant_filename(model_type, quantization);
+    if (!filename || !models_dir) {
+        return false;
+    }
+    if (quantization == VB_QUANT_Q5_1) {
+        return model_registry_is_available(model_type, models_dir);
+    }
+
+    // The index entry written at conversion is the reference; a variant is
+    // only as good as the source it came from
+    const std::string path = std::string(models_dir) + "/" + filename;
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    std::string header;
+    const bool readable = fstat(fd, &st) == 0 && read_header(fd, &header);
+    close(fd);
+    if (!readable || !model_registry_is_available(model_type, models_dir)) {
+        return false;
+    }
+    const FileStamp stamp = file_stamp(st);
+
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    const std::vector<IndexEntry> entries = load_index(index_path(models_dir));
+    const IndexEntry* entry = find_entry(entries, filename);
+    return entry && entry->stamp.size == stamp.size && entry->stamp.mtime_ns == stamp.mtime_ns &&
+           entry->header == header;
+}
+
+vb_status_t model_registry_prepare_variant(vb_model_type_t model_type, vb_quantization_t quantization,
+                                           const char* models_dir) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    const char* filename = model_registry_variant_filename(model_type, quantization);
+    if (!spec || !filename || !models_dir) {
+        return VB_STATUS_ERROR;
+    }
+
+    std::lock_guard<std::mutex> download_lock(g_download_mutex);
+    if (model_registry_is_variant_available(model_type, quantization, models_dir)) {
+        return VB_STATUS_SUCCESS;
+    }
+    if (quantization == VB_QUANT_Q5_1 || !model_registry_is_available(model_type, models_dir)) {
+        return VB_STATUS_MODEL_NOT_LOADED;
+    }
+
+    const std::string path = std::string(models_dir) + "/" + filename;
+    const vb_status_t status = model_quantize(model_path(models_dir, spec).c_str(), path.c_str(), quantization);
+    if (status != VB_STATUS_SUCCESS) {
+        return status;
+    }
+    sync_dir(models_dir);
+
+    IndexEntry converted;
+    if (!describe_file(path, filename, &converted)) {
+        return VB_STATUS_ERROR;
+    }
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    update_index(models_dir, converted);
+    return VB_STATUS_SUCCESS;
+}
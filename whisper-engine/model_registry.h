@@ -0,0 +1,52 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include "../shared/types.h"
+
+// Downloadable model as listed in models/manifest.json
+struct ModelSpec {
+    const char* name;                            // manifest key
+    const char* filename;
+    int64_t size_bytes;
+    const char* sha256;                          // lowercase hex, empty when the manifest has none
+    const char* url;
+};
+
+// Manifest entry of a model type, NULL for an unknown type
+const ModelSpec* model_registry_spec(vb_model_type_t model_type);
+
+// Whether models_dir holds a verified copy of the model. Answered from the
+// index of verified files kept in models_dir (size, mtime, SHA-256 and ggml
+// header of each): one stat and a read of the file header, whatever the
+// model size.
+bool model_registry_is_available(vb_model_type_t model_type, const char* models_dir);
+
+// Hash the whole model file against the manifest and record it in the index.
+// Without a manifest hash the first hash verified for the file is kept, and
+// later verifications and downloads must match it.
+vb_status_t model_registry_verify(vb_model_type_t model_type, const char* models_dir);
+
+// Download the model into models_dir through fetch. Bytes go to a .part file
+// that is hashed as it is written and renamed over the model only once it
+// verifies; a failed download keeps the .part file and the next call resumes
+// from its end.
+vb_status_t model_registry_download(vb_model_type_t model_type, const char* models_dir,
+                                    vb_model_fetch_callback_t fetch, void* user_data);
+
+// Quantization variants. VB_QUANT_Q5_1 is the manifest file itself; the
+// others are derived from it on the device and live next to it under
+// variant file names ("ggml-base.en-q8_0.bin").
+const char* model_registry_variant_filename(vb_model_type_t model_type, vb_quantization_t quantization);
+
+// Whether models_dir holds the variant as the registry converted it, checked
+// against the index like a downloaded model
+bool model_registry_is_variant_available(vb_model_type_t model_type, vb_quantization_t quantization,
+                                         const char* models_dir);
+
+// Convert the verified manifest file into the variant and index the result;
+// VB_STATUS_MODEL_NOT_LOADED when the manifest file is not in place. Runs
+// once: a variant already indexed is kept.
+vb_status_t model_registry_prepare_variant(vb_model_type_t model_type, vb_quantization_t quantization,
+                                           const char* models_dir);
+
+#endif // MODEL_REGISTRY_H
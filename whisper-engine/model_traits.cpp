@@ -0,0 +1,18 @@
+#include "model_traits.h"
+
+const ModelProfile* model_profile(vb_model_type_t model_type, whisper_context* ctx) {
+    if ((int) model_type < 0 || (int) model_type >= VB_MODEL_TYPE_COUNT || !ctx) {
+        return nullptr;
+    }
+
+    // A custom or fine-tuned file may be loaded under any type
+    const ModelProfile& profile = kModelProfiles[model_type];
+    const bool matches = whisper_model_n_mels(ctx) == profile.n_mels &&
+                         whisper_model_n_audio_ctx(ctx) == profile.n_audio_ctx &&
+                         whisper_model_n_audio_state(ctx) == profile.n_audio_state &&
+                         whisper_model_n_audio_layer(ctx) == profile.n_audio_layers &&
+                         whisper_model_n_text_ctx(ctx) == profile.n_text_ctx &&
+                         whisper_model_n_text_layer(ctx) == profile.n_text_layers &&
+                         whisper_model_n_vocab(ctx) == profile.n_vocab;
+    return matches ? &profile : nullptr;
+}
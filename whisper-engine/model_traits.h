@@ -0,0 +1,100 @@
+#ifndef MODEL_TRAITS_H
+#define MODEL_TRAITS_H
+
+#include "../shared/types.h"
+#include "whisper.h"
+#include <cstddef>
+
+// Compile-time description of the models VoiceBoard ships. Shapes come from
+// the ggml headers of the manifest files; the engine defaults are what each
+// model runs best with on phones. A file loaded under one of these types is
+// only treated as that model when its hyperparameters match (model_profile),
+// so arbitrary GGML files keep the generic, runtime-sized path.
+template <vb_model_type_t Type>
+struct ModelTraits;
+
+// Shared by the English-only models
+struct EnglishModelTraits {
+    static constexpr int kMels = 80;
+    static constexpr int kAudioCtx = 1500;       // encoder positions of a 30s window
+    static constexpr int kTextCtx = 448;
+    static constexpr int kVocab = 51864;
+};
+
+template <>
+struct ModelTraits<VB_MODEL_TINY_EN> : EnglishModelTraits {
+    static constexpr int kAudioState = 384;
+    static constexpr int kAudioLayers = 4;
+    static constexpr int kTextLayers = 4;
+    static constexpr int kDecodeThreads = 2;     // small matrices; more threads mostly synchronize
+    static constexpr int kBatchWorkers = 2;
+};
+
+template <>
+struct ModelTraits<VB_MODEL_BASE_EN> : EnglishModelTraits {
+    static constexpr int kAudioState = 512;
+    static constexpr int kAudioLayers = 6;
+    static constexpr int kTextLayers = 6;
+    static constexpr int kDecodeThreads = 4;
+    static constexpr int kBatchWorkers = 2;
+};
+
+// The manifest ships this type as small.en
+template <>
+struct ModelTraits<VB_MODEL_DISTIL_SMALL_EN> : EnglishModelTraits {
+    static constexpr int kAudioState = 768;
+    static constexpr int kAudioLayers = 12;
+    static constexpr int kTextLayers = 12;
+    static constexpr int kDecodeThreads = 4;
+    static constexpr int kBatchWorkers = 1;      // a second decoder state costs too much memory
+};
+
+// Sizes the engine derives from the traits, for use at runtime
+struct ModelProfile {
+    vb_model_type_t type;
+    int n_mels;
+    int n_audio_ctx;
+    int n_audio_state;
+    int n_audio_layers;
+    int n_text_ctx;
+    int n_text_layers;
+    int n_vocab;
+    int decode_threads;                          // fixed thread policy default
+    int batch_workers;                           // batch_workers default
+    size_t window_frames;                        // spectrogram frames of the largest decode window
+    size_t arena_bytes;                          // pass arena that holds a full-window hypothesis
+};
+
+// Whisper's spectrogram has 100 frames per second over a 30s encoder window
+constexpr size_t kWindowSeconds = 30;
+constexpr size_t kFramesPerSecond = WHISPER_SAMPLE_RATE / WHISPER_HOP_LENGTH;
+
+// Per hypothesis token: its vb_token_t, a word and the text, with room for
+// the result copies handed to the callback
+constexpr size_t kArenaBytesPerToken = 256;
+
+template <vb_model_type_t Type>
+constexpr ModelProfile make_model_profile() {
+    using T = ModelTraits<Type>;
+    static_assert(T::kAudioCtx * 2 == kWindowSeconds * kFramesPerSecond,
+                  "the encoder must cover a full 30s window");
+    return {Type, T::kMels, T::kAudioCtx, T::kAudioState, T::kAudioLayers, T::kTextCtx, T::kTextLayers,
+            T::kVocab, T::kDecodeThreads, T::kBatchWorkers, kWindowSeconds * kFramesPerSecond + 1,
+            (size_t) T::kTextCtx * kArenaBytesPerToken};
+}
+
+// Indexed by vb_model_type_t
+constexpr ModelProfile kModelProfiles[VB_MODEL_TYPE_COUNT] = {
+    make_model_profile<VB_MODEL_TINY_EN>(),
+    make_model_profile<VB_MODEL_BASE_EN>(),
+    make_model_profile<VB_MODEL_DISTIL_SMALL_EN>(),
+};
+static_assert(kModelProfiles[VB_MODEL_TINY_EN].type == VB_MODEL_TINY_EN &&
+              kModelProfiles[VB_MODEL_BASE_EN].type == VB_MODEL_BASE_EN &&
+              kModelProfiles[VB_MODEL_DISTIL_SMALL_EN].type == VB_MODEL_DISTIL_SMALL_EN,
+              "kModelProfiles is indexed by vb_model_type_t");
+
+// Profile of model_type when ctx holds that model, NULL for any other file
+const ModelProfile* model_profile(vb_model_type_t model_type, whisper_context* ctx);
+
+#endif // MODEL_TRAITS_H
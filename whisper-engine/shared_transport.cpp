@@ -0,0 +1,420 @@
+#include "shared_transport.h"
+#include "whisper_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <notify.h>
+#include <poll.h>
+#elif defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static const uint32_t kTransportMagic = 0x56425452;        // "VBTR"
+static const uint32_t kTransportVersion = 1;
+static const size_t kDefaultTransportBytes = 64 * 1024;
+static const size_t kMinTransportBytes = 4 * 1024;
+static const size_t kMaxTransportBytes = 16 * 1024 * 1024;
+static const size_t kRecordAlign = 8;
+static const int kHostToClient = 0;
+static const int kClientToHost = 1;
+
+// Both processes operate on these through the mapping, which only works for
+// atomics that are lock-free and therefore address-free
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "shared-memory positions need lock-free atomics");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words are plain 32-bit integers");
+
+// Positions count bytes since the host initialized the file; the reader and
+// writer fields sit on separate cache lines
+struct RingControl {
+    alignas(64) std::atomic<uint64_t> write_pos;
+    std::atomic<uint32_t> n_written;             // messages offered, dropped ones included
+    std::atomic<uint32_t> signal;                // bumped after each write; readers sleep on it
+    alignas(64) std::atomic<uint64_t> read_pos;
+};
+
+// Start of the file, followed by capacity bytes of each ring
+struct TransportHeader {
+    std::atomic<uint32_t> magic;                 // stored last by the host once the rest is set
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t reserved;
+    RingControl rings[2];                        // kHostToClient, kClientToHost
+};
+
+// One message in a ring, followed by its text and padding to kRecordAlign
+struct WireMessage {
+    uint32_t size;                               // record bytes, this header and padding included
+    uint32_t type;
+    int32_t status;
+    uint32_t sequence;
+    int64_t timestamp_ms;
+    float confidence;
+    uint32_t text_length;
+};
+static_assert(sizeof(WireMessage) % kRecordAlign == 0, "records stay aligned");
+
+struct vb_transport {
+    vb_transport_role_t role = VB_TRANSPORT_HOST;
+    int fd = -1;
+    void* map = MAP_FAILED;
+    size_t map_size = 0;
+    TransportHeader* header = nullptr;
+    uint8_t* data = nullptr;
+    size_t capacity = 0;
+    int out_ring = kHostToClient;
+    int in_ring = kClientToHost;
+    std::mutex write_mutex;
+    std::mutex read_mutex;
+#if defined(__APPLE__)
+    std::string notify_names[2];
+    int notify_fd = -1;
+    int notify_token = 0;
+#endif
+};
+
+static size_t ring_capacity(int32_t capacity_bytes) {
+    const size_t requested = capacity_bytes > 0 ? (size_t) capacity_bytes : kDefaultTransportBytes;
+    size_t capacity = kMinTransportBytes;
+    while (capacity < requested && capacity < kMaxTransportBytes) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static size_t file_size(size_t capacity) {
+    return sizeof(TransportHeader) + 2 * capacity;
+}
+
+static uint8_t* ring_data(vb_transport* t, int ring) {
+    return t->data + (size_t) ring * t->capacity;
+}
+
+static void ring_copy_in(uint8_t* data, size_t capacity, uint64_t pos, const void* src, size_t n) {
+    const size_t offset = (size_t) (pos & (capacity - 1));
+    const size_t first = std::min(n, capacity - offset);
+    memcpy(data + offset, src, first);
+    memcpy(data, static_cast<const uint8_t*>(src) + first, n - first);
+}
+
+static void ring_copy_out(const uint8_t* data, size_t capacity, uint64_t pos, void* dst, size_t n) {
+    const size_t offset = (size_t) (pos & (capacity - 1));
+    const size_t first = std::min(n, capacity - offset);
+    memcpy(dst, data + offset, first);
+    memcpy(static_cast<uint8_t*>(dst) + first, data, n - first);
+}
+
+#if defined(__APPLE__)
+// Darwin notification names are global; the file's identity keeps two
+// transports apart and is the same in both processes whatever path each uses
+static bool setup_wakeup(vb_transport* t) {
+    struct stat st;
+    if (fstat(t->fd, &st) != 0) {
+        return false;
+    }
+    const std::string base = "com.voiceboard.transport." + std::to_string((unsigned long long) st.st_dev) +
+                             "." + std::to_string((unsigned long long) st.st_ino);
+    t->notify_names[kHostToClient] = base + ".results";
+    t->notify_names[kClientToHost] = base + ".commands";
+    if (notify_register_file_descriptor(t->notify_names[t->in_ring].c_str(), &t->notify_fd, 0,
+                                        &t->notify_token) != NOTIFY_STATUS_OK) {
+        return false;
+    }
+    fcntl(t->notify_fd, F_SETFL, fcntl(t->notify_fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+static void teardown_wakeup(vb_transport* t) {
+    if (t->notify_fd >= 0) {
+        notify_cancel(t->notify_token);
+    }
+}
+
+static void wake_reader(vb_transport* t) {
+    notify_post(t->notify_names[t->out_ring].c_str());
+}
+
+// A post that arrived since the last wait is still queued on the descriptor,
+// so a write between the caller's check and the poll is not missed
+static void wait_for_signal(vb_transport* t, uint32_t /* signal */, int32_t timeout_ms) {
+    struct pollfd pfd = {t->notify_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        int token;
+        while (read(t->notify_fd, &token, sizeof(token)) == (ssize_t) sizeof(token)) {
+        }
+    }
+}
+#elif defined(__linux__)
+// FUTEX_WAIT without FUTEX_PRIVATE_FLAG matches waiters across processes
+// mapping the same file
+static bool setup_wakeup(vb_transport*) {
+    return true;
+}
+
+static void teardown_wakeup(vb_transport*) {
+}
+
+static void wake_reader(vb_transport* t) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&t->header->rings[t->out_ring].signal), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+
+// Returns at once if a write bumped the signal since the caller read it
+static void wait_for_signal(vb_transport* t, uint32_t signal, int32_t timeout_ms) {
+    struct timespec ts = {timeout_ms / 1000, (long) (timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&t->header->rings[t->in_ring].signal), FUTEX_WAIT, signal,
+            timeout_ms >= 0 ? &ts : nullptr, nullptr, 0);
+}
+#else
+static bool setup_wakeup(vb_transport*) {
+    return true;
+}
+
+static void teardown_wakeup(vb_transport*) {
+}
+
+static void wake_reader(vb_transport*) {
+}
+
+static void wait_for_signal(vb_transport* t, uint32_t signal, int32_t timeout_ms) {
+    const RingControl& ring = t->header->rings[t->in_ring];
+    for (int32_t waited = 0; timeout_ms < 0 || waited < timeout_ms; ++waited) {
+        if (ring.signal.load(std::memory_order_acquire) != signal) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+#endif
+
+static bool map_file(vb_transport* t, size_t size) {
+    t->map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+    if (t->map == MAP_FAILED) {
+        return false;
+    }
+    t->map_size = size;
+    t->header = static_cast<TransportHeader*>(t->map);
+    t->data = static_cast<uint8_t*>(t->map) + sizeof(TransportHeader);
+    return true;
+}
+
+static bool open_host(vb_transport* t, const char* path, int32_t capacity_bytes) {
+    t->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (t->fd < 0) {
+        return false;
+    }
+    t->capacity = ring_capacity(capacity_bytes);
+    const size_t size = file_size(t->capacity);
+    if (ftruncate(t->fd, (off_t) size) != 0 || !map_file(t, size)) {
+        return false;
+    }
+
+    // A client still mapping a previous layout sees no magic until the
+    // positions are consistent again
+    TransportHeader* header = t->header;
+    header->magic.store(0, std::memory_order_release);
+    header->version = kTransportVersion;
+    header->capacity = (uint32_t) t->capacity;
+    for (RingControl& ring : header->rings) {
+        ring.write_pos.store(0, std::memory_order_relaxed);
+        ring.read_pos.store(0, std::memory_order_relaxed);
+        ring.n_written.store(0, std::memory_order_relaxed);
+        ring.signal.fetch_add(1, std::memory_order_relaxed);
+    }
+    header->magic.store(kTransportMagic, std::memory_order_release);
+    return true;
+}
+
+static bool open_client(vb_transport* t, const char* path) {
+    t->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (t->fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(t->fd, &st) != 0 || (size_t) st.st_size < sizeof(TransportHeader) ||
+        !map_file(t, (size_t) st.st_size)) {
+        return false;
+    }
+
+    const TransportHeader* header = t->header;
+    if (header->magic.load(std::memory_order_acquire) != kTransportMagic || header->version != kTransportVersion) {
+        return false;
+    }
+    t->capacity = header->capacity;
+    return t->capacity >= kMinTransportBytes && t->capacity <= kMaxTransportBytes &&
+           (t->capacity & (t->capacity - 1)) == 0 && file_size(t->capacity) <= t->map_size;
+}
+
+vb_transport* transport_open(const char* path, vb_transport_role_t role, int32_t capacity_bytes) {
+    if (!path) {
+        return nullptr;
+    }
+
+    vb_transport* t = new vb_transport();
+    t->role = role;
+    t->out_ring = role == VB_TRANSPORT_HOST ? kHostToClient : kClientToHost;
+    t->in_ring = role == VB_TRANSPORT_HOST ? kClientToHost : kHostToClient;
+    const bool opened = role == VB_TRANSPORT_HOST ? open_host(t, path, capacity_bytes) : open_client(t, path);
+    if (!opened || !setup_wakeup(t)) {
+        transport_close(t);
+        return nullptr;
+    }
+    return t;
+}
+
+void transport_close(vb_transport* t) {
+    if (!t) {
+        return;
+    }
+    teardown_wakeup(t);
+    if (t->map != MAP_FAILED) {
+        munmap(t->map, t->map_size);
+    }
+    if (t->fd >= 0) {
+        close(t->fd);
+    }
+    delete t;
+}
+
+bool transport_write(vb_transport* t, vb_message_type_t type, int32_t status, int64_t timestamp_ms,
+                     float confidence, const char* text) {
+    if (!t) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(t->write_mutex);
+    RingControl& ring = t->header->rings[t->out_ring];
+
+    WireMessage wire = {};
+    const size_t max_text = t->capacity - sizeof(WireMessage) - kRecordAlign;
+    const size_t text_length = std::min(text ? strlen(text) : 0, max_text);
+    wire.size = (uint32_t) ((sizeof(WireMessage) + text_length + kRecordAlign - 1) & ~(kRecordAlign - 1));
+    wire.type = (uint32_t) type;
+    wire.status = status;
+    wire.sequence = ring.n_written.fetch_add(1, std::memory_order_relaxed);
+    wire.timestamp_ms = timestamp_ms;
+    wire.confidence = confidence;
+    wire.text_length = (uint32_t) text_length;
+
+    const uint64_t w = ring.write_pos.load(std::memory_order_relaxed);
+    const uint64_t used = w - ring.read_pos.load(std::memory_order_acquire);
+    if (used > t->capacity || t->capacity - used < wire.size) {
+        return false;
+    }
+
+    uint8_t* data = ring_data(t, t->out_ring);
+    ring_copy_in(data, t->capacity, w, &wire, sizeof(wire));
+    ring_copy_in(data, t->capacity, w + sizeof(wire), text, text_length);
+    ring.write_pos.store(w + wire.size, std::memory_order_release);
+    ring.signal.fetch_add(1, std::memory_order_release);
+    wake_reader(t);
+    return true;
+}
+
+bool transport_read(vb_transport* t, vb_transport_message_t* message, char* text, int32_t capacity) {
+    if (!t || !message) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(t->read_mutex);
+    RingControl& ring = t->header->rings[t->in_ring];
+
+    const uint64_t w = ring.write_pos.load(std::memory_order_acquire);
+    const uint64_t r = ring.read_pos.load(std::memory_order_relaxed);
+    if (w == r) {
+        return false;
+    }
+
+    // Positions out of step, or a record that does not fit what was written,
+    // mean the other side reinitialized the file; skip to its write position
+    WireMessage wire;
+    const uint8_t* data = ring_data(t, t->in_ring);
+    const bool consistent = w - r <= t->capacity && w - r >= sizeof(wire);
+    if (consistent) {
+        ring_copy_out(data, t->capacity, r, &wire, sizeof(wire));
+    }
+    if (!consistent || wire.size > w - r || wire.size < sizeof(wire) + wire.text_length) {
+        ring.read_pos.store(w, std::memory_order_release);
+        return false;
+    }
+
+    const size_t n_copy = text && capacity > 0 ? std::min((size_t) wire.text_length, (size_t) capacity - 1) : 0;
+    if (text && capacity > 0) {
+        ring_copy_out(data, t->capacity, r + sizeof(wire), text, n_copy);
+        text[n_copy] = '\0';
+    }
+    ring.read_pos.store(r + wire.size, std::memory_order_release);
+
+    message->type = (vb_message_type_t) wire.type;
+    message->status = wire.status;
+    message->timestamp_ms = wire.timestamp_ms;
+    message->confidence = wire.confidence;
+    message->sequence = wire.sequence;
+    message->text = capacity > 0 ? text : nullptr;
+    message->text_length = (int32_t) wire.text_length;
+    return true;
+}
+
+bool transport_wait(vb_transport* t, int32_t timeout_ms) {
+    if (!t) {
+        return false;
+    }
+    const RingControl& ring = t->header->rings[t->in_ring];
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+    for (;;) {
+        // Read the signal before the positions so a write in between wakes the wait
+        const uint32_t signal = ring.signal.load(std::memory_order_acquire);
+        if (ring.write_pos.load(std::memory_order_acquire) != ring.read_pos.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (timeout_ms < 0) {
+            wait_for_signal(t, signal, -1);
+            continue;
+        }
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            return false;
+        }
+        wait_for_signal(t, signal, (int32_t) remaining);
+    }
+}
+
+// Public API (whisper_engine.h). Kept out of the engine so the keyboard
+// extension can link the transport on its own.
+
+vb_transport_t* vb_transport_open(const char* path, vb_transport_role_t role, int32_t capacity_bytes) {
+    return transport_open(path, role, capacity_bytes);
+}
+
+void vb_transport_close(vb_transport_t* transport) {
+    transport_close(transport);
+}
+
+bool vb_transport_write(vb_transport_t* transport, const vb_transport_message_t* message) {
+    if (!message) {
+        return false;
+    }
+    return transport_write(transport, message->type, message->status, message->timestamp_ms,
+                           message->confidence, message->text);
+}
+
+bool vb_transport_read(vb_transport_t* transport, vb_transport_message_t* message, char* text,
+                       int32_t text_capacity) {
+    return transport_read(transport, message, text, text_capacity);
+}
+
+bool vb_transport_wait(vb_transport_t* transport, int32_t timeout_ms) {
+    return transport_wait(transport, timeout_ms);
+}
@@ -0,0 +1,38 @@
+#ifndef SHARED_TRANSPORT_H
+#define SHARED_TRANSPORT_H
+
+#include "../shared/types.h"
+
+// Message rings in a file both processes map, e.g. in the App Group container
+// shared by the iOS app and its keyboard extension. Each direction is a
+// single-producer/single-consumer byte ring of length-prefixed messages whose
+// positions live in the mapping, so a message is one copy in and one copy out
+// with no serialization, and neither side ever waits on the other. A full
+// ring drops the new message rather than block the writer. Writers in one
+// process are serialized by a local mutex, as are readers.
+//
+// Readers sleep on a per-direction wakeup: Darwin notifications on Apple
+// platforms, a shared futex on Linux and Android, a short poll elsewhere.
+struct vb_transport;
+
+// The host creates the file, or reuses an existing one in place so a client
+// that already mapped it sees the reset; capacity_bytes is per direction
+// (0 = 64KB), rounded up to a power of two. A client maps a file the host has
+// initialized and returns NULL until then.
+vb_transport* transport_open(const char* path, vb_transport_role_t role, int32_t capacity_bytes);
+void transport_close(vb_transport* transport);
+
+// Appends a message to the outgoing direction; false if it did not fit. Text
+// longer than the ring is truncated.
+bool transport_write(vb_transport* transport, vb_message_type_t type, int32_t status, int64_t timestamp_ms,
+                     float confidence, const char* text);
+
+// Takes the next incoming message, copying its text into text (NUL-terminated,
+// truncated to capacity). False when none is waiting.
+bool transport_read(vb_transport* transport, vb_transport_message_t* message, char* text, int32_t capacity);
+
+// Blocks until an incoming message is waiting or timeout_ms passes (< 0 =
+// no timeout); true if one is waiting
+bool transport_wait(vb_transport* transport, int32_t timeout_ms);
+
+#endif // SHARED_TRANSPORT_H
@@ -0,0 +1,195 @@
+#include "speculative_decoder.h"
+#include <algorithm>
+#include <cmath>
+
+// Rows of one batched call and of single-token calls differ only by rounding
+static const float kProbeTolerance = 1e-3f;
+
+// Limits whisper_full applies to one window
+static int max_new_tokens(whisper_context* ctx) {
+    return whisper_n_text_ctx(ctx) / 2 - 4;
+}
+
+// Token whisper_full suppresses at the start of a transcript
+static whisper_token blank_token(whisper_context* ctx) {
+    whisper_token token[4];
+    return whisper_tokenize(ctx, " ", token, 4) == 1 ? token[0] : -1;
+}
+
+// Greedy choice among the text tokens and end of text. Timestamps and the
+// other special tokens follow the end of text token in whisper's vocabulary.
+static whisper_token greedy_token(const float* logits, whisper_token eot, whisper_token blank, bool initial) {
+    whisper_token best = -1;
+    float best_logit = -INFINITY;
+    for (whisper_token i = 0; i <= eot; ++i) {
+        if (initial && (i == eot || i == blank)) {
+            continue;
+        }
+        if (logits[i] > best_logit) {
+            best_logit = logits[i];
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Target token data of a chosen token; p is normalized over the same tokens
+// as the greedy choice, as whisper does after suppressing the rest
+static whisper_token_data token_data(const float* logits, whisper_token id, whisper_token eot,
+                                     whisper_token blank, bool initial) {
+    double sum = 0.0;
+    for (whisper_token i = 0; i <= eot; ++i) {
+        if (!(initial && (i == eot || i == blank))) {
+            sum += std::exp((double) (logits[i] - logits[id]));
+        }
+    }
+
+    whisper_token_data data = {};
+    data.id = id;
+    data.tid = -1;
+    data.plog = (float) -std::log(sum);
+    data.p = (float) (1.0 / sum);
+    data.t0 = -1;
+    data.t1 = -1;
+    return data;
+}
+
+int speculative_supported(whisper_context* ctx, whisper_state* state, int n_threads) {
+    const int n_vocab = whisper_n_vocab(ctx);
+    const whisper_token probe[2] = {whisper_token_sot(ctx), whisper_token_not(ctx)};
+
+    // First row of a two-token call against the same token decoded alone
+    if (whisper_decode_with_state(ctx, state, probe, 2, 0, n_threads) != 0) {
+        return 0;
+    }
+    const float* rows = whisper_get_logits_from_state(state);
+    const std::vector<float> first(rows, rows + n_vocab);
+
+    if (whisper_decode_with_state(ctx, state, probe, 1, 0, n_threads) != 0) {
+        return 0;
+    }
+    const float* single = whisper_get_logits_from_state(state);
+    for (int i = 0; i < n_vocab; ++i) {
+        if (!std::isfinite(single[i])) {
+            return -1;
+        }
+        if (!std::isfinite(first[i]) ||
+            std::fabs(first[i] - single[i]) > kProbeTolerance * (1.0f + std::fabs(single[i]))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+std::vector<whisper_token> speculative_prompt(whisper_context* ctx, const whisper_token* past, int n_past) {
+    std::vector<whisper_token> prompt;
+    const int n_take = std::min(n_past, whisper_n_text_ctx(ctx) / 2);
+    if (n_take > 0) {
+        prompt.push_back(whisper_token_prev(ctx));
+        prompt.insert(prompt.end(), past + n_past - n_take, past + n_past);
+    }
+
+    prompt.push_back(whisper_token_sot(ctx));
+    if (whisper_is_multilingual(ctx)) {
+        prompt.push_back(whisper_token_lang(ctx, whisper_lang_id("en")));
+        prompt.push_back(whisper_token_transcribe(ctx));
+    }
+    prompt.push_back(whisper_token_not(ctx));
+    return prompt;
+}
+
+bool speculative_decode(whisper_context* target_ctx, whisper_state* target_state,
+                        whisper_context* draft_ctx, whisper_state* draft_state,
+                        const std::vector<whisper_token>& prompt, int n_draft, int n_threads,
+                        std::vector<whisper_token_data>& tokens, SpeculativeStats* stats) {
+    const int n_vocab = whisper_n_vocab(target_ctx);
+    const whisper_token eot = whisper_token_eot(target_ctx);
+    const whisper_token blank = blank_token(target_ctx);
+    const int n_ctx = std::min(whisper_n_text_ctx(target_ctx), whisper_n_text_ctx(draft_ctx));
+    const int n_max = std::min(max_new_tokens(target_ctx), n_ctx - (int) prompt.size() - 1);
+
+    // seq is the prompt and the accepted tokens; each model's decoder cache
+    // holds the first *_past of them. The last accepted token has not been
+    // through either model yet.
+    std::vector<whisper_token> seq(prompt);
+    std::vector<whisper_token> draft;
+    std::vector<whisper_token> batch;
+    std::vector<whisper_token_data> data;        // of the accepted tokens
+    int target_past = 0;
+    int draft_past = 0;
+    int n_new = 0;
+
+    while (n_new < n_max) {
+        const int n_propose = std::max(1, std::min(n_draft, n_max - n_new));
+        const int n_seq = (int) seq.size();
+
+        // Draft: feed what it has not seen yet, then extend one token per call
+        draft.clear();
+        for (int i = 0; i < n_propose; ++i) {
+            const whisper_token* input = i == 0 ? seq.data() + draft_past : &draft.back();
+            const int n_input = i == 0 ? n_seq - draft_past : 1;
+            const int n_past = i == 0 ? draft_past : n_seq + i - 1;
+            if (whisper_decode_with_state(draft_ctx, draft_state, input, n_input, n_past, n_threads) != 0) {
+                return false;
+            }
+            const float* logits = whisper_get_logits_from_state(draft_state) + (size_t) (n_input - 1) * n_vocab;
+            draft.push_back(greedy_token(logits, eot, blank, n_new == 0 && i == 0));
+            if (draft.back() == eot) {
+                break;
+            }
+        }
+        const int draft_seen = n_seq + (int) draft.size() - 1;
+
+        // Target: one call over the unseen tail and the whole proposal. Row
+        // base + i predicts the token after draft[i - 1].
+        batch.assign(seq.begin() + target_past, seq.end());
+        batch.insert(batch.end(), draft.begin(), draft.end());
+        if (whisper_decode_with_state(target_ctx, target_state, batch.data(), (int) batch.size(),
+                                      target_past, n_threads) != 0) {
+            return false;
+        }
+        const float* rows = whisper_get_logits_from_state(target_state);
+        const size_t base = (size_t) (n_seq - target_past - 1);
+
+        size_t n_ok = 0;
+        whisper_token next = eot;
+        bool done = false;
+        for (;;) {
+            next = greedy_token(rows + (base + n_ok) * n_vocab, eot, blank, n_new == 0 && n_ok == 0);
+            if (n_ok == draft.size() || next != draft[n_ok]) {
+                break;
+            }
+            if (next == eot) {
+                done = true;
+                break;
+            }
+            ++n_ok;
+        }
+
+        if (stats) {
+            ++stats->n_target_calls;
+            stats->n_drafted += (int) draft.size();
+            stats->n_accepted += (int) n_ok + (done ? 1 : 0);
+        }
+
+        for (size_t i = 0; i < n_ok; ++i) {
+            data.push_back(token_data(rows + (base + i) * n_vocab, draft[i], eot, blank, n_new == 0 && i == 0));
+        }
+
+        // Both caches keep only what agrees with the accepted sequence; the
+        // next call at a lower n_past drops the rest
+        seq.insert(seq.end(), draft.begin(), draft.begin() + n_ok);
+        n_new += (int) n_ok;
+        target_past = (int) seq.size();
+        draft_past = std::min(draft_seen, n_seq + (int) n_ok);
+        if (done || next == eot) {
+            break;
+        }
+        data.push_back(token_data(rows + (base + n_ok) * n_vocab, next, eot, blank, n_new == 0));
+        seq.push_back(next);
+        ++n_new;
+    }
+
+    tokens.insert(tokens.end(), data.begin(), data.end());
+    return true;
+}
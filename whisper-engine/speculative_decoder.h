@@ -0,0 +1,43 @@
+#ifndef SPECULATIVE_DECODER_H
+#define SPECULATIVE_DECODER_H
+
+#include "whisper.h"
+#include <vector>
+
+// Greedy decoding of an encoded window by a target model, with a smaller draft
+// model of the same vocabulary proposing the next tokens. The target checks a
+// whole proposal in one decoder call and keeps the agreeing prefix plus its
+// own next token, so the text is the target's greedy decode; how often the
+// draft agrees only changes the number of target calls.
+struct SpeculativeStats {
+    int n_target_calls = 0;
+    int n_drafted = 0;                           // tokens proposed by the draft
+    int n_accepted = 0;                          // proposed tokens the target kept
+};
+
+// Whether whisper_decode_with_state on this model returns logits for every
+// token it was given. whisper.cpp 1.5.4 does not: its legacy batch asks for
+// the last row only, so a proposal cannot be verified in one call and the
+// engine is built without speculative decoding unless WHISPER_BATCHED_LOGITS
+// says the linked whisper.cpp was patched or updated to fill every row.
+// Needs no encoded window, whatever the cross-attention cache holds is decoded
+// twice alike; its decoder cache is overwritten. 1 when every row is filled,
+// 0 when only the last one is, -1 when the logits were not finite (the state
+// holds garbage) and the answer is unknown.
+int speculative_supported(whisper_context* ctx, whisper_state* state, int n_threads);
+
+// Decoder prompt for text without timestamps, as whisper_full builds it:
+// the most recent past tokens after the previous-text marker, then the start
+// of transcript sequence
+std::vector<whisper_token> speculative_prompt(whisper_context* ctx, const whisper_token* past, int n_past);
+
+// Decode the window encoded in both target_state and draft_state after prompt,
+// n_draft proposed tokens at a time. Text tokens up to end of text are
+// appended to tokens with the target's id, p and plog; no timestamps are
+// decoded, so t0 and t1 are -1. Returns false on a decoder error.
+bool speculative_decode(whisper_context* target_ctx, whisper_state* target_state,
+                        whisper_context* draft_ctx, whisper_state* draft_state,
+                        const std::vector<whisper_token>& prompt, int n_draft, int n_threads,
+                        std::vector<whisper_token_data>& tokens, SpeculativeStats* stats);
+
+#endif // SPECULATIVE_DECODER_H
@@ -0,0 +1,27 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <cstdio>
+
+// Host tests are plain executables run by ctest: CHECK records a failure and
+// carries on, and main returns check_result().
+
+static int g_check_failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++g_check_failures;                                              \
+        }                                                                    \
+    } while (0)
+
+static inline int check_result() {
+    if (g_check_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", g_check_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // TESTS_CHECK_H
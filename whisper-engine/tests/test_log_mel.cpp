@@ -0,0 +1,156 @@
+// LogMelStream::compute against whisper_pcm_to_mel_with_state on the same
+// window, as the window grows and after drop_front. whisper keeps its
+// spectrogram private, so both are run through the model: each is encoded
+// and the decoder's next-token distribution after the prompt is compared
+// within a tolerance.
+//
+// usage: test_log_mel MODEL   (exits 77, skipped, when MODEL is missing)
+
+#include "check.h"
+#include "log_mel.h"
+#include "whisper.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static const int kSampleRate = WHISPER_SAMPLE_RATE;
+static const int kThreads = 4;
+static const int kSkipped = 77;
+
+// Largest allowed difference in log probability over the tokens either
+// spectrogram makes likely
+static const float kMaxLogProbDiff = 0.1f;
+static const float kLikelyLogProb = -8.0f;
+
+// A few seconds of voiced-sounding test signal: harmonics of a gliding pitch
+// under a syllable-rate envelope, with a little noise
+static std::vector<float> test_signal(size_t n_samples) {
+    std::vector<float> out(n_samples);
+    uint32_t noise = 12345;
+    double phase = 0.0;
+    for (size_t i = 0; i < n_samples; ++i) {
+        const double t = (double) i / kSampleRate;
+        phase += 2.0 * M_PI * (140.0 + 40.0 * std::sin(2.0 * M_PI * 0.7 * t)) / kSampleRate;
+        double v = 0.0;
+        for (int h = 1; h <= 8; ++h) {
+            v += std::sin(h * phase) / h;
+        }
+        const double envelope = 0.5 + 0.5 * std::sin(2.0 * M_PI * 4.0 * t);
+        noise = noise * 1664525u + 1013904223u;
+        out[i] = (float) (0.2 * envelope * v + 0.01 * ((double) (noise >> 8) / (1 << 24) - 0.5));
+    }
+    return out;
+}
+
+// Log softmax of the decoder's logits after the transcription prompt
+static bool next_token_log_probs(whisper_context* ctx, whisper_state* state, std::vector<float>* out) {
+    std::vector<whisper_token> prompt = {whisper_token_sot(ctx)};
+    if (whisper_is_multilingual(ctx)) {
+        prompt.push_back(whisper_token_lang(ctx, whisper_lang_id("en")));
+        prompt.push_back(whisper_token_transcribe(ctx));
+    }
+    prompt.push_back(whisper_token_not(ctx));
+
+    // The last token alone, so its logits are the only row whatever the
+    // whisper.cpp version returns
+    const int n_prefix = (int) prompt.size() - 1;
+    if (whisper_encode_with_state(ctx, state, 0, kThreads) != 0 ||
+        whisper_decode_with_state(ctx, state, prompt.data(), n_prefix, 0, kThreads) != 0 ||
+        whisper_decode_with_state(ctx, state, &prompt.back(), 1, n_prefix, kThreads) != 0) {
+        return false;
+    }
+
+    const int n_vocab = whisper_n_vocab(ctx);
+    const float* logits = whisper_get_logits_from_state(state);
+    const float max_logit = *std::max_element(logits, logits + n_vocab);
+    double sum = 0.0;
+    for (int i = 0; i < n_vocab; ++i) {
+        sum += std::exp((double) (logits[i] - max_logit));
+    }
+    const float log_sum = max_logit + (float) std::log(sum);
+    out->resize(n_vocab);
+    for (int i = 0; i < n_vocab; ++i) {
+        (*out)[i] = logits[i] - log_sum;
+    }
+    return true;
+}
+
+// compute() over samples[0, n_samples) must agree with whisper's own
+// spectrogram of the same samples
+static void check_window(whisper_context* ctx, whisper_state* reference, whisper_state* stream_state,
+                         LogMelStream* mel, const float* samples, size_t n_samples) {
+    int n_len = 0;
+    int n_audio_frames = 0;
+    const float* data = mel->compute(samples, n_samples, 1.0f, &n_len, &n_audio_frames);
+
+    CHECK(whisper_pcm_to_mel_with_state(ctx, reference, samples, (int) n_samples, kThreads) == 0);
+    CHECK(n_len == whisper_n_len_from_state(reference));
+    CHECK(whisper_set_mel_with_state(ctx, stream_state, data, n_len, mel->n_mels()) == 0);
+
+    std::vector<float> expected;
+    std::vector<float> actual;
+    CHECK(next_token_log_probs(ctx, reference, &expected));
+    CHECK(next_token_log_probs(ctx, stream_state, &actual));
+    if (expected.empty() || expected.size() != actual.size()) {
+        return;
+    }
+
+    float max_diff = 0.0f;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i] > kLikelyLogProb || actual[i] > kLikelyLogProb) {
+            max_diff = std::max(max_diff, std::fabs(expected[i] - actual[i]));
+        }
+    }
+    if (max_diff > kMaxLogProbDiff) {
+        fprintf(stderr, "window of %zu samples: log probabilities differ by %.3f\n", n_samples, max_diff);
+    }
+    CHECK(max_diff <= kMaxLogProbDiff);
+    CHECK(std::max_element(expected.begin(), expected.end()) - expected.begin() ==
+          std::max_element(actual.begin(), actual.end()) - actual.begin());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s MODEL\n", argv[0]);
+        return 1;
+    }
+    whisper_context_params cparams = whisper_context_default_params();
+    cparams.use_gpu = false;
+    whisper_context* ctx = whisper_init_from_file_with_params(argv[1], cparams);
+    if (!ctx) {
+        fprintf(stderr, "%s: no model, skipped\n", argv[1]);
+        return kSkipped;
+    }
+    whisper_state* reference = whisper_init_state(ctx);
+    whisper_state* stream_state = whisper_init_state(ctx);
+    CHECK(reference != nullptr && stream_state != nullptr);
+    if (!reference || !stream_state) {
+        whisper_free(ctx);
+        return check_result();
+    }
+
+    const std::vector<float> signal = test_signal((size_t) kSampleRate * 6);
+    LogMelStream mel;
+    mel.init(whisper_model_n_mels(ctx));
+
+    // Growing window, in steps that are not whole hops so the cached tail
+    // frames have to be redone
+    for (size_t n_samples : {16000u, 24123u, 40000u, 57777u}) {
+        check_window(ctx, reference, stream_state, &mel, signal.data(), n_samples);
+    }
+
+    // Head dropped by whole hops keeps the cache, by a part hop clears it;
+    // either way the result is the spectrogram of what is left
+    size_t start = 0;
+    for (size_t drop : {8000u, 1234u}) {
+        mel.drop_front(drop);
+        start += drop;
+        check_window(ctx, reference, stream_state, &mel, signal.data() + start, 72000 - start);
+    }
+
+    whisper_free_state(stream_state);
+    whisper_free_state(reference);
+    whisper_free(ctx);
+    return check_result();
+}
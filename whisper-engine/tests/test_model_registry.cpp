@@ -0,0 +1,72 @@
+// kManifest in model_registry.cpp must match models/manifest.json entry for
+// entry; scripts/build_models.py regenerates the one from the other.
+
+#include "check.h"
+#include "model_registry.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Value of "field" inside the object of model name in the manifest text: a
+// string's contents, or a number's digits. Empty when absent.
+static std::string manifest_field(const std::string& text, const std::string& name, const std::string& field) {
+    const size_t object = text.find("\"" + name + "\": {");
+    if (object == std::string::npos) {
+        return "";
+    }
+    const size_t object_end = text.find('}', object);
+    const size_t key = text.find("\"" + field + "\":", object);
+    if (key == std::string::npos || key > object_end) {
+        return "";
+    }
+    size_t pos = key + field.size() + 3;
+    while (pos < text.size() && text[pos] == ' ') {
+        ++pos;
+    }
+    if (text[pos] == '"') {
+        const size_t close = text.find('"', pos + 1);
+        return text.substr(pos + 1, close - pos - 1);
+    }
+    size_t end = pos;
+    while (end < text.size() && isdigit((unsigned char) text[end])) {
+        ++end;
+    }
+    return text.substr(pos, end - pos);
+}
+
+static bool is_sha256_hex(const char* hash) {
+    if (strlen(hash) != 64) {
+        return false;
+    }
+    for (const char* c = hash; *c; ++c) {
+        if (!isdigit((unsigned char) *c) && (*c < 'a' || *c > 'f')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    std::ifstream file(VB_MANIFEST_PATH);
+    CHECK(file.good());
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string manifest = buffer.str();
+
+    for (int type = 0; type < VB_MODEL_TYPE_COUNT; ++type) {
+        const ModelSpec* spec = model_registry_spec((vb_model_type_t) type);
+        CHECK(spec != nullptr);
+        if (!spec) {
+            continue;
+        }
+        CHECK(manifest_field(manifest, spec->name, "filename") == spec->filename);
+        CHECK(manifest_field(manifest, spec->name, "url") == spec->url);
+        CHECK(manifest_field(manifest, spec->name, "sha256") == spec->sha256);
+        CHECK(strtoll(manifest_field(manifest, spec->name, "size_bytes").c_str(), nullptr, 10) == spec->size_bytes);
+        CHECK(spec->sha256[0] == '\0' || is_sha256_hex(spec->sha256));
+    }
+    return check_result();
+}
@@ -0,0 +1,191 @@
+// speculative_decode against plain greedy decoding, on a fake whisper: the
+// decoder functions speculative_decoder.cpp calls are defined here over a
+// toy model whose logits are a hash of the token prefix, with the decoder
+// cache semantics of whisper_decode_with_state (n_past keeps a prefix of what
+// the state has seen, and every input token gets a row of logits).
+
+#include "check.h"
+#include "speculative_decoder.h"
+#include <cstdint>
+#include <vector>
+
+static const int kVocab = 64;
+static const whisper_token kBlank = 1;
+static const whisper_token kEot = 50;                // text tokens below, specials above
+static const whisper_token kSot = 51;
+static const whisper_token kNot = 52;
+static const whisper_token kPrev = 53;
+static const int kTextCtx = 96;
+static const size_t kEotAfter = 40;                  // prefix length at which the target ends the text
+
+struct whisper_context {
+    bool draft;                                      // disagrees with the target at every 4th position
+};
+
+struct whisper_state {
+    std::vector<whisper_token> cache;
+    std::vector<float> logits;
+    int n_calls = 0;
+};
+
+static uint32_t prefix_hash(const whisper_token* tokens, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ (uint32_t) tokens[i]) * 16777619u;
+    }
+    return h;
+}
+
+static whisper_token target_choice(const whisper_token* prefix, size_t n) {
+    if (n >= kEotAfter) {
+        return kEot;
+    }
+    return (whisper_token) (2 + prefix_hash(prefix, n) % (kEot - 2));
+}
+
+static whisper_token model_choice(const whisper_context* ctx, const whisper_token* prefix, size_t n) {
+    const whisper_token choice = target_choice(prefix, n);
+    if (ctx->draft && n % 4 == 2) {
+        return choice == kEot ? 2 : (whisper_token) (2 + (choice - 1) % (kEot - 2));
+    }
+    return choice;
+}
+
+static void fill_logits(const whisper_context* ctx, const whisper_token* prefix, size_t n, float* row) {
+    const whisper_token choice = model_choice(ctx, prefix, n);
+    const uint32_t h = prefix_hash(prefix, n);
+    for (int i = 0; i < kVocab; ++i) {
+        row[i] = (float) ((h >> (i % 24)) & 0xff) / 256.0f;
+    }
+    row[choice] = 4.0f;
+}
+
+extern "C" {
+
+int whisper_n_vocab(whisper_context*) { return kVocab; }
+int whisper_n_text_ctx(whisper_context*) { return kTextCtx; }
+int whisper_is_multilingual(whisper_context*) { return 0; }
+whisper_token whisper_token_eot(whisper_context*) { return kEot; }
+whisper_token whisper_token_sot(whisper_context*) { return kSot; }
+whisper_token whisper_token_not(whisper_context*) { return kNot; }
+whisper_token whisper_token_prev(whisper_context*) { return kPrev; }
+whisper_token whisper_token_lang(whisper_context*, int) { return -1; }
+whisper_token whisper_token_transcribe(whisper_context*) { return -1; }
+int whisper_lang_id(const char*) { return 0; }
+
+int whisper_tokenize(whisper_context*, const char*, whisper_token* tokens, int n_max_tokens) {
+    if (n_max_tokens < 1) {
+        return -1;
+    }
+    tokens[0] = kBlank;
+    return 1;
+}
+
+int whisper_decode_with_state(whisper_context* ctx, whisper_state* state, const whisper_token* tokens,
+                              int n_tokens, int n_past, int /* n_threads */) {
+    if (n_tokens < 1 || n_past < 0 || n_past > (int) state->cache.size()) {
+        return -1;
+    }
+    ++state->n_calls;
+    state->cache.resize((size_t) n_past);
+    state->logits.assign((size_t) n_tokens * kVocab, 0.0f);
+    for (int i = 0; i < n_tokens; ++i) {
+        state->cache.push_back(tokens[i]);
+        fill_logits(ctx, state->cache.data(), state->cache.size(), state->logits.data() + (size_t) i * kVocab);
+    }
+    return 0;
+}
+
+float* whisper_get_logits_from_state(whisper_state* state) {
+    return state->logits.data();
+}
+
+} // extern "C"
+
+// One token per call, as whisper_full's greedy sampling does
+static std::vector<whisper_token> greedy_reference(const std::vector<whisper_token>& prompt) {
+    std::vector<whisper_token> seq(prompt);
+    std::vector<whisper_token> out;
+    while (true) {
+        const whisper_token choice = target_choice(seq.data(), seq.size());
+        if (choice == kEot) {
+            return out;
+        }
+        out.push_back(choice);
+        seq.push_back(choice);
+    }
+}
+
+// The stats speculative_decode must report when the draft always proposes
+// from the accepted text: the same rounds, replayed without decoder caches
+static SpeculativeStats expected_stats(const whisper_context* draft, const std::vector<whisper_token>& prompt,
+                                       int n_draft) {
+    SpeculativeStats stats;
+    std::vector<whisper_token> seq(prompt);
+    while (true) {
+        std::vector<whisper_token> proposal;
+        std::vector<whisper_token> context(seq);
+        while ((int) proposal.size() < n_draft) {
+            proposal.push_back(model_choice(draft, context.data(), context.size()));
+            if (proposal.back() == kEot) {
+                break;
+            }
+            context.push_back(proposal.back());
+        }
+        ++stats.n_target_calls;
+        stats.n_drafted += (int) proposal.size();
+
+        whisper_token next = target_choice(seq.data(), seq.size());
+        for (const whisper_token token : proposal) {
+            if (next != token) {
+                break;
+            }
+            ++stats.n_accepted;
+            if (next == kEot) {
+                return stats;
+            }
+            seq.push_back(next);
+            next = target_choice(seq.data(), seq.size());
+        }
+        if (next == kEot) {
+            return stats;
+        }
+        seq.push_back(next);
+    }
+}
+
+static void check_decode(const std::vector<whisper_token>& past, int n_draft) {
+    whisper_context target = {false};
+    whisper_context draft = {true};
+    whisper_state target_state;
+    whisper_state draft_state;
+
+    const std::vector<whisper_token> prompt = speculative_prompt(&target, past.data(), (int) past.size());
+    std::vector<whisper_token_data> tokens;
+    SpeculativeStats stats;
+    CHECK(speculative_decode(&target, &target_state, &draft, &draft_state, prompt, n_draft, 1, tokens, &stats));
+
+    const std::vector<whisper_token> expected = greedy_reference(prompt);
+    CHECK(tokens.size() == expected.size());
+    for (size_t i = 0; i < tokens.size() && i < expected.size(); ++i) {
+        CHECK(tokens[i].id == expected[i]);
+        CHECK(tokens[i].p > 0.0f && tokens[i].p <= 1.0f);
+    }
+
+    // A draft decoding from a stale cache proposes from the wrong text after
+    // a correction; the outputs would still match greedy, but the counts not
+    const SpeculativeStats expected_counts = expected_stats(&draft, prompt, n_draft);
+    CHECK(stats.n_target_calls == expected_counts.n_target_calls);
+    CHECK(stats.n_drafted == expected_counts.n_drafted);
+    CHECK(stats.n_accepted == expected_counts.n_accepted);
+}
+
+int main() {
+    const std::vector<whisper_token> no_past;
+    const std::vector<whisper_token> past = {7, 8, 9, 10, 11};
+    for (int n_draft : {1, 2, 3, 4, 6}) {
+        check_decode(no_past, n_draft);
+        check_decode(past, n_draft);
+    }
+    return check_result();
+}
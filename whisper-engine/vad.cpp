@@ -0,0 +1,101 @@
+#include "vad.h"
+#include <cmath>
+
+static const float kMinSpeechDb = -50.0f;      // absolute floor; quieter frames are never speech
+static const float kMaxSpeechZcr = 0.5f;       // broadband noise crosses zero on about every other sample
+static const int kNoiseInitFrames = 10;        // frames used to seed the noise floor
+static const float kNoiseAdaptRate = 0.05f;
+
+EnergyVad::EnergyVad(float threshold_db) : threshold_db_(threshold_db) {
+    reset();
+}
+
+void EnergyVad::reset() {
+    noise_floor_db_ = 0.0f;
+    n_frames_ = 0;
+}
+
+bool EnergyVad::is_speech(const float* frame, size_t n_samples) {
+    if (n_samples == 0) {
+        return false;
+    }
+
+    double energy = 0.0;
+    int crossings = 0;
+    for (size_t i = 0; i < n_samples; ++i) {
+        energy += (double) frame[i] * frame[i];
+        if (i > 0 && (frame[i] >= 0.0f) != (frame[i - 1] >= 0.0f)) {
+            ++crossings;
+        }
+    }
+
+    const float db = 10.0f * std::log10((float) (energy / n_samples) + 1e-10f);
+    const float zcr = (float) crossings / (float) n_samples;
+
+    // Seed the floor with the quietest of the first frames
+    if (n_frames_ < kNoiseInitFrames) {
+        noise_floor_db_ = n_frames_ == 0 ? db : std::fmin(noise_floor_db_, db);
+        ++n_frames_;
+        return false;
+    }
+
+    const bool loud = db > kMinSpeechDb && db > noise_floor_db_ + threshold_db_;
+    const bool speech = loud && (zcr < kMaxSpeechZcr || db > noise_floor_db_ + 2.0f * threshold_db_);
+
+    // Track the floor downwards immediately and upwards slowly during non-speech
+    if (db < noise_floor_db_) {
+        noise_floor_db_ = db;
+    } else if (!speech) {
+        noise_floor_db_ += kNoiseAdaptRate * (db - noise_floor_db_);
+    }
+
+    return speech;
+}
+
+CallbackVad::CallbackVad(vb_vad_classifier_t classifier, void* user_data)
+    : classifier_(classifier), user_data_(user_data) {}
+
+bool CallbackVad::is_speech(const float* frame, size_t n_samples) {
+    return classifier_ && classifier_(frame, (int32_t) n_samples, user_data_) >= 0.5f;
+}
+
+VadSegmenter::VadSegmenter(int min_speech_frames, int hangover_frames, int endpoint_frames)
+    : min_speech_frames_(min_speech_frames > 0 ? min_speech_frames : 1),
+      hangover_frames_(hangover_frames > 0 ? hangover_frames : 1),
+      endpoint_frames_(endpoint_frames > hangover_frames ? endpoint_frames : hangover_frames + 1) {}
+
+void VadSegmenter::reset() {
+    state_ = State::Silence;
+    speech_frames_ = 0;
+    silence_frames_ = 0;
+}
+
+VadSegmenter::Event VadSegmenter::push(bool is_speech, bool* keep_frame) {
+    silence_frames_ = is_speech ? 0 : silence_frames_ + 1;
+
+    if (state_ == State::Speech) {
+        *keep_frame = true;
+        if (silence_frames_ >= hangover_frames_) {
+            state_ = State::Trailing;
+            return Event::SpeechEnd;
+        }
+        return Event::None;
+    }
+
+    // Silence or trailing silence: frames are held back until speech is confirmed
+    *keep_frame = false;
+    speech_frames_ = is_speech ? speech_frames_ + 1 : 0;
+    if (speech_frames_ >= min_speech_frames_) {
+        state_ = State::Speech;
+        speech_frames_ = 0;
+        *keep_frame = true;
+        return Event::SpeechStart;
+    }
+
+    if (state_ == State::Trailing && silence_frames_ >= endpoint_frames_) {
+        state_ = State::Silence;
+        return Event::Endpoint;
+    }
+
+    return Event::None;
+}
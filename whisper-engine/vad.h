@@ -0,0 +1,68 @@
+#ifndef VAD_H
+#define VAD_H
+
+#include "../shared/types.h"
+#include <cstddef>
+#include <cstdint>
+
+// Frame-level speech/non-speech classifier. Implementations see consecutive
+// frames of the session in order and may keep adaptive state.
+class VoiceActivityDetector {
+public:
+    virtual ~VoiceActivityDetector() = default;
+    virtual void reset() = 0;
+    virtual bool is_speech(const float* frame, size_t n_samples) = 0;
+};
+
+// Energy + zero-crossing detector with an adaptive noise floor
+class EnergyVad : public VoiceActivityDetector {
+public:
+    explicit EnergyVad(float threshold_db);
+    void reset() override;
+    bool is_speech(const float* frame, size_t n_samples) override;
+
+private:
+    float threshold_db_;
+    float noise_floor_db_;
+    int n_frames_;
+};
+
+// Adapter for an application-supplied (e.g. model-based) classifier
+class CallbackVad : public VoiceActivityDetector {
+public:
+    CallbackVad(vb_vad_classifier_t classifier, void* user_data);
+    void reset() override {}
+    bool is_speech(const float* frame, size_t n_samples) override;
+
+private:
+    vb_vad_classifier_t classifier_;
+    void* user_data_;
+};
+
+// Turns per-frame decisions into speech start/end and utterance endpoint events
+class VadSegmenter {
+public:
+    enum class Event { None, SpeechStart, SpeechEnd, Endpoint };
+
+    VadSegmenter(int min_speech_frames, int hangover_frames, int endpoint_frames);
+    void reset();
+
+    // keep_frame is set when the frame belongs to speech (including hangover)
+    // and should reach the decoder
+    Event push(bool is_speech, bool* keep_frame);
+
+    bool in_speech() const { return state_ == State::Speech; }
+
+private:
+    enum class State { Silence, Speech, Trailing };
+
+    int min_speech_frames_;
+    int hangover_frames_;
+    int endpoint_frames_;
+
+    State state_ = State::Silence;
+    int speech_frames_ = 0;     // consecutive speech frames while not in speech
+    int silence_frames_ = 0;    // non-speech frames since the last speech frame
+};
+
+#endif // VAD_H
@@ -1,219 +1,2641 @@
 #include "whisper_engine.h"
 #include "whisper.h"
+#include "audio_ring_buffer.h"
+#include "audio_dsp.h"
+#include "compute_backend.h"
+#include "model_registry.h"
+#include "model_traits.h"
+#include "shared_transport.h"
+#include "device_benchmark.h"
+#include "cpu_scheduler.h"
+#include "metrics.h"
+#include "log_mel.h"
+#include "arena.h"
+#include "speculative_decoder.h"
+#include "vad.h"
 #include <iostream>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
-#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
 
-// Internal state
-struct WhisperEngineState {
-    whisper_context* ctx = nullptr;
+// Streaming defaults
+static const int32_t kDefaultPartialIntervalMs = 300;
+static const int32_t kMinDecodeSamples = WHISPER_SAMPLE_RATE;           // whisper needs >= 1s of audio
+static const int32_t kMinDecodeFrames = kMinDecodeSamples / WHISPER_HOP_LENGTH;
+static const int32_t kMaxWindowSamples = WHISPER_SAMPLE_RATE * 25;      // force a commit before the 30s encoder window
+static const int32_t kBatchWindowSamples = WHISPER_SAMPLE_RATE * 30;     // one encoder window in batch mode
+static const int32_t kBatchSplitSearchSamples = WHISPER_SAMPLE_RATE * 8; // pause search at the end of each window
+static const int32_t kBatchPauseFrames = 20;                             // quietest 200ms is the split point
+static const int32_t kDefaultRingBufferMs = 10000;
+static const size_t kCaptureBlockSamples = 4096;                       // device-rate samples resampled per pass
+// Largest resampler output of one block, upsampling from its lowest rate
+static const size_t kCaptureScratchSamples =
+    (kCaptureBlockSamples + Resampler::kTaps) * WHISPER_SAMPLE_RATE / Resampler::kMinRate + 1;
+static const int32_t kDefaultMaxThreads = 4;
+static const int32_t kDefaultMetricsIntervalMs = 5000;
+static const int32_t kDefaultResidencyIdleMs = 120000;
+static const int32_t kDefaultPromptHistoryTokens = 64;
+static const size_t kMaxVocabularyTokens = 96;                          // with the history, under whisper's n_text_ctx / 2
+static const int32_t kDefaultMaxQueueMs = 3000;
+
+// Dynamic audio context defaults
+static const int32_t kDefaultMinAudioCtxMs = 2000;
+static const int32_t kAudioCtxMarginMs = 500;                           // encoded past the last sample
+static const int32_t kAudioCtxStep = 64;                                // encoder positions, 1.28s
+static const int32_t kMaxTokensPerSecond = 12;                          // more is a decoder loop, not speech
+static const int32_t kReducedPassTokenSlack = 8;
+
+// VAD defaults
+static const int32_t kVadFrameSamples = WHISPER_SAMPLE_RATE / 50;       // 20ms frames
+static const int32_t kVadMinSpeechFrames = 3;
+static const int32_t kVadPrerollFrames = 15;                            // audio kept ahead of speech onset
+static const float kDefaultVadThresholdDb = 10.0f;
+static const int32_t kDefaultVadHangoverMs = 300;
+static const int32_t kDefaultVadEndpointMs = 800;
+static const int32_t kVadWakeMs = 200;                                  // longest the worker sleeps on undecided audio
+
+// One word of a streaming hypothesis, tagged with the segment and the tokens
+// it came from
+struct HypothesisWord {
+    std::string_view text;                       // into the pass arena
+    int segment;
+    size_t token_begin;                          // tokens [token_begin, token_end) spell the word
+    size_t token_end;
+};
+
+// Result of one decode pass, built in the session's pass arena and valid until
+// the next pass resets it
+struct Hypothesis {
+    explicit Hypothesis(Arena* arena = nullptr)
+        : tokens(arena), words(arena), segment_t0_ms(arena), segment_t1_ms(arena), segment_end_word(arena) {}
+    
+    ArenaVector<vb_token_t> tokens;              // text tokens; times relative to the window, text in the model vocabulary
+    ArenaVector<HypothesisWord> words;
+    ArenaVector<int64_t> segment_t0_ms;
+    ArenaVector<int64_t> segment_t1_ms;
+    ArenaVector<size_t> segment_end_word;        // index one past the last word of each segment
+};
+
+// Last pass of the session model over the streaming window. whisper_full
+// encodes on every call, and decoding an unchanged encoder output with an
+// unchanged prompt gives the same hypothesis, so the pass result is kept with
+// the window position and prompt it was computed for.
+struct EncoderCache {
+    bool valid = false;
+    int64_t offset_ms = 0;                       // window start of the pass
+    size_t n_samples = 0;                        // window length encoded
+    std::vector<whisper_token> prompt;
+    Hypothesis hyp;                              // in the pass arena; cleared when it resets
+};
+
+// Words of a hypothesis packed into one buffer. clear() keeps the capacity,
+// so once the window has held its longest hypothesis a pass rebuilds the
+// list without allocating.
+class WordList {
+public:
+    void clear() {
+        text_.clear();
+        ends_.clear();
+    }
+    void push_back(std::string_view word) {
+        text_.append(word);
+        ends_.push_back(text_.size());
+    }
+    size_t size() const { return ends_.size(); }
+    bool empty() const { return ends_.empty(); }
+    std::string_view operator[](size_t i) const {
+        const size_t begin = i == 0 ? 0 : ends_[i - 1];
+        return std::string_view(text_).substr(begin, ends_[i] - begin);
+    }
+    
+private:
+    std::string text_;
+    std::vector<size_t> ends_;                   // end offset of each word in text_
+};
+
+// Rolling window used by the streaming (partial results) mode
+struct StreamingWindow {
+    std::vector<float> samples;                  // audio that has not been committed yet
+    int64_t offset_ms = 0;                       // session time of samples[0]
+    WordList prev_words;                         // hypothesis of the previous decode pass
+    size_t n_committed_words = 0;                // words of the current window already emitted as final
+    bool has_committed_text = false;             // anything emitted as final in this session
+    size_t n_samples_at_last_decode = 0;
+    std::chrono::steady_clock::time_point last_decode;
+    bool awaiting_first_text = true;             // first-partial latency not yet recorded for this utterance
+    EncoderCache encoder;
+};
+
+// Wall-clock marks of a whisper_full pass, set from whisper's callbacks
+struct PassTimer {
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point encoder_begin;
+    std::chrono::steady_clock::time_point first_logits;
+    std::chrono::steady_clock::time_point end;
+    bool encoder_began = false;
+    bool got_logits = false;
+};
+
+// Preallocated decoder states. Each whisper_state owns its KV cache, mel
+// buffer and compute graphs, so they are built once and reused.
+struct StatePool {
+    std::mutex mutex;
+    std::vector<whisper_state*> all;
+    std::vector<whisper_state*> idle;
+};
+
+// Loaded model weights, shared read-only by any number of sessions
+struct vb_model {
+    std::atomic<int> refs{1};
+    vb_model_type_t type = VB_MODEL_TINY_EN;
+    whisper_context* ctx = nullptr;              // created without a default state
+    const ModelProfile* profile = nullptr;       // compile-time sizes of a shipped model, NULL for other files
+    vb_backend_t backend = VB_BACKEND_CPU;
+    StatePool states;
+    std::atomic<bool> resident{false};           // one reference is held by the residency cache
+    std::atomic<int> batched_logits{-1};         // whisper_decode returns every row: -1 not probed yet, 0 no, 1 yes
+};
+
+// Cached models, kept loaded for a while after their last user is gone
+struct ResidentModel {
+    vb_model* model = nullptr;                   // the cache's own reference
+    std::string path;
+    bool use_gpu = false;                        // as requested; the model may have fallen back to the CPU
+    bool idle = false;                           // only the cache holds the model
+    std::chrono::steady_clock::time_point idle_since;
+};
+
+struct ModelResidency {
+    std::mutex mutex;
+    std::condition_variable wake;                // reaper: idle set changed or config updated
+    std::vector<ResidentModel> models;
+    vb_residency_config_t config = {};
+    bool reaper_started = false;
+};
+
+// Silence gating ahead of whisper_full
+struct VadStage {
+    std::unique_ptr<VoiceActivityDetector> detector;
+    std::unique_ptr<VadSegmenter> segmenter;
+    std::vector<float> input;                    // audio drained from the ring, not yet framed
+    std::vector<float> held;                     // non-speech audio not yet decoded: pre-roll, or a whole pause
+    bool in_pause = false;                       // speech ended, endpoint not reached yet
+    int64_t n_session_samples = 0;               // samples classified so far
+};
+
+// One transcription session: its own config, queue, worker and decoder state
+struct vb_engine {
+    vb_model* model = nullptr;                   // retained while attached
+    whisper_context* ctx = nullptr;              // model->ctx, cached for the hot path
+    whisper_state* session_state = nullptr;      // held by the processing thread while transcribing
+    vb_model* session_model = nullptr;           // owner of session_state: model, or fallback_model after a downgrade
+    vb_model* rescore_model = nullptr;           // optional second-pass model for final text
+    whisper_state* rescore_state = nullptr;
+    vb_model* fallback_model = nullptr;          // faster model for VB_OVERLOAD_DOWNGRADE
     vb_engine_config_t config = {};
     vb_transcription_callback_t transcription_callback = nullptr;
     vb_error_callback_t error_callback = nullptr;
     void* user_data = nullptr;
+    vb_transport* transport = nullptr;           // results also go to another process
+    
+    std::atomic<bool> is_processing{false};
+    std::unique_ptr<std::thread> processing_thread;
+    
+    // Capture thread -> processing thread audio path
+    AudioRingBuffer audio_ring;
+    WakeupSignal audio_ready;
+    std::atomic<bool> consumer_waiting{false};
+    std::atomic<int> producers_in_flight{0};     // capture calls that may be touching the ring
+    size_t wake_threshold = 0;                   // samples that must be buffered before waking the worker
+    std::atomic<uint64_t> dropped_samples{0};
+    
+    // Processing thread -> blocked producer (VB_OVERLOAD_BLOCK)
+    WakeupSignal space_ready;
+    std::atomic<bool> producer_waiting{false};
+    bool overloaded = false;                     // processing thread: backlog over max_queue_ms
+    
+    // Ingest preprocessing; written by the capture thread only
+    float pre_emphasis_prev = 0.0f;
+    std::atomic<float> level_peak{0.0f};
+    std::atomic<double> level_sum_squares{0.0};
+    std::atomic<uint64_t> level_n_samples{0};
+    std::vector<float> normalize_scratch;        // gain-adjusted copy handed to whisper
+    Resampler capture_resampler;                 // device rate -> 16kHz for vb_engine_process_capture
+    std::vector<float> capture_scratch;          // resampled block on its way into the ring
+    std::atomic<float> input_rms{0.0f};          // of the most recent capture buffer
+    std::atomic<float> input_peak{0.0f};
+    
+    StreamingWindow stream;
+    LogMelStream mel;                            // spectrogram of stream.samples, kept across decodes
+    Arena arena;                                 // transient data of the current decode pass
+    std::vector<float> batch_samples;            // audio accumulated in batch mode
+    int64_t batch_offset_samples = 0;            // session time of batch_samples[0], in samples
+    
+    // Decoder prompt: seeded vocabulary, then committed text that has left the window
+    std::string vocabulary;
+    std::vector<whisper_token> vocabulary_tokens;
+    std::vector<whisper_token> history_tokens;   // capped at prompt_history_tokens
+    std::vector<whisper_token> prompt_tokens;    // vocabulary_tokens + history_tokens
+    
+    ThreadTuner thread_tuner;                    // VB_THREADS_ADAPTIVE only
+    
+    EngineMetrics metrics;
+    PassTimer pass_timer;
+    std::chrono::steady_clock::time_point last_drain;
+    int64_t n_drained_samples = 0;               // session audio clock: samples taken from the ring
+    vb_metrics_callback_t metrics_callback = nullptr;
+    void* metrics_user_data = nullptr;
+    int32_t metrics_interval_ms = 0;
+    std::chrono::steady_clock::time_point last_metrics_report;
+    
+    VadStage vad;
+    vb_vad_callback_t vad_callback = nullptr;
+    void* vad_user_data = nullptr;
+    vb_vad_classifier_t vad_classifier = nullptr;
+    void* vad_classifier_user_data = nullptr;
+};
+
+// Session behind the original single-session API
+static vb_engine g_default_engine;
+
+// States whose last whisper_full pass ran with a reduced audio_ctx. whisper
+// keeps that size on the state for later whisper_encode calls and only
+// whisper_full changes it, so decoding outside whisper_full needs to know.
+static std::mutex g_reduced_ctx_mutex;
+static std::unordered_set<const whisper_state*> g_reduced_ctx_states;
+
+static void note_audio_ctx(const whisper_state* state, int audio_ctx) {
+    std::lock_guard<std::mutex> lock(g_reduced_ctx_mutex);
+    if (audio_ctx > 0) {
+        g_reduced_ctx_states.insert(state);
+    } else {
+        g_reduced_ctx_states.erase(state);
+    }
+}
+
+static bool encodes_full_window(const whisper_state* state) {
+    std::lock_guard<std::mutex> lock(g_reduced_ctx_mutex);
+    return g_reduced_ctx_states.count(state) == 0;
+}
+
+static void free_state(whisper_state* state) {
+    note_audio_ctx(state, 0);
+    whisper_free_state(state);
+}
+
+// Borrow an idle state from the model's pool. A new state is only created
+// when more sessions run at once than were preallocated.
+static whisper_state* acquire_state(vb_model* model) {
+    if (!model) {
+        return nullptr;
+    }
+    StatePool& pool = model->states;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if (pool.idle.empty()) {
+        whisper_state* state = whisper_init_state(model->ctx);
+        if (state) {
+            pool.all.push_back(state);
+        }
+        return state;
+    }
+    whisper_state* state = pool.idle.back();
+    pool.idle.pop_back();
+    return state;
+}
+
+static void release_state(vb_model* model, whisper_state* state) {
+    if (!model || !state) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(model->states.mutex);
+    model->states.idle.push_back(state);
+}
+
+// Free states no session is using; acquire_state recreates them on demand
+static void trim_idle_states(vb_model* model) {
+    StatePool& pool = model->states;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (whisper_state* state : pool.idle) {
+        pool.all.erase(std::find(pool.all.begin(), pool.all.end(), state));
+        free_state(state);
+    }
+    pool.idle.clear();
+}
+
+static void free_model(vb_model* model) {
+    for (whisper_state* state : model->states.all) {
+        free_state(state);
+    }
+    if (model->ctx) {
+        whisper_free(model->ctx);
+    }
+    delete model;
+}
+
+static int32_t config_or_default(int32_t value, int32_t fallback) {
+    return value > 0 ? value : fallback;
+}
+
+// Profile of the model the session decodes with, NULL on the generic path
+static const ModelProfile* session_profile(const vb_engine* e) {
+    const vb_model* model = e->session_model ? e->session_model : e->model;
+    return model ? model->profile : nullptr;
+}
+
+static int fixed_thread_count(const vb_engine* e) {
+    if (e->config.n_threads > 0) {
+        return e->config.n_threads;
+    }
+    const ModelProfile* profile = session_profile(e);
+    const int max_threads = profile ? profile->decode_threads : kDefaultMaxThreads;
+    return std::min<int>(max_threads, (int) std::max<size_t>(1, cpu_topology().performance_cores.size()));
+}
+
+static bool on_encoder_begin(whisper_context* /* ctx */, whisper_state* /* state */, void* user_data) {
+    PassTimer& timer = *static_cast<PassTimer*>(user_data);
+    timer.encoder_begin = std::chrono::steady_clock::now();
+    timer.encoder_began = true;
+    return true;
+}
+
+// Called after every decoder step; the first call marks the end of the encoder
+static void on_logits(whisper_context* /* ctx */, whisper_state* /* state */, const whisper_token_data* /* tokens */,
+                      int /* n_tokens */, float* /* logits */, void* user_data) {
+    PassTimer& timer = *static_cast<PassTimer*>(user_data);
+    if (!timer.got_logits) {
+        timer.first_logits = std::chrono::steady_clock::now();
+        timer.got_logits = true;
+    }
+}
+
+static int decode_thread_count(const vb_engine* e) {
+    return e->config.thread_policy == VB_THREADS_ADAPTIVE ? e->thread_tuner.threads() : fixed_thread_count(e);
+}
+
+static whisper_full_params make_decode_params(vb_engine* e) {
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    wparams.n_threads = decode_thread_count(e);
+    wparams.offset_ms = 0;
+    wparams.duration_ms = 0;
+    wparams.translate = false;
+    // Context comes only from the session's own prompt; a pooled state may
+    // still hold another session's tokens
+    wparams.no_context = true;
+    if (!e->prompt_tokens.empty()) {
+        wparams.prompt_tokens = e->prompt_tokens.data();
+        wparams.prompt_n_tokens = (int) e->prompt_tokens.size();
+    }
+    wparams.single_segment = false;
+    wparams.token_timestamps = true;
+    wparams.print_realtime = false;
+    wparams.print_progress = false;
+    wparams.print_timestamps = false;
+    wparams.print_special = false;
+    wparams.encoder_begin_callback = on_encoder_begin;
+    wparams.encoder_begin_callback_user_data = &e->pass_timer;
+    wparams.logits_filter_callback = on_logits;
+    wparams.logits_filter_callback_user_data = &e->pass_timer;
+    return wparams;
+}
+
+// Tokens of text, in the pass arena
+static ArenaVector<whisper_token> tokenize(vb_engine* e, whisper_context* ctx, const char* text) {
+    ArenaVector<whisper_token> tokens(std::strlen(text) + 1, 0, &e->arena);
+    const int n = whisper_tokenize(ctx, text, tokens.data(), (int) tokens.size());
+    tokens.resize(n > 0 ? n : 0);
+    return tokens;
+}
+
+static void rebuild_prompt(vb_engine* e) {
+    e->prompt_tokens = e->vocabulary_tokens;
+    e->prompt_tokens.insert(e->prompt_tokens.end(), e->history_tokens.begin(), e->history_tokens.end());
+}
+
+// Session start. Tokenized with the session model; the rescoring models share
+// its vocabulary.
+static void reset_prompt(vb_engine* e) {
+    e->history_tokens.clear();
+    e->vocabulary_tokens.clear();
+    if (!e->vocabulary.empty()) {
+        const ArenaVector<whisper_token> tokens = tokenize(e, e->ctx, (" " + e->vocabulary).c_str());
+        e->vocabulary_tokens.assign(tokens.begin(), tokens.end());
+        if (e->vocabulary_tokens.size() > kMaxVocabularyTokens) {
+            e->vocabulary_tokens.resize(kMaxVocabularyTokens);
+        }
+    }
+    rebuild_prompt(e);
+}
+
+// Committed text that will not be decoded again becomes context for the next
+// decodes. Only the most recent tokens are kept so the prompt stays bounded.
+static void append_history(vb_engine* e, const char* text) {
+    const int32_t cap = e->config.prompt_history_tokens < 0
+        ? 0 : config_or_default(e->config.prompt_history_tokens, kDefaultPromptHistoryTokens);
+    if (cap == 0 || text[0] == '\0') {
+        return;
+    }
+    
+    std::vector<whisper_token>& history = e->history_tokens;
+    const ArenaVector<whisper_token> tokens = tokenize(e, e->ctx, text);
+    history.insert(history.end(), tokens.begin(), tokens.end());
+    if (history.size() > (size_t) cap) {
+        history.erase(history.begin(), history.end() - cap);
+    }
+    rebuild_prompt(e);
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// whisper_full_with_state; wparams' callbacks must mark timer
+static int run_timed(whisper_context* ctx, whisper_state* state, const whisper_full_params& wparams,
+                     const float* samples, int n_samples, PassTimer& timer) {
+    timer = PassTimer();
+    timer.start = std::chrono::steady_clock::now();
+    const int result = whisper_full_with_state(ctx, state, wparams, samples, n_samples);
+    timer.end = std::chrono::steady_clock::now();
+    note_audio_ctx(state, wparams.audio_ctx);
+    return result;
+}
+
+// Stage times of a finished pass. n_audio excludes silence padding; mel_ms is
+// spectrogram time spent before the call.
+static PassTiming pass_timing(const PassTimer& timer, whisper_state* state, size_t n_audio, double mel_ms) {
+    const auto encoder_begin = timer.encoder_began ? timer.encoder_begin : timer.start;
+    const auto encoder_end = timer.got_logits ? timer.first_logits : timer.end;
+    
+    PassTiming pass;
+    pass.total_ms = elapsed_ms(timer.start, timer.end) + mel_ms;
+    pass.mel_ms = elapsed_ms(timer.start, encoder_begin) + mel_ms;
+    pass.encode_ms = elapsed_ms(encoder_begin, encoder_end);
+    pass.decode_ms = elapsed_ms(encoder_end, timer.end);
+    pass.audio_ms = (double) n_audio * 1000.0 / WHISPER_SAMPLE_RATE;
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int i = 0; i < n_segments; ++i) {
+        pass.n_tokens += whisper_full_n_tokens_from_state(state, i);
+    }
+    return pass;
+}
+
+// whisper_full_with_state, timed per stage for the metrics and the adaptive
+// thread policy. Only passes of the session model are fed to the tuner;
+// rescoring passes cost more.
+static int run_whisper(vb_engine* e, whisper_context* ctx, whisper_state* state,
+                       const whisper_full_params& wparams, const float* samples, int n_samples,
+                       size_t n_audio, double mel_ms) {
+    const int result = run_timed(ctx, state, wparams, samples, n_samples, e->pass_timer);
+    if (result != 0) {
+        return result;
+    }
+    
+    const PassTiming pass = pass_timing(e->pass_timer, state, n_audio, mel_ms);
+    e->metrics.record_pass(pass);
+    
+    if (ctx == e->ctx && e->config.thread_policy == VB_THREADS_ADAPTIVE) {
+        e->thread_tuner.record(wparams.n_threads, pass.total_ms, pass.audio_ms);
+    }
+    return result;
+}
+
+static void report_error(vb_engine* e, vb_status_t status, const char* message) {
+    if (e->error_callback) {
+        e->error_callback(status, message, e->user_data);
+    }
+    transport_write(e->transport, VB_MESSAGE_ERROR, status, 0, 0.0f, message);
+}
+
+// Geometric mean of the token probabilities, 1 without token data
+static float result_confidence(const vb_token_t* tokens, size_t n_tokens) {
+    if (n_tokens == 0) {
+        return 1.0f;
+    }
+    
+    double sum_log = 0.0;
+    for (size_t i = 0; i < n_tokens; ++i) {
+        sum_log += std::log(std::max(tokens[i].p, 1e-6f));
+    }
+    return (float) std::exp(sum_log / (double) n_tokens);
+}
+
+static void emit_result(vb_engine* e, const char* text, int64_t timestamp_ms, bool is_final,
+                        const vb_token_t* tokens = nullptr, size_t n_tokens = 0) {
+    if (!e->transcription_callback && !e->transport) {
+        return;
+    }
+    
+    const float confidence = result_confidence(tokens, n_tokens);
+    transport_write(e->transport, is_final ? VB_MESSAGE_FINAL : VB_MESSAGE_PARTIAL, VB_STATUS_SUCCESS,
+                    timestamp_ms, confidence, text);
+    if (!e->transcription_callback) {
+        return;
+    }
+    
+    vb_transcription_result_t result = {};
+    result.text = const_cast<char*>(text);
+    result.confidence = confidence;
+    result.timestamp_ms = timestamp_ms;
+    result.is_final = is_final;
+    result.tokens = tokens;
+    result.n_tokens = (int32_t) n_tokens;
+    e->transcription_callback(&result, e->user_data);
+}
+
+static ArenaString join_words(vb_engine* e, const ArenaVector<HypothesisWord>& words, size_t begin, size_t end) {
+    ArenaString text(&e->arena);
+    for (size_t i = begin; i < end; ++i) {
+        text += ' ';
+        text += words[i].text;
+    }
+    return text;
+}
+
+// Emit words [begin, end) of the hypothesis with their tokens, both moved to
+// session time by offset_ms, the start of the hypothesis' window. text
+// defaults to the joined words.
+static void emit_words(vb_engine* e, const Hypothesis& hyp, size_t begin, size_t end, int64_t offset_ms,
+                       bool is_final, const char* text = nullptr) {
+    const size_t token_begin = hyp.words[begin].token_begin;
+    const size_t token_end = hyp.words[end - 1].token_end;
+    ArenaVector<vb_token_t> tokens(hyp.tokens.begin() + token_begin, hyp.tokens.begin() + token_end, &e->arena);
+    for (vb_token_t& token : tokens) {
+        token.t0_ms += offset_ms;
+        token.t1_ms += offset_ms;
+    }
+    
+    const ArenaString joined = text ? ArenaString(&e->arena) : join_words(e, hyp.words, begin, end);
+    emit_result(e, text ? text : joined.c_str(), offset_ms + hyp.segment_t0_ms[hyp.words[begin].segment],
+                is_final, tokens.data(), tokens.size());
+}
+
+// Normalization gain for the audio seen so far, 1 when normalization is off
+static float decode_gain(const vb_engine* e) {
+    const vb_normalize_mode_t mode = e->config.normalize_mode;
+    if (mode == VB_NORMALIZE_NONE) {
+        return 1.0f;
+    }
+    
+    AudioLevelStats stats;
+    stats.peak = e->level_peak.load(std::memory_order_relaxed);
+    stats.sum_squares = e->level_sum_squares.load(std::memory_order_relaxed);
+    stats.n_samples = e->level_n_samples.load(std::memory_order_relaxed);
+    return dsp_normalization_gain(stats, mode, e->config.normalize_target);
+}
+
+// Apply the normalization gain. Returns samples unchanged when there is none.
+static const float* prepare_decode_input(vb_engine* e, const float* samples, size_t n_samples) {
+    const float gain = decode_gain(e);
+    if (gain == 1.0f) {
+        return samples;
+    }
+    
+    e->normalize_scratch.resize(n_samples);
+    dsp_scale(samples, e->normalize_scratch.data(), n_samples, gain);
+    return e->normalize_scratch.data();
+}
+
+// Encoder positions for n_samples of audio under dynamic_audio_ctx, 0 for the
+// full window. The audio plus a margin is rounded up to whole steps, so a
+// growing streaming window changes size only every step, and never goes below
+// the configured minimum: very short contexts cost whisper accuracy.
+static int dynamic_audio_ctx(const vb_engine* e, whisper_context* ctx, size_t n_samples) {
+    if (!e->config.dynamic_audio_ctx) {
+        return 0;
+    }
+    const int n_full = whisper_n_audio_ctx(ctx);
+    const int64_t position_ms = (int64_t) WHISPER_CHUNK_SIZE * 1000 / n_full;
+    const int64_t audio_ms = (int64_t) n_samples * 1000 / WHISPER_SAMPLE_RATE + kAudioCtxMarginMs;
+    const int64_t window_ms = std::max<int64_t>(audio_ms, config_or_default(e->config.min_audio_ctx_ms,
+                                                                             kDefaultMinAudioCtxMs));
+    const int64_t n_positions = (window_ms + position_ms - 1) / position_ms;
+    const int64_t n_ctx = (n_positions + kAudioCtxStep - 1) / kAudioCtxStep * kAudioCtxStep;
+    return n_ctx < n_full ? (int) n_ctx : 0;
+}
+
+// Whether a pass with a reduced audio context went the way short contexts
+// fail: a decoder loop that runs far past any speaking rate, or no text at
+// all from audio the VAD classified as speech. Such a pass is redone over the
+// full window.
+static bool reduced_pass_suspect(const vb_engine* e, whisper_context* ctx, whisper_state* state, size_t n_samples) {
+    const whisper_token eot = whisper_token_eot(ctx);
+    int64_t n_text_tokens = 0;
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int i = 0; i < n_segments; ++i) {
+        const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+        for (int j = 0; j < n_tokens; ++j) {
+            n_text_tokens += whisper_full_get_token_id_from_state(state, i, j) < eot ? 1 : 0;
+        }
+    }
+    
+    const int64_t max_tokens = kMaxTokensPerSecond * (int64_t) n_samples / WHISPER_SAMPLE_RATE + kReducedPassTokenSlack;
+    return n_text_tokens > max_tokens || (n_text_tokens == 0 && e->vad.detector);
+}
+
+// Hand the window to whisper as a spectrogram from the session's mel cache,
+// so only audio that arrived since the last decode is transformed. whisper
+// skips its own mel pass when given no samples.
+static int run_whisper_mel(vb_engine* e, whisper_context* ctx, whisper_state* state, whisper_full_params& wparams) {
+    const std::vector<float>& samples = e->stream.samples;
+    const auto start = std::chrono::steady_clock::now();
+    
+    int n_len = 0;
+    int n_audio_frames = 0;
+    const float* mel = e->mel.compute(samples.data(), samples.size(), decode_gain(e), &n_len, &n_audio_frames);
+    if (whisper_set_mel_with_state(ctx, state, mel, n_len, e->mel.n_mels()) != 0) {
+        return -1;
+    }
+    
+    // The silence padding would otherwise count as audio to decode; short
+    // windows still get the one second whisper requires
+    wparams.duration_ms = std::max(n_audio_frames, kMinDecodeFrames) * WHISPER_HOP_LENGTH * 1000 / WHISPER_SAMPLE_RATE;
+    
+    const double mel_ms = elapsed_ms(start, std::chrono::steady_clock::now());
+    return run_whisper(e, ctx, state, wparams, nullptr, 0, samples.size(), mel_ms);
+}
+
+// Every decode pass starts from an empty arena. The encoder cache is the only
+// arena data kept between passes, so it gives up its buffers and is invalidated.
+static void begin_pass(vb_engine* e) {
+    EncoderCache& cache = e->stream.encoder;
+    cache.valid = false;
+    cache.hyp = Hypothesis(&e->arena);
+    e->arena.reset();
+}
+
+// Close a segment made of tokens [first_token, end) of the hypothesis. Words
+// are views into an arena copy of its text, split at whitespace like whisper's
+// segment text.
+static void append_segment(vb_engine* e, Hypothesis& hyp, size_t first_token, int64_t t0_ms, int64_t t1_ms) {
+    const int index = (int) hyp.segment_end_word.size();
+    size_t length = 0;
+    for (size_t t = first_token; t < hyp.tokens.size(); ++t) {
+        length += std::strlen(hyp.tokens[t].text);
+    }
+    char* text = e->arena.allocate_array<char>(length);
+    
+    size_t pos = 0;
+    bool in_word = false;
+    for (size_t t = first_token; t < hyp.tokens.size(); ++t) {
+        for (const char* c = hyp.tokens[t].text; *c != '\0'; ++c, ++pos) {
+            text[pos] = *c;
+            if (std::isspace((unsigned char) *c)) {
+                in_word = false;
+                continue;
+            }
+            if (!in_word) {
+                hyp.words.push_back({std::string_view(text + pos, 0), index, t, t + 1});
+                in_word = true;
+            }
+            HypothesisWord& word = hyp.words.back();
+            word.text = std::string_view(word.text.data(), word.text.size() + 1);
+            word.token_end = t + 1;
+        }
+    }
+    hyp.segment_t0_ms.push_back(t0_ms);
+    hyp.segment_t1_ms.push_back(t1_ms);
+    hyp.segment_end_word.push_back(hyp.words.size());
+}
+
+// Tokens, words and segments of the last whisper_full pass on state
+static void read_hypothesis(vb_engine* e, whisper_context* ctx, whisper_state* state, Hypothesis& hyp) {
+    const whisper_token eot = whisper_token_eot(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int i = 0; i < n_segments; ++i) {
+        const int64_t t0_ms = whisper_full_get_segment_t0_from_state(state, i) * 10;
+        const int64_t t1_ms = whisper_full_get_segment_t1_from_state(state, i) * 10;
+        const size_t first_token = hyp.tokens.size();
+        
+        const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+        for (int j = 0; j < n_tokens; ++j) {
+            const whisper_token_data data = whisper_full_get_token_data_from_state(state, i, j);
+            if (data.id >= eot) {
+                continue;                        // timestamps and other special tokens
+            }
+            
+            // Token times are whisper's estimate, kept inside the segment
+            vb_token_t token = {};
+            token.id = data.id;
+            token.text = whisper_full_get_token_text_from_state(ctx, state, i, j);
+            token.t0_ms = data.t0 >= 0 ? std::min(std::max(data.t0 * 10, t0_ms), t1_ms) : t0_ms;
+            token.t1_ms = data.t1 >= 0 ? std::min(std::max(data.t1 * 10, token.t0_ms), t1_ms) : t1_ms;
+            token.p = data.p;
+            hyp.tokens.push_back(token);
+        }
+        append_segment(e, hyp, first_token, t0_ms, t1_ms);
+    }
+}
+
+// One whisper_full pass over the streaming window
+static int run_window_pass(vb_engine* e, whisper_context* ctx, whisper_state* state, whisper_full_params& wparams) {
+    StreamingWindow& stream = e->stream;
+    if (whisper_model_n_mels(ctx) == e->mel.n_mels()) {
+        return run_whisper_mel(e, ctx, state, wparams);
+    }
+    
+    // Pad short windows with silence; whisper rejects input under one second
+    const size_t n_samples = stream.samples.size();
+    if (n_samples < (size_t) kMinDecodeSamples) {
+        stream.samples.resize(kMinDecodeSamples, 0.0f);
+    }
+    
+    const float* input = prepare_decode_input(e, stream.samples.data(), stream.samples.size());
+    const int result = run_whisper(e, ctx, state, wparams, input, (int) stream.samples.size(), n_samples, 0.0);
+    stream.samples.resize(n_samples);
+    return result;
+}
+
+static bool decode_window(vb_engine* e, whisper_context* ctx, whisper_state* state, Hypothesis& hyp) {
+    StreamingWindow& stream = e->stream;
+    begin_pass(e);
+    
+    // Committed words still in the window are decoded again, so they are not
+    // part of the prompt yet
+    whisper_full_params wparams = make_decode_params(e);
+    wparams.audio_ctx = dynamic_audio_ctx(e, ctx, stream.samples.size());
+    
+    int result = run_window_pass(e, ctx, state, wparams);
+    if (result == 0 && wparams.audio_ctx > 0 && reduced_pass_suspect(e, ctx, state, stream.samples.size())) {
+        wparams.audio_ctx = 0;
+        result = run_window_pass(e, ctx, state, wparams);
+    }
+    
+    if (result != 0) {
+        report_error(e, VB_STATUS_ERROR, "Whisper processing failed");
+        return false;
+    }
+    
+    read_hypothesis(e, ctx, state, hyp);
+    return true;
+}
+
+// Whether the cached pass still describes the window: same start and prompt,
+// and at most max_new_samples of audio appended since
+static bool encoder_cache_covers(const vb_engine* e, size_t max_new_samples) {
+    const StreamingWindow& stream = e->stream;
+    const EncoderCache& cache = stream.encoder;
+    return cache.valid && cache.offset_ms == stream.offset_ms &&
+           stream.samples.size() >= cache.n_samples &&
+           stream.samples.size() - cache.n_samples <= max_new_samples &&
+           cache.prompt == e->prompt_tokens;
+}
+
+static void store_encoder_cache(vb_engine* e, const Hypothesis& hyp) {
+    EncoderCache& cache = e->stream.encoder;
+    cache.valid = true;
+    cache.offset_ms = e->stream.offset_ms;
+    cache.n_samples = e->stream.samples.size();
+    cache.prompt = e->prompt_tokens;
+    cache.hyp = hyp;
+}
+
+// Record speech onset -> first text once per utterance. The onset is the start
+// of the first segment with words, mapped to wall time through the audio clock
+// of the ring drains; the ring is filled in real time by the capture thread.
+static void note_first_text(vb_engine* e, const Hypothesis& hyp, size_t first_word) {
+    StreamingWindow& stream = e->stream;
+    if (!stream.awaiting_first_text || first_word >= hyp.words.size()) {
+        return;
+    }
+    stream.awaiting_first_text = false;
+    
+    const int64_t onset_ms = stream.offset_ms + hyp.segment_t0_ms[hyp.words[first_word].segment];
+    const int64_t drained_ms = e->n_drained_samples * 1000 / WHISPER_SAMPLE_RATE;
+    const double since_drain = elapsed_ms(e->last_drain, std::chrono::steady_clock::now());
+    e->metrics.record_first_partial(since_drain + (double) (drained_ms - onset_ms));
+}
+
+// Emit words [begin, end) of the hypothesis as final text
+static void commit_words(vb_engine* e, const Hypothesis& hyp, size_t begin, size_t end) {
+    StreamingWindow& stream = e->stream;
+    if (end <= begin) {
+        return;
+    }
+    
+    ArenaString text = join_words(e, hyp.words, begin, end);
+    if (!stream.has_committed_text) {
+        text.erase(0, 1);
+    }
+    emit_words(e, hyp, begin, end, stream.offset_ms, true, text.c_str());
+    stream.has_committed_text = true;
+}
+
+// Drop the audio and committed words of segments [0, n_segments) from the window
+static void trim_window(vb_engine* e, const Hypothesis& hyp, int n_segments) {
+    StreamingWindow& stream = e->stream;
+    if (n_segments <= 0) {
+        return;
+    }
+    
+    const int64_t cut_ms = hyp.segment_t1_ms[n_segments - 1];
+    const size_t cut_samples = std::min(stream.samples.size(),
+                                        (size_t) (cut_ms * WHISPER_SAMPLE_RATE / 1000));
+    const size_t cut_words = hyp.segment_end_word[n_segments - 1];
+    append_history(e, join_words(e, hyp.words, 0, cut_words).c_str());
+    
+    stream.samples.erase(stream.samples.begin(), stream.samples.begin() + cut_samples);
+    e->mel.drop_front(cut_samples);
+    stream.offset_ms += cut_ms;
+    stream.n_committed_words -= std::min(stream.n_committed_words, cut_words);
+    
+    stream.prev_words.clear();
+    for (size_t i = cut_words; i < hyp.words.size(); ++i) {
+        stream.prev_words.push_back(hyp.words[i].text);
+    }
+    stream.n_samples_at_last_decode = stream.samples.size();
+}
+
+// The sample buffer keeps its capacity for the next window
+static void reset_stream(vb_engine* e) {
+    std::vector<float> samples;
+    samples.swap(e->stream.samples);
+    samples.clear();
+    e->stream = StreamingWindow();
+    e->stream.samples.swap(samples);
+    e->stream.last_decode = std::chrono::steady_clock::now();
+    e->mel.reset();
+}
+
+// Start an empty window where the current one ends
+static void advance_window(vb_engine* e) {
+    StreamingWindow& stream = e->stream;
+    const bool has_committed_text = stream.has_committed_text;
+    const int64_t end_ms = stream.offset_ms +
+        (int64_t) stream.samples.size() * 1000 / WHISPER_SAMPLE_RATE;
+    reset_stream(e);
+    stream.offset_ms = end_ms;
+    stream.has_committed_text = has_committed_text;
+    stream.awaiting_first_text = false;          // same utterance continues
+}
+
+// Load the window into state as a spectrogram and run the encoder, for
+// decoding without whisper_full. *mel_ms gets the spectrogram time.
+static bool encode_window(vb_engine* e, whisper_context* ctx, whisper_state* state, int n_threads, double* mel_ms) {
+    std::vector<float>& samples = e->stream.samples;
+    const auto start = std::chrono::steady_clock::now();
+    
+    bool ok = false;
+    if (whisper_model_n_mels(ctx) == e->mel.n_mels()) {
+        int n_len = 0;
+        int n_audio_frames = 0;
+        const float* mel = e->mel.compute(samples.data(), samples.size(), decode_gain(e), &n_len, &n_audio_frames);
+        ok = whisper_set_mel_with_state(ctx, state, mel, n_len, e->mel.n_mels()) == 0;
+    } else {
+        const size_t n_samples = samples.size();
+        if (n_samples < (size_t) kMinDecodeSamples) {
+            samples.resize(kMinDecodeSamples, 0.0f);
+        }
+        const float* input = prepare_decode_input(e, samples.data(), samples.size());
+        ok = whisper_pcm_to_mel_with_state(ctx, state, input, (int) samples.size(), n_threads) == 0;
+        samples.resize(n_samples);
+    }
+    
+    *mel_ms += elapsed_ms(start, std::chrono::steady_clock::now());
+    return ok && whisper_encode_with_state(ctx, state, 0, n_threads) == 0;
+}
+
+// Cascade second pass by speculative decoding: the session model drafts, the
+// rescoring model verifies, and the text is the rescoring model's greedy
+// decode without timestamps. Returns false, leaving the pass to whisper_full,
+// when speculative decoding is off, the models do not share a vocabulary or
+// the whisper build cannot verify several tokens in one call. Without
+// WHISPER_BATCHED_LOGITS (whisper.cpp 1.5.4 as pinned) it never runs.
+static bool speculative_rescore(vb_engine* e, Hypothesis& hyp) {
+#if !defined(WHISPER_BATCHED_LOGITS)
+    (void) e;
+    (void) hyp;
+    return false;
+#else
+    vb_model* target = e->rescore_model;
+    if (e->config.draft_tokens <= 0 || !e->rescore_state || target->batched_logits.load() == 0 ||
+        whisper_n_vocab(target->ctx) != whisper_n_vocab(e->ctx)) {
+        return false;
+    }
+    
+    // whisper_encode would reuse the reduced audio context of an earlier
+    // whisper_full pass on either state
+    if (!encodes_full_window(e->rescore_state) || !encodes_full_window(e->session_state)) {
+        return false;
+    }
+    
+    // Probed once per model before paying for an encode; an unknown answer
+    // leaves this pass to whisper_full, which gives the state an encoding
+    const int n_threads = decode_thread_count(e);
+    if (target->batched_logits.load() < 0) {
+        const int supported = speculative_supported(target->ctx, e->rescore_state, n_threads);
+        if (supported >= 0) {
+            target->batched_logits = supported;
+        }
+        if (supported <= 0) {
+            return false;
+        }
+    }
+    
+    // A first pass over exactly this window left its encoder output in the
+    // session state
+    const bool draft_encoded = encoder_cache_covers(e, 0);
+    begin_pass(e);
+    
+    const auto start = std::chrono::steady_clock::now();
+    double mel_ms = 0.0;
+    if (!encode_window(e, target->ctx, e->rescore_state, n_threads, &mel_ms)) {
+        return false;
+    }
+    if (!draft_encoded && !encode_window(e, e->ctx, e->session_state, n_threads, &mel_ms)) {
+        return false;
+    }
+    const auto encoded = std::chrono::steady_clock::now();
+    
+    const std::vector<whisper_token> prompt =
+        speculative_prompt(target->ctx, e->prompt_tokens.data(), (int) e->prompt_tokens.size());
+    std::vector<whisper_token_data> tokens;
+    SpeculativeStats stats;
+    if (!speculative_decode(target->ctx, e->rescore_state, e->ctx, e->session_state, prompt,
+                            e->config.draft_tokens, n_threads, tokens, &stats)) {
+        return false;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    
+    PassTiming pass;
+    pass.total_ms = elapsed_ms(start, end);
+    pass.mel_ms = mel_ms;
+    pass.encode_ms = elapsed_ms(start, encoded) - mel_ms;
+    pass.decode_ms = elapsed_ms(encoded, end);
+    pass.audio_ms = (double) e->stream.samples.size() * 1000.0 / WHISPER_SAMPLE_RATE;
+    pass.n_tokens = (int) tokens.size();
+    pass.n_drafted = stats.n_drafted;
+    pass.n_accepted = stats.n_accepted;
+    e->metrics.record_pass(pass);
+    
+    // Without timestamps every token spans the window
+    const int64_t window_ms = (int64_t) pass.audio_ms;
+    for (const whisper_token_data& data : tokens) {
+        vb_token_t token = {};
+        token.id = data.id;
+        token.text = whisper_token_to_str(target->ctx, data.id);
+        token.t0_ms = 0;
+        token.t1_ms = window_ms;
+        token.p = data.p;
+        hyp.tokens.push_back(token);
+    }
+    append_segment(e, hyp, 0, 0, window_ms);
+    return true;
+#endif
+}
+
+// Second pass of the cascade: re-decode the whole window with the rescoring
+// model and commit its text. Falls back to the first-pass model when no
+// rescoring state is available.
+static void rescore_window(vb_engine* e) {
+    if (e->stream.samples.empty()) {
+        return;
+    }
+    
+    Hypothesis hyp(&e->arena);
+    bool ok = speculative_rescore(e, hyp);
+    if (!ok) {
+        ok = e->rescore_state
+            ? decode_window(e, e->rescore_model->ctx, e->rescore_state, hyp)
+            : decode_window(e, e->ctx, e->session_state, hyp);
+    }
+    if (ok) {
+        commit_words(e, hyp, 0, hyp.words.size());
+        append_history(e, join_words(e, hyp.words, 0, hyp.words.size()).c_str());
+    }
+}
+
+// Cascade first pass: the fast model's hypothesis is only ever shown as a
+// partial; final text comes from rescore_window
+static void cascade_decode_pass(vb_engine* e, const Hypothesis& hyp) {
+    StreamingWindow& stream = e->stream;
+    
+    note_first_text(e, hyp, 0);
+    if (!hyp.words.empty()) {
+        emit_words(e, hyp, 0, hyp.words.size(), stream.offset_ms, false);
+    }
+    
+    stream.prev_words.clear();
+    for (const auto& word : hyp.words) {
+        stream.prev_words.push_back(word.text);
+    }
+    
+    // The whole utterance stays in the window for the second pass, so it can
+    // only be cut once it fills the encoder
+    if (stream.samples.size() >= (size_t) kMaxWindowSamples) {
+        rescore_window(e);
+        advance_window(e);
+    }
+}
+
+// Re-decode the rolling window. Words that two consecutive passes agree on are
+// emitted as final; the rest of the hypothesis is emitted as a partial.
+static void streaming_decode_pass(vb_engine* e) {
+    StreamingWindow& stream = e->stream;
+    
+    // Until enough new audio has built up, the last encoder output stands in
+    // for the window and the partial it produced stays current
+    const size_t refresh_samples =
+        (size_t) std::max(0, e->config.encoder_refresh_ms) * WHISPER_SAMPLE_RATE / 1000;
+    if (refresh_samples > 0 && encoder_cache_covers(e, refresh_samples)) {
+        return;
+    }
+    
+    Hypothesis hyp(&e->arena);
+    if (!decode_window(e, e->ctx, e->session_state, hyp)) {
+        return;
+    }
+    store_encoder_cache(e, hyp);
+    
+    stream.last_decode = std::chrono::steady_clock::now();
+    stream.n_samples_at_last_decode = stream.samples.size();
+    
+    if (e->rescore_model) {
+        cascade_decode_pass(e, hyp);
+        return;
+    }
+    
+    // Local agreement: the longest common word prefix with the previous pass is stable
+    size_t n_stable = 0;
+    while (n_stable < hyp.words.size() && n_stable < stream.prev_words.size() &&
+           hyp.words[n_stable].text == stream.prev_words[n_stable]) {
+        ++n_stable;
+    }
+    
+    note_first_text(e, hyp, stream.n_committed_words);
+    
+    if (n_stable > stream.n_committed_words) {
+        commit_words(e, hyp, stream.n_committed_words, n_stable);
+        stream.n_committed_words = n_stable;
+    }
+    
+    if (stream.n_committed_words < hyp.words.size()) {
+        emit_words(e, hyp, stream.n_committed_words, hyp.words.size(), stream.offset_ms, false);
+    }
+    
+    stream.prev_words.clear();
+    for (const auto& word : hyp.words) {
+        stream.prev_words.push_back(word.text);
+    }
+    
+    // Trim audio behind the last segment that is fully committed, but always
+    // keep the segment currently being spoken in the window
+    const int n_segments = (int) hyp.segment_end_word.size();
+    int n_done = 0;
+    while (n_done < n_segments - 1 &&
+           hyp.segment_end_word[n_done] <= stream.n_committed_words) {
+        ++n_done;
+    }
+    
+    if (stream.samples.size() >= (size_t) kMaxWindowSamples) {
+        // A single segment that fills the window: commit it and start over
+        if (n_segments <= 1) {
+            commit_words(e, hyp, stream.n_committed_words, hyp.words.size());
+            append_history(e, join_words(e, hyp.words, 0, hyp.words.size()).c_str());
+            advance_window(e);
+            return;
+        }
+        
+        // The window is about to outgrow the encoder; commit all but the last segment
+        n_done = n_segments - 1;
+        commit_words(e, hyp, stream.n_committed_words, hyp.segment_end_word[n_done - 1]);
+        stream.n_committed_words = std::max(stream.n_committed_words, hyp.segment_end_word[n_done - 1]);
+    }
+    
+    trim_window(e, hyp, n_done);
+}
+
+// Decode whatever is left in the window and emit all of it as final
+static void streaming_flush(vb_engine* e) {
+    StreamingWindow& stream = e->stream;
+    if (stream.samples.size() <= stream.n_samples_at_last_decode && stream.prev_words.empty()) {
+        return;
+    }
+    
+    if (e->rescore_model) {
+        rescore_window(e);
+        stream.samples.clear();
+        stream.prev_words.clear();
+        return;
+    }
+    
+    // Stopping right after a pass leaves the window as it was encoded
+    Hypothesis hyp(&e->arena);
+    if (encoder_cache_covers(e, 0)) {
+        hyp = stream.encoder.hyp;
+    } else if (stream.samples.empty() || !decode_window(e, e->ctx, e->session_state, hyp)) {
+        return;
+    }
+    
+    commit_words(e, hyp, std::min(stream.n_committed_words, hyp.words.size()), hyp.words.size());
+    append_history(e, join_words(e, hyp.words, 0, hyp.words.size()).c_str());
+    stream.samples.clear();
+    stream.prev_words.clear();
+    stream.n_committed_words = 0;
+}
+
+static int batch_worker_count(const vb_engine* e) {
+    const ModelProfile* profile = session_profile(e);
+    return config_or_default(e->config.batch_workers, profile ? profile->batch_workers : 1);
+}
+
+// End of the batch chunk starting at begin: the middle of the quietest 200ms
+// in the last seconds of its encoder window, so a split lands in a pause
+// rather than in a word. Everything left when it fits one window.
+static size_t find_chunk_end(const float* samples, size_t begin, size_t n_samples) {
+    const size_t window_end = begin + kBatchWindowSamples;
+    if (n_samples <= window_end) {
+        return n_samples;
+    }
+    
+    const size_t search_begin = window_end - kBatchSplitSearchSamples;
+    const int n_frames = kBatchSplitSearchSamples / WHISPER_HOP_LENGTH;
+    std::vector<double> energy(n_frames);
+    for (int i = 0; i < n_frames; ++i) {
+        const float* frame = samples + search_begin + (size_t) i * WHISPER_HOP_LENGTH;
+        double sum = 0.0;
+        for (int k = 0; k < WHISPER_HOP_LENGTH; ++k) {
+            sum += (double) frame[k] * frame[k];
+        }
+        energy[i] = sum;
+    }
+    
+    // Sliding sum over kBatchPauseFrames; on ties the later pause wins, which
+    // keeps chunks long
+    double run = 0.0;
+    for (int i = 0; i < kBatchPauseFrames; ++i) {
+        run += energy[i];
+    }
+    double best = run;
+    int best_start = 0;
+    for (int i = kBatchPauseFrames; i < n_frames; ++i) {
+        run += energy[i] - energy[i - kBatchPauseFrames];
+        if (run <= best) {
+            best = run;
+            best_start = i - kBatchPauseFrames + 1;
+        }
+    }
+    return search_begin + (size_t) (best_start + kBatchPauseFrames / 2) * WHISPER_HOP_LENGTH;
+}
+
+// One piece of a batch recording and the state decoding it
+struct BatchChunk {
+    size_t begin = 0;
+    size_t n_samples = 0;
+    whisper_state* state = nullptr;
+    PassTimer timer;
+    int result = -1;
+};
+
+// Decode up to n_chunks chunks at once, each on its own state of the decoding
+// model, with the cores split between them. The session state takes the first
+// chunk on this thread; the others borrow pool states, and the round shrinks
+// to the states the pool can give. All chunks see the prompt as it stands
+// before the round. Returns the number of chunks decoded.
+static size_t decode_batch_round(vb_engine* e, const float* input, BatchChunk* chunks, size_t n_chunks) {
+    begin_pass(e);
+    
+    // Batch output is all final, so the cascade goes straight to the second pass
+    whisper_context* ctx = e->ctx;
+    vb_model* model = e->session_model;
+    whisper_state* own_state = e->session_state;
+    if (e->rescore_state) {
+        ctx = e->rescore_model->ctx;
+        model = e->rescore_model;
+        own_state = e->rescore_state;
+    }
+    
+    chunks[0].state = own_state;
+    for (size_t i = 1; i < n_chunks; ++i) {
+        chunks[i].state = acquire_state(model);
+        if (!chunks[i].state) {
+            n_chunks = i;
+        }
+    }
+    
+    const whisper_full_params base = make_decode_params(e);
+    auto run_chunk = [&](BatchChunk& chunk) {
+        whisper_full_params wparams = base;
+        wparams.n_threads = std::max(1, base.n_threads / (int) n_chunks);
+        wparams.encoder_begin_callback_user_data = &chunk.timer;
+        wparams.logits_filter_callback_user_data = &chunk.timer;
+        wparams.audio_ctx = dynamic_audio_ctx(e, ctx, chunk.n_samples);
+        chunk.result = run_timed(ctx, chunk.state, wparams, input + chunk.begin,
+                                 (int) chunk.n_samples, chunk.timer);
+        if (chunk.result == 0 && wparams.audio_ctx > 0 &&
+            reduced_pass_suspect(e, ctx, chunk.state, chunk.n_samples)) {
+            wparams.audio_ctx = 0;
+            chunk.result = run_timed(ctx, chunk.state, wparams, input + chunk.begin,
+                                     (int) chunk.n_samples, chunk.timer);
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < n_chunks; ++i) {
+        workers.emplace_back(run_chunk, std::ref(chunks[i]));
+    }
+    run_chunk(chunks[0]);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    
+    // Stitch in order, shifting segment times by each chunk's position
+    for (size_t i = 0; i < n_chunks; ++i) {
+        BatchChunk& chunk = chunks[i];
+        if (chunk.result != 0) {
+            report_error(e, VB_STATUS_ERROR, "Whisper processing failed");
+        } else {
+            const PassTiming pass = pass_timing(chunk.timer, chunk.state, chunk.n_samples, 0.0);
+            e->metrics.record_pass(pass);
+            if (n_chunks == 1 && ctx == e->ctx && e->config.thread_policy == VB_THREADS_ADAPTIVE) {
+                e->thread_tuner.record(base.n_threads, pass.total_ms, pass.audio_ms);
+            }
+            
+            const int64_t offset_ms = (e->batch_offset_samples + (int64_t) chunk.begin) * 1000 / WHISPER_SAMPLE_RATE;
+            Hypothesis hyp(&e->arena);
+            read_hypothesis(e, ctx, chunk.state, hyp);
+            size_t begin = 0;
+            for (const size_t end : hyp.segment_end_word) {
+                if (end > begin) {
+                    const ArenaString text = join_words(e, hyp.words, begin, end);
+                    emit_words(e, hyp, begin, end, offset_ms, true, text.c_str());
+                    append_history(e, text.c_str());
+                }
+                begin = end;
+            }
+        }
+        if (i > 0) {
+            release_state(model, chunk.state);
+        }
+    }
+    return n_chunks;
+}
+
+// Decode batch audio in chunks of at most one encoder window, split at
+// pauses, batch_workers chunks at a time. Until the utterance is final only
+// whole rounds of chunks that can no longer grow are taken; the rest stays
+// in pending for more audio.
+static void decode_batch(vb_engine* e, std::vector<float>& pending, bool final) {
+    std::vector<BatchChunk> chunks;
+    size_t begin = 0;
+    while (begin < pending.size()) {
+        const size_t end = find_chunk_end(pending.data(), begin, pending.size());
+        if (end == pending.size() && !final) {
+            break;
+        }
+        BatchChunk chunk;
+        chunk.begin = begin;
+        chunk.n_samples = end - begin;
+        chunks.push_back(chunk);
+        begin = end;
+    }
+    
+    const size_t n_workers = (size_t) batch_worker_count(e);
+    if (!final) {
+        chunks.resize(chunks.size() / n_workers * n_workers);
+    }
+    if (chunks.empty()) {
+        return;
+    }
+    
+    // whisper needs a second of audio; only the last chunk can be shorter
+    BatchChunk& last = chunks.back();
+    if (last.n_samples < (size_t) kMinDecodeSamples) {
+        pending.resize(last.begin + kMinDecodeSamples, 0.0f);
+        last.n_samples = kMinDecodeSamples;
+    }
+    
+    const size_t n_consumed = last.begin + last.n_samples;
+    const float* input = prepare_decode_input(e, pending.data(), n_consumed);
+    for (size_t first = 0; first < chunks.size();) {
+        first += decode_batch_round(e, input, chunks.data() + first, std::min(n_workers, chunks.size() - first));
+    }
+    
+    pending.erase(pending.begin(), pending.begin() + n_consumed);
+    e->batch_offset_samples += (int64_t) n_consumed;
+}
+
+// Move everything buffered in the ring to the end of dst
+static size_t drain_audio_ring(vb_engine* e, std::vector<float>& dst) {
+    const size_t n = e->audio_ring.available();
+    if (n == 0) {
+        return 0;
+    }
+    e->metrics.record_queue_depth((double) n * 1000.0 / WHISPER_SAMPLE_RATE);
+    
+    const size_t old_size = dst.size();
+    dst.resize(old_size + n);
+    const size_t n_read = e->audio_ring.read(dst.data() + old_size, n);
+    if (e->producer_waiting.exchange(false)) {
+        e->space_ready.notify();
+    }
+    e->last_drain = std::chrono::steady_clock::now();
+    e->n_drained_samples += (int64_t) n_read;
+    return n_read;
+}
+
+static void report_metrics(vb_engine* e) {
+    if (!e->metrics_callback) {
+        return;
+    }
+    vb_engine_metrics_t metrics;
+    e->metrics.snapshot(e->dropped_samples.load(), &metrics);
+    e->metrics_callback(&metrics, e->metrics_user_data);
+    e->last_metrics_report = std::chrono::steady_clock::now();
+}
+
+static void report_metrics_if_due(vb_engine* e) {
+    if (e->metrics_callback &&
+        std::chrono::steady_clock::now() - e->last_metrics_report >=
+            std::chrono::milliseconds(config_or_default(e->metrics_interval_ms, kDefaultMetricsIntervalMs))) {
+        report_metrics(e);
+    }
+}
+
+// Sleep until the producer has buffered wake_threshold samples or stop is requested
+static void wait_for_audio(vb_engine* e) {
+    while (e->is_processing &&
+           e->audio_ring.available() < e->wake_threshold) {
+        e->consumer_waiting.store(true);
+        // Re-check after publishing the flag so a producer that missed it has not
+        // left us waiting on audio that is already there
+        if (!e->is_processing ||
+            e->audio_ring.available() >= e->wake_threshold) {
+            e->consumer_waiting.store(false);
+            break;
+        }
+        e->audio_ready.wait();
+    }
+}
+
+static void emit_vad_event(vb_engine* e, vb_vad_event_type_t type, int64_t sample_pos) {
+    if (!e->vad_callback) {
+        return;
+    }
+    vb_vad_event_t event = {};
+    event.type = type;
+    event.timestamp_ms = sample_pos * 1000 / WHISPER_SAMPLE_RATE;
+    e->vad_callback(&event, e->vad_user_data);
+}
+
+static void setup_vad(vb_engine* e) {
+    VadStage& vad = e->vad;
+    const vb_engine_config_t& config = e->config;
+    
+    vad.detector.reset();
+    vad.segmenter.reset();
+    if (config.vad_mode == VB_VAD_ENERGY) {
+        vad.detector.reset(new EnergyVad(config.vad_threshold_db > 0.0f
+                                             ? config.vad_threshold_db : kDefaultVadThresholdDb));
+    } else if (config.vad_mode == VB_VAD_CUSTOM && e->vad_classifier) {
+        vad.detector.reset(new CallbackVad(e->vad_classifier,
+                                           e->vad_classifier_user_data));
+    }
+    if (!vad.detector) {
+        return;
+    }
+    
+    const int32_t frame_ms = kVadFrameSamples * 1000 / WHISPER_SAMPLE_RATE;
+    vad.segmenter.reset(new VadSegmenter(
+        kVadMinSpeechFrames,
+        config_or_default(config.vad_hangover_ms, kDefaultVadHangoverMs) / frame_ms,
+        config_or_default(config.vad_endpoint_ms, kDefaultVadEndpointMs) / frame_ms));
+    
+    vad.input.clear();
+    vad.held.clear();
+    vad.in_pause = false;
+    vad.n_session_samples = 0;
+}
+
+// Decode and emit everything buffered for the current utterance as final
+static void finalize_utterance(vb_engine* e, std::vector<float>& pending, bool streaming) {
+    if (streaming) {
+        streaming_flush(e);
+        StreamingWindow& stream = e->stream;
+        const bool has_committed_text = stream.has_committed_text;
+        reset_stream(e);
+        stream.has_committed_text = has_committed_text;
+        return;
+    }
+    
+    decode_batch(e, pending, true);
+}
+
+// Classify drained audio frame by frame; only speech (plus pre-roll and
+// hangover) is appended to pending. A pause that ends before the endpoint is
+// replayed whole, so pending stays contiguous in session time. Endpoints
+// finalize the utterance inline.
+static void run_vad(vb_engine* e, std::vector<float>& pending, bool streaming) {
+    VadStage& vad = e->vad;
+    const size_t max_preroll = (size_t) kVadPrerollFrames * kVadFrameSamples;
+    
+    size_t pos = 0;
+    for (; pos + kVadFrameSamples <= vad.input.size(); pos += kVadFrameSamples) {
+        const float* frame = vad.input.data() + pos;
+        const bool is_speech = vad.detector->is_speech(frame, kVadFrameSamples);
+        
+        bool keep = false;
+        const VadSegmenter::Event event = vad.segmenter->push(is_speech, &keep);
+        
+        if (event == VadSegmenter::Event::SpeechStart) {
+            // A new utterance starts its time base where the VAD picked it up
+            const int64_t start = vad.n_session_samples - (int64_t) vad.held.size();
+            if (pending.empty()) {
+                if (streaming) {
+                    e->stream.offset_ms = start * 1000 / WHISPER_SAMPLE_RATE;
+                } else {
+                    e->batch_offset_samples = start;
+                }
+            }
+            pending.insert(pending.end(), vad.held.begin(), vad.held.end());
+            vad.held.clear();
+            vad.in_pause = false;
+            // Speech began with the first of the frames that confirmed it
+            emit_vad_event(e, VB_VAD_EVENT_SPEECH_START,
+                           vad.n_session_samples - (int64_t) (kVadMinSpeechFrames - 1) * kVadFrameSamples);
+        }
+        
+        if (keep) {
+            pending.insert(pending.end(), frame, frame + kVadFrameSamples);
+        } else {
+            vad.held.insert(vad.held.end(), frame, frame + kVadFrameSamples);
+            if (!vad.in_pause && vad.held.size() > max_preroll) {
+                vad.held.erase(vad.held.begin(), vad.held.end() - max_preroll);
+            }
+        }
+        
+        vad.n_session_samples += kVadFrameSamples;
+        
+        if (event == VadSegmenter::Event::SpeechEnd) {
+            vad.in_pause = true;
+            emit_vad_event(e, VB_VAD_EVENT_SPEECH_END, vad.n_session_samples);
+        } else if (event == VadSegmenter::Event::Endpoint) {
+            // The pause is dropped; its tail is the next utterance's pre-roll
+            vad.in_pause = false;
+            if (vad.held.size() > max_preroll) {
+                vad.held.erase(vad.held.begin(), vad.held.end() - max_preroll);
+            }
+            finalize_utterance(e, pending, streaming);
+            emit_vad_event(e, VB_VAD_EVENT_ENDPOINT, vad.n_session_samples);
+        }
+    }
+    
+    vad.input.erase(vad.input.begin(), vad.input.begin() + pos);
+}
+
+// Captured audio still waiting for a decode, beyond what the mode buffers by
+// design: the streaming window since the last pass, or batch audio past the
+// encoder windows of the round being filled
+static size_t decode_backlog(const vb_engine* e, const std::vector<float>& pending, bool streaming) {
+    const size_t queued = e->audio_ring.available();
+    if (streaming) {
+        const StreamingWindow& stream = e->stream;
+        return queued + stream.samples.size() - std::min(stream.samples.size(), stream.n_samples_at_last_decode);
+    }
+    const size_t buffered = queued + pending.size();
+    const size_t round = (size_t) kBatchWindowSamples * batch_worker_count(e);
+    return buffered > round ? buffered - round : 0;
+}
+
+// VB_OVERLOAD_DROP_OLDEST while streaming: the last pass's hypothesis becomes
+// final and the window restarts on its newest n_keep samples
+static void shed_window(vb_engine* e, size_t n_keep) {
+    StreamingWindow& stream = e->stream;
+    
+    ArenaString text(&e->arena);
+    for (size_t i = stream.n_committed_words; i < stream.prev_words.size(); ++i) {
+        text += ' ';
+        text += stream.prev_words[i];
+    }
+    ArenaString history(&e->arena);
+    for (size_t i = 0; i < stream.prev_words.size(); ++i) {
+        history += ' ';
+        history += stream.prev_words[i];
+    }
+    append_history(e, history.c_str());
+    if (!text.empty()) {
+        if (!stream.has_committed_text) {
+            text.erase(0, 1);
+        }
+        emit_result(e, text.c_str(), stream.offset_ms, true);
+        stream.has_committed_text = true;
+    }
+    
+    std::vector<float> samples;
+    samples.swap(stream.samples);
+    const size_t n_drop = samples.size() - std::min(samples.size(), n_keep);
+    samples.erase(samples.begin(), samples.begin() + n_drop);
+    
+    const int64_t start_ms = stream.offset_ms + (int64_t) n_drop * 1000 / WHISPER_SAMPLE_RATE;
+    const bool has_committed_text = stream.has_committed_text;
+    reset_stream(e);
+    stream.samples.swap(samples);
+    stream.offset_ms = start_ms;
+    stream.has_committed_text = has_committed_text;
+    stream.awaiting_first_text = false;
+}
+
+// VB_OVERLOAD_DOWNGRADE: decode with the fallback model for the rest of the
+// session. The English models share one vocabulary, so the prompt carries over.
+static bool downgrade_model(vb_engine* e) {
+    if (!e->fallback_model || e->session_model == e->fallback_model) {
+        return false;
+    }
+    whisper_state* state = acquire_state(e->fallback_model);
+    if (!state) {
+        return false;
+    }
+    
+    release_state(e->session_model, e->session_state);
+    e->session_state = state;
+    e->session_model = e->fallback_model;
+    e->ctx = e->fallback_model->ctx;
+    e->stream.encoder.valid = false;
+    return true;
+}
+
+static void report_overload(vb_engine* e, const std::string& message) {
+    e->metrics.record_overload();
+    report_error(e, VB_STATUS_OVERLOADED, message.c_str());
+}
+
+// Record the decode backlog and apply the overload policy once it exceeds
+// max_queue_ms. An overload is reported when it starts, and again for every
+// shed or model switch.
+static void check_overload(vb_engine* e, std::vector<float>& pending, bool streaming) {
+    const size_t backlog = decode_backlog(e, pending, streaming);
+    e->metrics.record_queue_lag((double) backlog * 1000.0 / WHISPER_SAMPLE_RATE);
+    
+    const size_t limit = (size_t) config_or_default(e->config.max_queue_ms, kDefaultMaxQueueMs) *
+        WHISPER_SAMPLE_RATE / 1000;
+    if (backlog <= limit) {
+        e->overloaded = false;
+        return;
+    }
+    
+    const bool started = !e->overloaded;
+    e->overloaded = true;
+    const std::string behind = "Decoding is " +
+        std::to_string((int64_t) backlog * 1000 / WHISPER_SAMPLE_RATE) + "ms behind";
+    
+    switch (e->config.overload_policy) {
+        case VB_OVERLOAD_DROP_OLDEST: {
+            // Shed down to half the limit so the session does not sit at the edge
+            size_t n_drop = backlog - limit / 2;
+            if (streaming) {
+                const StreamingWindow& stream = e->stream;
+                const size_t n_new = stream.samples.size() - std::min(stream.samples.size(), stream.n_samples_at_last_decode);
+                n_drop = std::min(n_drop, n_new);
+                shed_window(e, n_new - n_drop);
+            } else {
+                n_drop = std::min(n_drop, pending.size());
+                pending.erase(pending.begin(), pending.begin() + n_drop);
+                e->batch_offset_samples += (int64_t) n_drop;
+            }
+            e->dropped_samples += n_drop;
+            e->overloaded = false;
+            report_overload(e, behind + ", dropped " +
+                            std::to_string((int64_t) n_drop * 1000 / WHISPER_SAMPLE_RATE) + "ms of audio");
+            return;
+        }
+        case VB_OVERLOAD_DOWNGRADE:
+            if (downgrade_model(e)) {
+                report_overload(e, behind + ", switched to the fallback model");
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    
+    if (started) {
+        report_overload(e, behind);
+    }
+}
+
+// Return the session's states to their pools; a downgraded session goes back
+// to its own model
+static void release_session_states(vb_engine* e) {
+    release_state(e->session_model, e->session_state);
+    release_state(e->rescore_model, e->rescore_state);
+    e->session_state = nullptr;
+    e->rescore_state = nullptr;
+    e->session_model = nullptr;
+    e->ctx = e->model ? e->model->ctx : nullptr;
+}
+
+static void processing_thread_func(vb_engine* e) {
+    const bool streaming = e->config.enable_partial_results;
+    const auto interval = std::chrono::milliseconds(
+        e->config.partial_update_interval_ms > 0
+            ? e->config.partial_update_interval_ms
+            : kDefaultPartialIntervalMs);
+    
+    reset_stream(e);
+    reset_prompt(e);
+    e->batch_samples.clear();
+    e->batch_offset_samples = 0;
+    if (streaming && e->ctx) {
+        e->mel.init(whisper_model_n_mels(e->ctx));
+    }
+    e->n_drained_samples = 0;
+    e->overloaded = false;
+    e->last_drain = std::chrono::steady_clock::now();
+    e->last_metrics_report = e->last_drain;
+    
+    StreamingWindow& stream = e->stream;
+    std::vector<float>& pending = streaming ? stream.samples : e->batch_samples;
+    
+    setup_vad(e);
+    VadStage& vad = e->vad;
+    
+    // ggml's workers are spawned from this thread and inherit its affinity
+    if (e->config.thread_policy == VB_THREADS_ADAPTIVE) {
+        pin_to_performance_cores();
+        const int n_fast = (int) std::max<size_t>(1, cpu_topology().performance_cores.size());
+        e->thread_tuner.reset(e->config.n_threads > 0 ? std::min(e->config.n_threads, n_fast) : n_fast);
+    }
+    
+    // Hold one state for the whole session so nothing is allocated per utterance
+    e->session_state = acquire_state(e->model);
+    e->session_model = e->model;
+    e->rescore_state = acquire_state(e->rescore_model);
+    
+    // A shipped model's window sizes are known: allocate for them up front
+    // rather than growing the buffers during the first decodes
+    if (const ModelProfile* profile = session_profile(e)) {
+        const size_t window_samples = profile->window_frames * WHISPER_HOP_LENGTH;
+        e->arena.reserve(profile->arena_bytes);
+        e->normalize_scratch.reserve(window_samples);
+        if (streaming) {
+            stream.samples.reserve(window_samples);
+            e->mel.reserve(profile->window_frames);
+        }
+    }
+    
+    bool running = true;
+    while (running) {
+        running = e->is_processing;
+        wait_for_audio(e);
+        report_metrics_if_due(e);
+        
+        // Audio pushed before stop was requested is still decoded below
+        if (drain_audio_ring(e, vad.detector ? vad.input : pending) == 0 && running) {
+            continue;
+        }
+        
+        if (!e->ctx || !e->session_state) {
+            report_error(e, VB_STATUS_MODEL_NOT_LOADED, "Model not loaded");
+            pending.clear();
+            vad.input.clear();
+            continue;
+        }
+        
+        if (vad.detector) {
+            run_vad(e, pending, streaming);
+        }
+        
+        check_overload(e, pending, streaming);
+        
+        if (streaming) {
+            // Coalescing: while overloaded, partial updates wait until the
+            // window has to be decoded anyway
+            const bool coalescing = e->overloaded &&
+                e->config.overload_policy == VB_OVERLOAD_COALESCE &&
+                stream.samples.size() < (size_t) kMaxWindowSamples;
+            if (!coalescing &&
+                std::chrono::steady_clock::now() - stream.last_decode >= interval &&
+                stream.samples.size() > stream.n_samples_at_last_decode) {
+                streaming_decode_pass(e);
+            }
+            continue;
+        }
+        
+        // Batch mode decodes encoder windows as enough of them fill up
+        decode_batch(e, pending, false);
+    }
+    
+    if (!e->ctx || !e->session_state) {
+        release_session_states(e);
+        return;
+    }
+    
+    // A trailing partial VAD frame belongs to the utterance if speech is ongoing
+    if (vad.detector) {
+        if (vad.segmenter->in_speech()) {
+            pending.insert(pending.end(), vad.input.begin(), vad.input.end());
+        }
+        vad.input.clear();
+    }
+    
+    finalize_utterance(e, pending, streaming);
+    report_metrics(e);
+    
+    release_session_states(e);
+}
+
+// Public API implementation
+
+// Shared models
+static void quiet_whisper_logs() {
+    whisper_log_set([](ggml_log_level /* level */, const char* /* text */, void* /* user_data */) {
+        // Suppress whisper logs for cleaner output
+    }, nullptr);
+}
+
+// Accelerated backends to try for a model, best first. Once the device
+// benchmark has measured the model type only its fastest backend is tried,
+// which may be the CPU.
+static std::vector<vb_backend_t> preferred_backends(vb_model_type_t model_type, const char* model_path) {
+    if ((int) model_type < 0 || (int) model_type >= VB_MODEL_TYPE_COUNT) {
+        return backend_candidates(model_path);
+    }
+    const vb_model_benchmark_t measured = vb_engine_benchmark_device().models[model_type];
+    if (measured.real_time_factor <= 0.0f) {
+        return backend_candidates(model_path);
+    }
+    if (measured.backend != VB_BACKEND_CPU && backend_available(measured.backend, model_path)) {
+        return {measured.backend};
+    }
+    return {};
+}
+
+// Weights and n_states states on backend. An accelerated backend must also
+// pass its probe on the first state.
+static vb_status_t init_model_backend(vb_model* model, const char* model_path, vb_backend_t backend, int32_t n_states) {
+    // Weights only; decoder states are created explicitly below
+    model->ctx = backend_init_context(model_path, backend);
+    if (!model->ctx) {
+        return VB_STATUS_ERROR;
+    }
+    model->backend = backend;
+    
+    for (int32_t i = 0; i < std::max(1, n_states); ++i) {
+        whisper_state* state = whisper_init_state(model->ctx);
+        if (!state) {
+            return VB_STATUS_INSUFFICIENT_MEMORY;
+        }
+        model->states.all.push_back(state);
+        model->states.idle.push_back(state);
+    }
+    
+    const int n_threads = std::min<int>(kDefaultMaxThreads,
+                                        (int) std::max<size_t>(1, cpu_topology().performance_cores.size()));
+    if (backend != VB_BACKEND_CPU && !backend_probe(model->ctx, model->states.all[0], n_threads)) {
+        return VB_STATUS_ERROR;
+    }
+    return VB_STATUS_SUCCESS;
+}
+
+// With use_gpu, the preferred accelerated backends are tried first; the CPU
+// is the fallback that always remains
+static vb_status_t load_model(vb_model_type_t model_type, const char* model_path, int32_t n_states, bool use_gpu,
+                              vb_model** out) {
+    *out = nullptr;
+    quiet_whisper_logs();
+    
+    std::vector<vb_backend_t> backends;
+    if (use_gpu) {
+        backends = preferred_backends(model_type, model_path);
+    }
+    backends.push_back(VB_BACKEND_CPU);
+    
+    vb_status_t status = VB_STATUS_ERROR;
+    for (vb_backend_t backend : backends) {
+        vb_model* model = new vb_model();
+        model->type = model_type;
+        status = init_model_backend(model, model_path, backend, n_states);
+        if (status == VB_STATUS_SUCCESS) {
+            model->profile = model_profile(model_type, model->ctx);
+            *out = model;
+            return status;
+        }
+        free_model(model);
+    }
+    return status;
+}
+
+vb_model_t* vb_model_load(vb_model_type_t model_type, const char* model_path, int32_t n_states, bool use_gpu) {
+    vb_model* model = nullptr;
+    load_model(model_type, model_path, n_states, use_gpu, &model);
+    return model;
+}
+
+vb_model_t* vb_model_retain(vb_model_t* model) {
+    if (model) {
+        model->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return model;
+}
+
+void note_model_idle(vb_model* model);
+
+void vb_model_release(vb_model_t* model) {
+    if (!model) {
+        return;
+    }
+    const int prev = model->refs.fetch_sub(1, std::memory_order_acq_rel);
+    if (prev == 1) {
+        free_model(model);
+    } else if (prev == 2 && model->resident.load(std::memory_order_relaxed)) {
+        note_model_idle(model);
+    }
+}
+
+vb_model_type_t vb_model_get_type(const vb_model_t* model) {
+    return model ? model->type : VB_MODEL_TINY_EN;
+}
+
+vb_backend_t vb_model_get_backend(const vb_model_t* model) {
+    return model ? model->backend : VB_BACKEND_CPU;
+}
+
+// Resident models
+static ModelResidency& residency() {
+    // Never destroyed: the reaper thread outlives static destructors
+    static ModelResidency* r = new ModelResidency();
+    return *r;
+}
+
+static std::chrono::milliseconds residency_timeout(const ModelResidency& r) {
+    const int32_t ms = r.config.idle_timeout_ms;
+    return std::chrono::milliseconds(ms < 0 ? 0 : config_or_default(ms, kDefaultResidencyIdleMs));
+}
+
+// Drops the cache reference of models only the cache holds. Caller holds r.mutex.
+// A model whose count is 1 cannot be picked up concurrently: every other path
+// to it goes through the cache under the same lock.
+static void evict_idle_models(ModelResidency& r, bool expired_only) {
+    const auto now = std::chrono::steady_clock::now();
+    const auto timeout = residency_timeout(r);
+    for (auto it = r.models.begin(); it != r.models.end();) {
+        if (it->model->refs.load(std::memory_order_acquire) > 1) {
+            it->idle = false;
+            ++it;
+            continue;
+        }
+        if (!it->idle) {
+            it->idle = true;
+            it->idle_since = now;
+        }
+        if (expired_only && now < it->idle_since + timeout) {
+            ++it;
+            continue;
+        }
+        it->model->resident = false;
+        vb_model_release(it->model);
+        it = r.models.erase(it);
+    }
+}
+
+static void residency_reaper() {
+    ModelResidency& r = residency();
+    std::unique_lock<std::mutex> lock(r.mutex);
+    for (;;) {
+        evict_idle_models(r, true);
+        
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (const ResidentModel& entry : r.models) {
+            if (entry.idle) {
+                next = std::min(next, entry.idle_since + residency_timeout(r));
+            }
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            r.wake.wait(lock);
+        } else {
+            r.wake.wait_until(lock, next);
+        }
+    }
+}
+
+void note_model_idle(vb_model* model) {
+    ModelResidency& r = residency();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (ResidentModel& entry : r.models) {
+        if (entry.model == model && !entry.idle) {
+            entry.idle = true;
+            entry.idle_since = std::chrono::steady_clock::now();
+        }
+    }
+    r.wake.notify_one();
+}
+
+static vb_model* find_resident(ModelResidency& r, vb_model_type_t model_type, const char* model_path, bool use_gpu) {
+    for (ResidentModel& entry : r.models) {
+        if (entry.model->type == model_type && entry.path == model_path && entry.use_gpu == use_gpu) {
+            entry.idle = false;
+            return vb_model_retain(entry.model);
+        }
+    }
+    return nullptr;
+}
+
+vb_model_t* vb_model_acquire(vb_model_type_t model_type, const char* model_path, int32_t n_states, bool use_gpu) {
+    if (!model_path) {
+        return nullptr;
+    }
+    ModelResidency& r = residency();
+    bool warm_up = false;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (vb_model* model = find_resident(r, model_type, model_path, use_gpu)) {
+            return model;
+        }
+        warm_up = r.config.warm_up;
+    }
+    
+    // Loaded outside the lock; a concurrent load of the same file loses the race below
+    vb_model* model = nullptr;
+    if (load_model(model_type, model_path, n_states, use_gpu, &model) != VB_STATUS_SUCCESS) {
+        return nullptr;
+    }
+    if (warm_up) {
+        vb_model_warm_up(model);
+    }
+    
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (vb_model* existing = find_resident(r, model_type, model_path, use_gpu)) {
+        vb_model_release(model);
+        return existing;
+    }
+    
+    ResidentModel entry;
+    entry.model = vb_model_retain(model);
+    entry.path = model_path;
+    entry.use_gpu = use_gpu;
+    model->resident = true;
+    r.models.push_back(entry);
+    
+    if (!r.reaper_started) {
+        std::thread(residency_reaper).detach();
+        r.reaper_started = true;
+    }
+    return model;
+}
+
+void vb_engine_set_residency(const vb_residency_config_t* config) {
+    if (!config) {
+        return;
+    }
+    ModelResidency& r = residency();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.config = *config;
+    r.wake.notify_one();
+}
+
+void vb_engine_trim_memory(vb_trim_level_t level) {
+    if (level == VB_TRIM_NONE) {
+        return;
+    }
+    ModelResidency& r = residency();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    // Decoder states go first: they are cheap to rebuild, unlike the weights
+    for (ResidentModel& entry : r.models) {
+        trim_idle_states(entry.model);
+    }
+    if (level >= VB_TRIM_MODELS) {
+        evict_idle_models(r, false);
+    }
+}
+
+vb_status_t vb_model_warm_up(vb_model_t* model) {
+    if (!model) {
+        return VB_STATUS_MODEL_NOT_LOADED;
+    }
+    whisper_state* state = acquire_state(model);
+    if (!state) {
+        return VB_STATUS_INSUFFICIENT_MEMORY;
+    }
+    
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    wparams.n_threads = std::min<int>(kDefaultMaxThreads,
+                                      (int) std::max<size_t>(1, cpu_topology().performance_cores.size()));
+    wparams.no_context = true;
+    wparams.single_segment = true;
+    wparams.no_timestamps = true;
+    wparams.max_tokens = 1;
+    wparams.print_realtime = false;
+    wparams.print_progress = false;
+    wparams.print_timestamps = false;
+    wparams.print_special = false;
+    
+    // Full-size encoder window, so every weight and compute buffer page is touched
+    const std::vector<float> silence(kMinDecodeSamples, 0.0f);
+    const int result = whisper_full_with_state(model->ctx, state, wparams, silence.data(), (int) silence.size());
+    release_state(model, state);
+    return result == 0 ? VB_STATUS_SUCCESS : VB_STATUS_ERROR;
+}
+
+// Sessions
+vb_engine_t* vb_engine_create(const vb_engine_config_t* config, vb_model_t* model) {
+    if (!config) {
+        return nullptr;
+    }
+    
+    vb_engine* e = new vb_engine();
+    e->config = *config;
+    vb_engine_set_model(e, model);
+    return e;
+}
+
+void vb_engine_destroy(vb_engine_t* e) {
+    if (!e || e == &g_default_engine) {
+        return;
+    }
+    vb_engine_session_stop(e);
+    vb_engine_set_model(e, nullptr);
+    vb_engine_set_rescore_model(e, nullptr);
+    vb_engine_set_fallback_model(e, nullptr);
+    delete e;
+}
+
+vb_status_t vb_engine_set_model(vb_engine_t* e, vb_model_t* model) {
+    if (!e) {
+        return VB_STATUS_ERROR;
+    }
+    // The processing thread holds a state from the model's pool
+    if (e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
     
-    std::atomic<bool> is_processing{false};
-    std::mutex audio_mutex;
-    std::queue<vb_audio_buffer_t> audio_queue;
-    std::unique_ptr<std::thread> processing_thread;
-};
+    vb_model_retain(model);
+    vb_model_release(e->model);
+    e->model = model;
+    e->ctx = model ? model->ctx : nullptr;
+    return VB_STATUS_SUCCESS;
+}
 
-static WhisperEngineState g_engine_state;
+vb_status_t vb_engine_set_rescore_model(vb_engine_t* e, vb_model_t* model) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    
+    vb_model_retain(model);
+    vb_model_release(e->rescore_model);
+    e->rescore_model = model;
+    return VB_STATUS_SUCCESS;
+}
 
-// Helper functions
-const char* model_type_to_filename(vb_model_type_t model_type) {
-    switch (model_type) {
-        case VB_MODEL_TINY_EN: return "ggml-tiny.en-q5_1.bin";
-        case VB_MODEL_BASE_EN: return "ggml-base.en-q5_1.bin";
-        case VB_MODEL_DISTIL_SMALL_EN: return "ggml-distil-small.en-q5_1.bin";
-        default: return nullptr;
+vb_status_t vb_engine_set_fallback_model(vb_engine_t* e, vb_model_t* model) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
     }
+    
+    vb_model_retain(model);
+    vb_model_release(e->fallback_model);
+    e->fallback_model = model;
+    return VB_STATUS_SUCCESS;
 }
 
-void processing_thread_func() {
-    while (g_engine_state.is_processing) {
-        vb_audio_buffer_t audio_buffer = {};
-        
-        // Get audio from queue
-        {
-            std::lock_guard<std::mutex> lock(g_engine_state.audio_mutex);
-            if (g_engine_state.audio_queue.empty()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                continue;
-            }
-            audio_buffer = g_engine_state.audio_queue.front();
-            g_engine_state.audio_queue.pop();
+bool vb_engine_has_model(const vb_engine_t* e) {
+    return e && e->ctx != nullptr;
+}
+
+vb_status_t vb_engine_session_start(vb_engine_t* e,
+                                    vb_transcription_callback_t callback,
+                                    vb_error_callback_t error_callback,
+                                    void* user_data) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    
+    e->transcription_callback = callback;
+    e->error_callback = error_callback;
+    e->user_data = user_data;
+    
+    // Preallocate the capture ring so the audio thread never allocates
+    const int32_t ring_ms = e->config.ring_buffer_ms > 0
+        ? e->config.ring_buffer_ms : kDefaultRingBufferMs;
+    e->audio_ring.allocate((size_t) ring_ms * WHISPER_SAMPLE_RATE / 1000);
+    e->dropped_samples = 0;
+    e->consumer_waiting = false;
+    e->producer_waiting = false;
+    e->pre_emphasis_prev = 0.0f;
+    e->level_peak = 0.0f;
+    e->level_sum_squares = 0.0;
+    e->level_n_samples = 0;
+    e->capture_resampler.reset();
+    e->capture_scratch.resize(kCaptureScratchSamples);
+    e->input_rms = 0.0f;
+    e->input_peak = 0.0f;
+    e->metrics.reset();
+    
+    // Streaming wakes once per partial update; batch mode only needs to keep the ring drained
+    const size_t half_ring = e->audio_ring.capacity() / 2;
+    size_t threshold = half_ring;
+    if (e->config.enable_partial_results) {
+        const int32_t interval_ms = e->config.partial_update_interval_ms > 0
+            ? e->config.partial_update_interval_ms : kDefaultPartialIntervalMs;
+        threshold = std::min(half_ring, (size_t) interval_ms * WHISPER_SAMPLE_RATE / 1000);
+    }
+    // The VAD needs to see silence as it arrives, or an endpoint is only
+    // noticed once the ring is half full
+    if (e->config.vad_mode != VB_VAD_OFF) {
+        const int32_t vad_wake_ms = std::min({kVadWakeMs,
+                                              config_or_default(e->config.vad_hangover_ms, kDefaultVadHangoverMs),
+                                              config_or_default(e->config.vad_endpoint_ms, kDefaultVadEndpointMs)});
+        threshold = std::min(threshold, (size_t) vad_wake_ms * WHISPER_SAMPLE_RATE / 1000);
+    }
+    e->wake_threshold = std::max<size_t>(threshold, 1);
+    
+    e->is_processing = true;
+    
+    e->processing_thread = std::make_unique<std::thread>(processing_thread_func, e);
+    
+    return VB_STATUS_SUCCESS;
+}
+
+// Producer side: wake the worker once enough audio is buffered
+static void notify_consumer(vb_engine* e) {
+    if (e->audio_ring.available() >= e->wake_threshold &&
+        e->consumer_waiting.exchange(false)) {
+        e->audio_ready.notify();
+    }
+}
+
+static bool needs_ingest_preprocessing(const vb_engine* e) {
+    return e->config.pre_emphasis != 0.0f ||
+           e->config.normalize_mode != VB_NORMALIZE_NONE;
+}
+
+static void preprocess_into(vb_engine* e, const float* in, float* out, size_t n, AudioLevelStats* stats) {
+    if (!needs_ingest_preprocessing(e)) {
+        memcpy(out, in, n * sizeof(float));
+        return;
+    }
+    dsp_preprocess_f32(in, out, n, e->config.pre_emphasis,
+                       &e->pre_emphasis_prev, stats);
+}
+
+static void preprocess_into(vb_engine* e, const int16_t* in, float* out, size_t n, AudioLevelStats* stats) {
+    dsp_convert_pcm16(in, out, n, e->config.pre_emphasis,
+                      &e->pre_emphasis_prev, stats);
+}
+
+// VB_OVERLOAD_BLOCK: sleep until the worker has drained some of the full ring.
+// Returns false once the session is stopping.
+static bool wait_for_space(vb_engine* e) {
+    while (e->is_processing && e->audio_ring.free_space() == 0) {
+        e->producer_waiting.store(true);
+        // Same handshake as wait_for_audio, in the other direction
+        if (!e->is_processing || e->audio_ring.free_space() > 0) {
+            e->producer_waiting.store(false);
+            break;
         }
-        
-        if (!g_engine_state.ctx) {
-            if (g_engine_state.error_callback) {
-                g_engine_state.error_callback(VB_STATUS_MODEL_NOT_LOADED, 
-                    "Model not loaded", g_engine_state.user_data);
-            }
-            continue;
+        notify_consumer(e);
+        e->space_ready.wait();
+    }
+    return e->is_processing;
+}
+
+// Held by every producer call for its whole run. Registering before checking
+// is_processing pairs with stop clearing it before waiting for the count to
+// drop, so once stop returns no producer is writing to the ring.
+struct ProducerScope {
+    explicit ProducerScope(vb_engine* e) : engine(e) {
+        if (engine) {
+            engine->producers_in_flight.fetch_add(1);
         }
-        
-        // Process audio with Whisper
-        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-        wparams.n_threads = g_engine_state.config.n_threads;
-        wparams.offset_ms = 0;
-        wparams.duration_ms = 0;
-        wparams.translate = false;
-        wparams.no_context = false;
-        wparams.single_segment = false;
-        wparams.print_realtime = false;
-        wparams.print_progress = false;
-        wparams.print_timestamps = false;
-        wparams.print_special = false;
-        
-        int result = whisper_full(g_engine_state.ctx, wparams, 
-                                  audio_buffer.samples, audio_buffer.n_samples);
-        
-        if (result != 0) {
-            if (g_engine_state.error_callback) {
-                g_engine_state.error_callback(VB_STATUS_ERROR, 
-                    "Whisper processing failed", g_engine_state.user_data);
-            }
-            continue;
+    }
+    ~ProducerScope() {
+        if (engine) {
+            engine->producers_in_flight.fetch_sub(1);
         }
-        
-        // Extract results
-        const int n_segments = whisper_full_n_segments(g_engine_state.ctx);
-        for (int i = 0; i < n_segments; ++i) {
-            const char* text = whisper_full_get_segment_text(g_engine_state.ctx, i);
-            const int64_t t0 = whisper_full_get_segment_t0(g_engine_state.ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(g_engine_state.ctx, i);
-            
-            vb_transcription_result_t result = {};
-            result.text = const_cast<char*>(text);
-            result.confidence = 1.0f; // Whisper doesn't provide confidence scores
-            result.timestamp_ms = t0 * 10; // Convert from centiseconds to milliseconds
-            result.is_final = (i == n_segments - 1);
-            
-            if (g_engine_state.transcription_callback) {
-                g_engine_state.transcription_callback(&result, g_engine_state.user_data);
+    }
+    ProducerScope(const ProducerScope&) = delete;
+    ProducerScope& operator=(const ProducerScope&) = delete;
+    
+    bool running() const { return engine && engine->is_processing; }
+    
+    vb_engine* engine;
+};
+
+// Convert/preprocess samples straight into spans of the capture ring
+template <typename T>
+vb_status_t ingest_audio(vb_engine* e, const T* samples, size_t n) {
+    AudioLevelStats stats;
+    stats.peak = e->level_peak.load(std::memory_order_relaxed);
+    
+    size_t written = 0;
+    while (written < n) {
+        size_t granted = 0;
+        float* span = e->audio_ring.acquire_write(n - written, &granted);
+        if (granted == 0) {
+            if (e->config.overload_policy == VB_OVERLOAD_BLOCK && wait_for_space(e)) {
+                continue;
             }
+            break;
         }
-        
-        // Cleanup audio buffer
-        delete[] audio_buffer.samples;
+        preprocess_into(e, samples + written, span, granted, &stats);
+        e->audio_ring.commit_write(granted);
+        written += granted;
+    }
+    
+    if (stats.n_samples > 0) {
+        e->level_peak.store(stats.peak, std::memory_order_relaxed);
+        e->level_sum_squares.store(
+            e->level_sum_squares.load(std::memory_order_relaxed) + stats.sum_squares,
+            std::memory_order_relaxed);
+        e->level_n_samples.store(
+            e->level_n_samples.load(std::memory_order_relaxed) + stats.n_samples,
+            std::memory_order_relaxed);
+    }
+    
+    notify_consumer(e);
+    
+    if (written < n) {
+        // The worker fell behind and the ring is full (or the session stopped
+        // while blocked); the tail of this chunk is lost
+        e->dropped_samples += n - written;
+        return VB_STATUS_AUDIO_ERROR;
     }
+    
+    return VB_STATUS_SUCCESS;
 }
 
-// Public API implementation
-vb_status_t vb_engine_init(const vb_engine_config_t* config) {
-    if (!config) {
+vb_status_t vb_engine_session_process_audio(vb_engine_t* e, const vb_audio_buffer_t* audio_buffer) {
+    ProducerScope producer(e);
+    if (!producer.running()) {
+        return VB_STATUS_ERROR;
+    }
+    if (!audio_buffer || !audio_buffer->samples || audio_buffer->n_samples < 0) {
+        return VB_STATUS_AUDIO_ERROR;
+    }
+    
+    return ingest_audio(e, audio_buffer->samples, (size_t) audio_buffer->n_samples);
+}
+
+vb_status_t vb_engine_session_process_audio_i16(vb_engine_t* e, const vb_audio_buffer_i16_t* audio_buffer) {
+    ProducerScope producer(e);
+    if (!producer.running()) {
         return VB_STATUS_ERROR;
     }
+    if (!audio_buffer || !audio_buffer->samples || audio_buffer->n_samples < 0) {
+        return VB_STATUS_AUDIO_ERROR;
+    }
     
-    g_engine_state.config = *config;
+    return ingest_audio(e, audio_buffer->samples, (size_t) audio_buffer->n_samples);
+}
+
+// Level of the latest capture buffer, for vb_engine_get_input_level
+static void store_input_level(vb_engine* e, const AudioLevelStats& level) {
+    if (level.n_samples > 0) {
+        e->input_rms.store((float) std::sqrt(level.sum_squares / (double) level.n_samples),
+                           std::memory_order_relaxed);
+        e->input_peak.store(level.peak, std::memory_order_relaxed);
+    }
+}
+
+vb_status_t vb_engine_session_process_capture(vb_engine_t* e, const vb_audio_buffer_t* audio_buffer) {
+    ProducerScope producer(e);
+    if (!e) {
+        return VB_STATUS_ERROR;
+    }
+    if (!audio_buffer || !audio_buffer->samples || audio_buffer->n_samples < 0) {
+        return VB_STATUS_AUDIO_ERROR;
+    }
     
-    // Initialize whisper
-    whisper_log_set([](ggml_log_level level, const char* text, void* user_data) {
-        // Suppress whisper logs for cleaner output
-    }, nullptr);
+    // The meter stays live between sessions; the audio itself goes nowhere
+    if (!producer.running()) {
+        AudioLevelStats level;
+        dsp_measure_level(audio_buffer->samples, (size_t) audio_buffer->n_samples, &level);
+        store_input_level(e, level);
+        return VB_STATUS_ERROR;
+    }
+    
+    Resampler& resampler = e->capture_resampler;
+    if (audio_buffer->sample_rate != resampler.in_rate() &&
+        !resampler.configure(audio_buffer->sample_rate, WHISPER_SAMPLE_RATE)) {
+        return VB_STATUS_AUDIO_ERROR;
+    }
+    
+    AudioLevelStats level;
+    vb_status_t status = VB_STATUS_SUCCESS;
+    const size_t n = (size_t) audio_buffer->n_samples;
+    for (size_t done = 0; done < n; ) {
+        const float* in = audio_buffer->samples + done;
+        const size_t block = std::min(n - done, kCaptureBlockSamples);
+        float* scratch = e->capture_scratch.data();
+        size_t n_out = block;
+        if (resampler.passthrough()) {
+            float prev = 0.0f;
+            dsp_preprocess_f32(in, scratch, block, 0.0f, &prev, &level);
+        } else {
+            n_out = resampler.process(in, block, scratch, &level);
+        }
+        if (ingest_audio(e, scratch, n_out) != VB_STATUS_SUCCESS) {
+            status = VB_STATUS_AUDIO_ERROR;
+        }
+        done += block;
+    }
     
+    store_input_level(e, level);
+    return status;
+}
+
+vb_status_t vb_engine_session_get_input_level(vb_engine_t* e, vb_input_level_t* level) {
+    if (!e || !level) {
+        return VB_STATUS_ERROR;
+    }
+    level->rms = e->input_rms.load(std::memory_order_relaxed);
+    level->peak = e->input_peak.load(std::memory_order_relaxed);
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_load_model(vb_model_type_t model_type, const char* model_path) {
-    if (g_engine_state.ctx) {
-        whisper_free(g_engine_state.ctx);
-        g_engine_state.ctx = nullptr;
+vb_status_t vb_engine_session_acquire_audio_span(vb_engine_t* e, int32_t max_samples,
+                                                 float** samples, int32_t* n_samples) {
+    if (!samples || !n_samples || max_samples < 0) {
+        return VB_STATUS_AUDIO_ERROR;
     }
+    *samples = nullptr;
+    *n_samples = 0;
     
-    g_engine_state.ctx = whisper_init_from_file(model_path);
-    if (!g_engine_state.ctx) {
+    ProducerScope producer(e);
+    if (!producer.running()) {
         return VB_STATUS_ERROR;
     }
     
+    size_t granted = 0;
+    float* span = e->audio_ring.acquire_write((size_t) max_samples, &granted);
+    if (granted == 0 && max_samples > 0) {
+        return VB_STATUS_AUDIO_ERROR;
+    }
+    
+    *samples = span;
+    *n_samples = (int32_t) granted;
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_unload_model(void) {
-    if (g_engine_state.ctx) {
-        whisper_free(g_engine_state.ctx);
-        g_engine_state.ctx = nullptr;
+vb_status_t vb_engine_session_commit_audio_span(vb_engine_t* e, int32_t n_samples) {
+    ProducerScope producer(e);
+    if (!producer.running()) {
+        return VB_STATUS_ERROR;
+    }
+    if (n_samples < 0 || (size_t) n_samples > e->audio_ring.free_space()) {
+        return VB_STATUS_AUDIO_ERROR;
     }
+    
+    e->audio_ring.commit_write((size_t) n_samples);
+    notify_consumer(e);
+    
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_cleanup(void) {
-    vb_engine_stop_transcription();
-    vb_engine_unload_model();
+vb_status_t vb_engine_session_stop(vb_engine_t* e) {
+    if (!e) {
+        return VB_STATUS_ERROR;
+    }
+    
+    e->is_processing = false;
+    e->audio_ready.notify();
+    e->space_ready.notify();
+    
+    // A capture call that got past its check may still be writing; the ring
+    // is only reset once it has left
+    while (e->producers_in_flight.load() != 0) {
+        std::this_thread::yield();
+    }
+    
+    if (e->processing_thread && e->processing_thread->joinable()) {
+        e->processing_thread->join();
+    }
+    e->processing_thread.reset();
+    
+    e->audio_ring.reset();
+    
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_start_transcription(vb_transcription_callback_t callback, 
-                                          vb_error_callback_t error_callback,
-                                          void* user_data) {
-    if (g_engine_state.is_processing) {
+vb_status_t vb_engine_session_set_vad_callback(vb_engine_t* e, vb_vad_callback_t callback, void* user_data) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    e->vad_callback = callback;
+    e->vad_user_data = user_data;
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_session_set_vad_classifier(vb_engine_t* e, vb_vad_classifier_t classifier, void* user_data) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    e->vad_classifier = classifier;
+    e->vad_classifier_user_data = user_data;
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_session_get_metrics(vb_engine_t* e, vb_engine_metrics_t* metrics) {
+    if (!e || !metrics) {
+        return VB_STATUS_ERROR;
+    }
+    e->metrics.snapshot(e->dropped_samples.load(), metrics);
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_session_set_metrics_callback(vb_engine_t* e, vb_metrics_callback_t callback,
+                                                   int32_t interval_ms, void* user_data) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    e->metrics_callback = callback;
+    e->metrics_interval_ms = interval_ms;
+    e->metrics_user_data = user_data;
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_session_set_transport(vb_engine_t* e, vb_transport_t* transport) {
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    e->transport = transport;
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_session_set_vocabulary(vb_engine_t* e, const char* vocabulary) {
+    // Tokenized by the processing thread at session start
+    if (!e || e->is_processing) {
+        return VB_STATUS_ERROR;
+    }
+    e->vocabulary = vocabulary ? vocabulary : "";
+    return VB_STATUS_SUCCESS;
+}
+
+// Single-session API, backed by the default session
+vb_status_t vb_engine_init(const vb_engine_config_t* config) {
+    if (!config) {
         return VB_STATUS_ERROR;
     }
     
-    g_engine_state.transcription_callback = callback;
-    g_engine_state.error_callback = error_callback;
-    g_engine_state.user_data = user_data;
-    g_engine_state.is_processing = true;
+    g_default_engine.config = *config;
     
-    g_engine_state.processing_thread = std::make_unique<std::thread>(processing_thread_func);
+    // Initialize whisper
+    quiet_whisper_logs();
     
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_process_audio(const vb_audio_buffer_t* audio_buffer) {
-    if (!g_engine_state.is_processing) {
+vb_status_t vb_engine_load_model(vb_model_type_t model_type, const char* model_path) {
+    if (vb_engine_unload_model() != VB_STATUS_SUCCESS) {
         return VB_STATUS_ERROR;
     }
     
-    // Copy audio buffer for thread safety
-    vb_audio_buffer_t buffer_copy = {};
-    buffer_copy.n_samples = audio_buffer->n_samples;
-    buffer_copy.sample_rate = audio_buffer->sample_rate;
-    buffer_copy.samples = new float[audio_buffer->n_samples];
-    memcpy(buffer_copy.samples, audio_buffer->samples, 
-           audio_buffer->n_samples * sizeof(float));
-    
-    {
-        std::lock_guard<std::mutex> lock(g_engine_state.audio_mutex);
-        g_engine_state.audio_queue.push(buffer_copy);
+    vb_model* model = vb_model_acquire(model_type, model_path, g_default_engine.config.n_decode_states,
+                                       g_default_engine.config.use_gpu_acceleration);
+    if (!model) {
+        return VB_STATUS_ERROR;
     }
     
+    vb_engine_set_model(&g_default_engine, model);
+    vb_model_release(model);
     return VB_STATUS_SUCCESS;
 }
 
-vb_status_t vb_engine_stop_transcription(void) {
-    g_engine_state.is_processing = false;
+vb_status_t vb_engine_unload_model(void) {
+    return vb_engine_set_model(&g_default_engine, nullptr);
+}
+
+vb_status_t vb_engine_load_rescore_model(vb_model_type_t model_type, const char* model_path) {
+    if (!model_path) {
+        return vb_engine_set_rescore_model(&g_default_engine, nullptr);
+    }
+    if (g_default_engine.is_processing) {
+        return VB_STATUS_ERROR;
+    }
     
-    if (g_engine_state.processing_thread && g_engine_state.processing_thread->joinable()) {
-        g_engine_state.processing_thread->join();
+    vb_model* model = vb_model_acquire(model_type, model_path, 1, g_default_engine.config.use_gpu_acceleration);
+    if (!model) {
+        return VB_STATUS_ERROR;
     }
-    g_engine_state.processing_thread.reset();
     
-    // Clear audio queue
-    {
-        std::lock_guard<std::mutex> lock(g_engine_state.audio_mutex);
-        while (!g_engine_state.audio_queue.empty()) {
-            auto& buffer = g_engine_state.audio_queue.front();
-            delete[] buffer.samples;
-            g_engine_state.audio_queue.pop();
-        }
+    vb_engine_set_rescore_model(&g_default_engine, model);
+    vb_model_release(model);
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_load_fallback_model(vb_model_type_t model_type, const char* model_path) {
+    if (!model_path) {
+        return vb_engine_set_fallback_model(&g_default_engine, nullptr);
+    }
+    if (g_default_engine.is_processing) {
+        return VB_STATUS_ERROR;
     }
     
+    vb_model* model = vb_model_acquire(model_type, model_path, 1, g_default_engine.config.use_gpu_acceleration);
+    if (!model) {
+        return VB_STATUS_ERROR;
+    }
+    
+    vb_engine_set_fallback_model(&g_default_engine, model);
+    vb_model_release(model);
+    return VB_STATUS_SUCCESS;
+}
+
+vb_status_t vb_engine_cleanup(void) {
+    vb_engine_stop_transcription();
+    vb_engine_unload_model();
+    vb_engine_load_rescore_model(VB_MODEL_TINY_EN, nullptr);
+    vb_engine_load_fallback_model(VB_MODEL_TINY_EN, nullptr);
     return VB_STATUS_SUCCESS;
 }
 
+vb_status_t vb_engine_start_transcription(vb_transcription_callback_t callback, 
+                                          vb_error_callback_t error_callback,
+                                          void* user_data) {
+    return vb_engine_session_start(&g_default_engine, callback, error_callback, user_data);
+}
+
+vb_status_t vb_engine_process_audio(const vb_audio_buffer_t* audio_buffer) {
+    return vb_engine_session_process_audio(&g_default_engine, audio_buffer);
+}
+
+vb_status_t vb_engine_process_audio_i16(const vb_audio_buffer_i16_t* audio_buffer) {
+    return vb_engine_session_process_audio_i16(&g_default_engine, audio_buffer);
+}
+
+vb_status_t vb_engine_acquire_audio_span(int32_t max_samples, float** samples, int32_t* n_samples) {
+    return vb_engine_session_acquire_audio_span(&g_default_engine, max_samples, samples, n_samples);
+}
+
+vb_status_t vb_engine_commit_audio_span(int32_t n_samples) {
+    return vb_engine_session_commit_audio_span(&g_default_engine, n_samples);
+}
+
+vb_status_t vb_engine_process_capture(const vb_audio_buffer_t* audio_buffer) {
+    return vb_engine_session_process_capture(&g_default_engine, audio_buffer);
+}
+
+vb_status_t vb_engine_get_input_level(vb_input_level_t* level) {
+    return vb_engine_session_get_input_level(&g_default_engine, level);
+}
+
+vb_status_t vb_engine_stop_transcription(void) {
+    return vb_engine_session_stop(&g_default_engine);
+}
+
+vb_status_t vb_engine_set_vad_callback(vb_vad_callback_t callback, void* user_data) {
+    return vb_engine_session_set_vad_callback(&g_default_engine, callback, user_data);
+}
+
+vb_status_t vb_engine_set_vad_classifier(vb_vad_classifier_t classifier, void* user_data) {
+    return vb_engine_session_set_vad_classifier(&g_default_engine, classifier, user_data);
+}
+
+vb_status_t vb_engine_get_metrics(vb_engine_metrics_t* metrics) {
+    return vb_engine_session_get_metrics(&g_default_engine, metrics);
+}
+
+vb_status_t vb_engine_set_metrics_callback(vb_metrics_callback_t callback, int32_t interval_ms, void* user_data) {
+    return vb_engine_session_set_metrics_callback(&g_default_engine, callback, interval_ms, user_data);
+}
+
+vb_status_t vb_engine_set_vocabulary(const char* vocabulary) {
+    return vb_engine_session_set_vocabulary(&g_default_engine, vocabulary);
+}
+
+vb_status_t vb_engine_set_transport(vb_transport_t* transport) {
+    return vb_engine_session_set_transport(&g_default_engine, transport);
+}
+
 bool vb_engine_is_model_loaded(void) {
-    return g_engine_state.ctx != nullptr;
+    return vb_engine_has_model(&g_default_engine);
+}
+
+void vb_engine_set_thermal_state(vb_thermal_state_t state) {
+    set_thermal_state(state);
 }
 
 const char* vb_engine_get_version(void) {
     return "VoiceBoard Engine 1.0.0";
 }
 
+const char* vb_engine_backend_to_string(vb_backend_t backend) {
+    switch (backend) {
+        case VB_BACKEND_CPU: return "CPU";
+        case VB_BACKEND_METAL: return "Metal";
+        case VB_BACKEND_COREML: return "Core ML";
+        default: return "Unknown backend";
+    }
+}
+
+const char* vb_engine_quantization_to_string(vb_quantization_t quantization) {
+    switch (quantization) {
+        case VB_QUANT_Q5_1: return "q5_1";
+        case VB_QUANT_Q8_0: return "q8_0";
+        case VB_QUANT_Q4_0: return "q4_0";
+        default: return "Unknown quantization";
+    }
+}
+
 const char* vb_engine_status_to_string(vb_status_t status) {
     switch (status) {
         case VB_STATUS_SUCCESS: return "Success";
@@ -221,36 +2643,84 @@ const char* vb_engine_status_to_string(vb_status_t status) {
         case VB_STATUS_MODEL_NOT_LOADED: return "Model not loaded";
         case VB_STATUS_AUDIO_ERROR: return "Audio error";
         case VB_STATUS_INSUFFICIENT_MEMORY: return "Insufficient memory";
+        case VB_STATUS_OVERLOADED: return "Overloaded";
+        case VB_STATUS_INTEGRITY_ERROR: return "Model integrity check failed";
         default: return "Unknown status";
     }
 }
 
-// Placeholder implementations - will be expanded
+// Result of the last vb_engine_benchmark_models call
+static std::mutex g_capabilities_mutex;
+static bool g_has_capabilities = false;
+static vb_device_capabilities_t g_capabilities;
+
+vb_status_t vb_engine_benchmark_models(const char* const* model_paths, const char* cache_path,
+                                       vb_device_capabilities_t* caps) {
+    vb_device_capabilities_t result;
+    const vb_status_t status = device_benchmark_run(model_paths, cache_path, &result);
+    if (status == VB_STATUS_SUCCESS) {
+        std::lock_guard<std::mutex> lock(g_capabilities_mutex);
+        g_capabilities = result;
+        g_has_capabilities = true;
+    }
+    if (caps) {
+        *caps = result;
+    }
+    return status;
+}
+
 vb_device_capabilities_t vb_engine_benchmark_device(void) {
-    vb_device_capabilities_t caps = {};
-    caps.cpu_score = 1000.0f; // Placeholder
-    caps.memory_mb = 4096.0f;
-    caps.has_neural_engine = false;
-    caps.has_gpu_acceleration = false;
-    caps.recommended_model = VB_MODEL_BASE_EN;
-    return caps;
+    {
+        std::lock_guard<std::mutex> lock(g_capabilities_mutex);
+        if (g_has_capabilities) {
+            return g_capabilities;
+        }
+    }
+    return device_benchmark_defaults();
 }
 
-vb_status_t vb_engine_download_model(vb_model_type_t model_type, const char* download_path) {
-    // Placeholder - in real implementation would download from server
-    return VB_STATUS_SUCCESS;
+vb_status_t vb_engine_download_model(vb_model_type_t model_type, const char* models_dir,
+                                     vb_model_fetch_callback_t fetch, void* user_data) {
+    return model_registry_download(model_type, models_dir, fetch, user_data);
 }
 
 bool vb_engine_is_model_available(vb_model_type_t model_type, const char* models_dir) {
-    // Placeholder - would check if model file exists
-    return false;
+    return model_registry_is_available(model_type, models_dir);
+}
+
+vb_status_t vb_engine_verify_model(vb_model_type_t model_type, const char* models_dir) {
+    return model_registry_verify(model_type, models_dir);
 }
 
 int64_t vb_engine_get_model_size(vb_model_type_t model_type) {
-    switch (model_type) {
-        case VB_MODEL_TINY_EN: return 39 * 1024 * 1024; // ~39MB
-        case VB_MODEL_BASE_EN: return 148 * 1024 * 1024; // ~148MB  
-        case VB_MODEL_DISTIL_SMALL_EN: return 244 * 1024 * 1024; // ~244MB
-        default: return 0;
+    const ModelSpec* spec = model_registry_spec(model_type);
+    return spec ? spec->size_bytes : 0;
+}
+
+const char* vb_engine_get_model_filename(vb_model_type_t model_type) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    return spec ? spec->filename : nullptr;
+}
+
+vb_quantization_t vb_engine_recommend_quantization(vb_model_type_t model_type, int64_t memory_budget_bytes) {
+    const ModelSpec* spec = model_registry_spec(model_type);
+    if (!spec) {
+        return VB_QUANT_Q5_1;
     }
+    return device_benchmark_quantization(vb_engine_benchmark_device(), model_type, spec->size_bytes,
+                                         memory_budget_bytes);
+}
+
+vb_status_t vb_engine_prepare_model_variant(vb_model_type_t model_type, vb_quantization_t quantization,
+                                            const char* models_dir) {
+    return model_registry_prepare_variant(model_type, quantization, models_dir);
+}
+
+bool vb_engine_is_model_variant_available(vb_model_type_t model_type, vb_quantization_t quantization,
+                                          const char* models_dir) {
+    return model_registry_is_variant_available(model_type, quantization, models_dir);
+}
+
+const char* vb_engine_get_model_variant_filename(vb_model_type_t model_type, vb_quantization_t quantization) {
+    return model_registry_variant_filename(model_type, quantization);
 }
\ No newline at end of file
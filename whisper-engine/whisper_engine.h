@@ -7,29 +7,224 @@
 extern "C" {
 #endif
 
+// Opaque handles. A model holds read-only weights and a pool of decoder
+// states; any number of sessions can share one model. A session owns its own
+// config, capture ring, worker thread and streaming state.
+typedef struct vb_model vb_model_t;
+typedef struct vb_engine vb_engine_t;
+typedef struct vb_transport vb_transport_t;
+
+// Shared models. vb_model_load returns a model with one reference and
+// n_states preallocated decoder states (more are created on demand when
+// more sessions run at once). Returns NULL on failure. With use_gpu the model
+// goes to the fastest accelerated backend available (the one
+// vb_engine_benchmark_models measured fastest, once it has run), after a
+// probe pass; when none is built in or the probe fails it loads on the CPU.
+// vb_model_get_backend tells where it ended up.
+vb_model_t* vb_model_load(vb_model_type_t model_type, const char* model_path, int32_t n_states, bool use_gpu);
+vb_model_t* vb_model_retain(vb_model_t* model);
+void vb_model_release(vb_model_t* model);
+vb_model_type_t vb_model_get_type(const vb_model_t* model);
+vb_backend_t vb_model_get_backend(const vb_model_t* model);
+
+// Resident models. vb_model_acquire returns a reference to a model from a
+// process-wide cache keyed by type, path and use_gpu, loading it on a miss. Once only
+// the cache holds it, the model stays loaded for the residency idle timeout,
+// so a session started shortly after the last one ended skips the load.
+// Release it with vb_model_release. The single-session API loads through it.
+vb_model_t* vb_model_acquire(vb_model_type_t model_type, const char* model_path, int32_t n_states, bool use_gpu);
+void vb_engine_set_residency(const vb_residency_config_t* config);
+
+// Memory pressure: VB_TRIM_STATES frees idle decoder states of cached models
+// (recreated on the next session), VB_TRIM_MODELS also unloads cached models
+// that no session or caller holds
+void vb_engine_trim_memory(vb_trim_level_t level);
+
+// One short decode of silence, paying first-run costs (weight page faults,
+// compute buffer first touch) up front. Takes about one encoder pass.
+vb_status_t vb_model_warm_up(vb_model_t* model);
+
+// Sessions. A session retains its model; the caller may release its own
+// reference right after vb_engine_create/vb_engine_set_model.
+vb_engine_t* vb_engine_create(const vb_engine_config_t* config, vb_model_t* model);
+void vb_engine_destroy(vb_engine_t* engine);
+vb_status_t vb_engine_set_model(vb_engine_t* engine, vb_model_t* model);
+bool vb_engine_has_model(const vb_engine_t* engine);
+
+// Cascaded decoding. With a rescoring model attached, the session model (e.g.
+// tiny.en) only produces partials; when an utterance is finalized (VAD
+// endpoint, full window or stop) its audio is re-decoded with the rescoring
+// model (base.en or distil-small.en) and that text is emitted as final.
+// Batch sessions decode with the rescoring model directly. NULL detaches it.
+vb_status_t vb_engine_set_rescore_model(vb_engine_t* engine, vb_model_t* model);
+
+// Faster model for VB_OVERLOAD_DOWNGRADE (e.g. tiny.en under base.en). When
+// the session falls behind it decodes with this model until it stops. NULL
+// detaches it.
+vb_status_t vb_engine_set_fallback_model(vb_engine_t* engine, vb_model_t* model);
+
+// Per-session equivalents of the single-session calls below
+vb_status_t vb_engine_session_start(vb_engine_t* engine,
+                                    vb_transcription_callback_t callback,
+                                    vb_error_callback_t error_callback,
+                                    void* user_data);
+vb_status_t vb_engine_session_process_audio(vb_engine_t* engine, const vb_audio_buffer_t* audio_buffer);
+vb_status_t vb_engine_session_process_audio_i16(vb_engine_t* engine, const vb_audio_buffer_i16_t* audio_buffer);
+vb_status_t vb_engine_session_acquire_audio_span(vb_engine_t* engine, int32_t max_samples,
+                                                 float** samples, int32_t* n_samples);
+vb_status_t vb_engine_session_commit_audio_span(vb_engine_t* engine, int32_t n_samples);
+vb_status_t vb_engine_session_process_capture(vb_engine_t* engine, const vb_audio_buffer_t* audio_buffer);
+vb_status_t vb_engine_session_get_input_level(vb_engine_t* engine, vb_input_level_t* level);
+vb_status_t vb_engine_session_stop(vb_engine_t* engine);
+vb_status_t vb_engine_session_set_vad_callback(vb_engine_t* engine, vb_vad_callback_t callback, void* user_data);
+vb_status_t vb_engine_session_set_vad_classifier(vb_engine_t* engine, vb_vad_classifier_t classifier, void* user_data);
+vb_status_t vb_engine_session_get_metrics(vb_engine_t* engine, vb_engine_metrics_t* metrics);
+vb_status_t vb_engine_session_set_metrics_callback(vb_engine_t* engine, vb_metrics_callback_t callback,
+                                                   int32_t interval_ms, void* user_data);
+vb_status_t vb_engine_session_set_vocabulary(vb_engine_t* engine, const char* vocabulary);
+vb_status_t vb_engine_session_set_transport(vb_engine_t* engine, vb_transport_t* transport);
+
+// Single-session API, operating on a built-in default session
 // Engine lifecycle
 vb_status_t vb_engine_init(const vb_engine_config_t* config);
 vb_status_t vb_engine_load_model(vb_model_type_t model_type, const char* model_path);
 vb_status_t vb_engine_unload_model(void);
+// Attach a rescoring model to the default session; a NULL path detaches it
+vb_status_t vb_engine_load_rescore_model(vb_model_type_t model_type, const char* model_path);
+// Attach a fallback model for VB_OVERLOAD_DOWNGRADE; a NULL path detaches it
+vb_status_t vb_engine_load_fallback_model(vb_model_type_t model_type, const char* model_path);
+// Cached models stay loaded until the residency timeout or vb_engine_trim_memory
 vb_status_t vb_engine_cleanup(void);
 
 // Audio processing
 vb_status_t vb_engine_start_transcription(vb_transcription_callback_t callback, 
                                           vb_error_callback_t error_callback,
                                           void* user_data);
+// Copies 16kHz mono samples into the engine's capture ring without blocking or
+// allocating. Returns VB_STATUS_AUDIO_ERROR if the ring overflowed. With
+// VB_OVERLOAD_BLOCK it waits for room instead, so only call it from a thread
+// that may block. Without partial results, audio is decoded per 30s window
+// and at stop.
 vb_status_t vb_engine_process_audio(const vb_audio_buffer_t* audio_buffer);
+
+// 16-bit PCM ingestion. Conversion to float, pre-emphasis and level tracking
+// for normalization happen natively in one SIMD pass straight into the ring.
+vb_status_t vb_engine_process_audio_i16(const vb_audio_buffer_i16_t* audio_buffer);
+
+// Zero-copy ingestion: borrow a writable span of up to max_samples floats
+// directly inside the capture ring, fill it, then publish it with commit.
+// The span may be shorter than requested when the ring wraps; call again for
+// the rest. Only the capture thread may hold a span. Samples written through a
+// span bypass ingest preprocessing (pre-emphasis, level tracking). Commit a
+// span before stopping the session; the ring is reset once stop returns.
+vb_status_t vb_engine_acquire_audio_span(int32_t max_samples, float** samples, int32_t* n_samples);
+vb_status_t vb_engine_commit_audio_span(int32_t n_samples);
+
+// Capture tap ingestion: mono float samples at the device rate
+// (audio_buffer->sample_rate, 8-192kHz) are resampled to 16kHz natively,
+// metered in the same pass and then ingested like vb_engine_process_audio.
+// Meant to be called straight from the capture thread (an AVAudioEngine tap)
+// so audio never waits on the main thread; it does not allocate. A new rate
+// (route change) restarts the resampler. vb_engine_get_input_level returns the
+// level of the most recent buffer and may be polled from any thread. Without
+// a running session a buffer is only metered and VB_STATUS_ERROR returned.
+vb_status_t vb_engine_process_capture(const vb_audio_buffer_t* audio_buffer);
+vb_status_t vb_engine_get_input_level(vb_input_level_t* level);
+
 vb_status_t vb_engine_stop_transcription(void);
 
+// Voice activity detection; set before vb_engine_start_transcription
+vb_status_t vb_engine_set_vad_callback(vb_vad_callback_t callback, void* user_data);
+vb_status_t vb_engine_set_vad_classifier(vb_vad_classifier_t classifier, void* user_data);
+
+// Metrics of the current or last session: percentiles over the most recent
+// 256 samples of each metric. May be called from any thread. The callback
+// runs on the processing thread every interval_ms (0 = 5s) and once at stop;
+// set it before vb_engine_start_transcription.
+vb_status_t vb_engine_get_metrics(vb_engine_metrics_t* metrics);
+vb_status_t vb_engine_set_metrics_callback(vb_metrics_callback_t callback, int32_t interval_ms, void* user_data);
+
+// Decoder context. Each decode is prompted with the seeded vocabulary (names,
+// jargon, comma-separated; NULL clears it) followed by the most recent
+// committed text, capped at prompt_history_tokens so decode cost stays flat.
+// Set before vb_engine_start_transcription.
+vb_status_t vb_engine_set_vocabulary(const char* vocabulary);
+
+// Cross-process results. The host app opens a transport on a file in a
+// container both processes can reach (the App Group container on iOS) and
+// attaches it to its session; every partial, final and error is then written
+// into the shared mapping straight from the processing thread. The keyboard
+// extension opens the same file as a client and waits on it, so results reach
+// it without serialization or a hop through either main thread. The other
+// direction carries commands from the extension to the host. Messages that
+// find their ring full are dropped; the gap shows in the sequence numbers.
+// The session does not own the transport: detach it (NULL) before closing it.
+// Set before vb_engine_start_transcription.
+vb_transport_t* vb_transport_open(const char* path, vb_transport_role_t role, int32_t capacity_bytes);
+void vb_transport_close(vb_transport_t* transport);
+// Write to the other process; false if the message was dropped
+bool vb_transport_write(vb_transport_t* transport, const vb_transport_message_t* message);
+// Take the next message from the other process into message, its text into
+// text (truncated to text_capacity). False when none is waiting.
+bool vb_transport_read(vb_transport_t* transport, vb_transport_message_t* message, char* text,
+                       int32_t text_capacity);
+// Wait up to timeout_ms (< 0 = forever) for a message; true if one is waiting
+bool vb_transport_wait(vb_transport_t* transport, int32_t timeout_ms);
+vb_status_t vb_engine_set_transport(vb_transport_t* transport);
+
+// Device benchmark. model_paths holds VB_MODEL_TYPE_COUNT entries indexed by
+// vb_model_type_t; NULL entries are skipped. Each model is timed (encoder pass
+// plus decoder steps on synthetic input) at several thread counts, on the CPU
+// and on each accelerated backend, which takes a few seconds per model and
+// backend, so call it off the UI thread. Later GPU loads of a measured model
+// type use its fastest backend. Results are cached in cache_path (may be NULL)
+// per device and model file.
+vb_status_t vb_engine_benchmark_models(const char* const* model_paths, const char* cache_path,
+                                       vb_device_capabilities_t* caps);
+
+// Thermal pressure from the host; caps decoder threads of adaptive sessions
+void vb_engine_set_thermal_state(vb_thermal_state_t state);
+
 // Utility functions
+// Last vb_engine_benchmark_models result, or a hardware-only estimate
 vb_device_capabilities_t vb_engine_benchmark_device(void);
 bool vb_engine_is_model_loaded(void);
 const char* vb_engine_get_version(void);
 const char* vb_engine_status_to_string(vb_status_t status);
+const char* vb_engine_backend_to_string(vb_backend_t backend);
+const char* vb_engine_quantization_to_string(vb_quantization_t quantization);
 
-// Model management
-vb_status_t vb_engine_download_model(vb_model_type_t model_type, const char* download_path);
+// Model management. Models live in models_dir under their manifest file names
+// (models/manifest.json) next to an index of verified files, so availability
+// costs a stat and a header read rather than a pass over the model.
+// vb_engine_download_model fetches through the platform's transport into a
+// .part file that is hashed as it arrives, resumes one left by a failed
+// attempt, and renames it into place only once size, SHA-256 and ggml header
+// check out (VB_STATUS_INTEGRITY_ERROR otherwise). It blocks until done, so
+// call it off the UI thread. vb_engine_verify_model re-hashes a file in full.
+vb_status_t vb_engine_download_model(vb_model_type_t model_type, const char* models_dir,
+                                     vb_model_fetch_callback_t fetch, void* user_data);
 bool vb_engine_is_model_available(vb_model_type_t model_type, const char* models_dir);
+vb_status_t vb_engine_verify_model(vb_model_type_t model_type, const char* models_dir);
 int64_t vb_engine_get_model_size(vb_model_type_t model_type);
+const char* vb_engine_get_model_filename(vb_model_type_t model_type);
+
+// Quantization variants. The manifest ships q5_1; q8_0 (faster with int8 dot
+// products or on the GPU, at q5_1 accuracy until an f16 source ships) and
+// q4_0 (smallest) are converted from it on the device. vb_engine_recommend_quantization picks one
+// from the last benchmark: q4_0 when the model would not stay under
+// memory_budget_bytes (0 = a quarter of physical memory) or decodes too
+// slowly, q8_0 when it fits and the hardware runs it fast, q5_1 otherwise.
+// vb_engine_prepare_model_variant converts and indexes the variant once the
+// q5_1 file is available (VB_STATUS_MODEL_NOT_LOADED before); it rewrites the
+// whole model, so call it off the UI thread. VB_QUANT_Q5_1 names the
+// manifest file itself.
+vb_quantization_t vb_engine_recommend_quantization(vb_model_type_t model_type, int64_t memory_budget_bytes);
+vb_status_t vb_engine_prepare_model_variant(vb_model_type_t model_type, vb_quantization_t quantization,
+                                            const char* models_dir);
+bool vb_engine_is_model_variant_available(vb_model_type_t model_type, vb_quantization_t quantization,
+                                          const char* models_dir);
+const char* vb_engine_get_model_variant_filename(vb_model_type_t model_type, vb_quantization_t quantization);
 
 #ifdef __cplusplus
 }